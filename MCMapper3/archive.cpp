@@ -0,0 +1,244 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include <iostream>
+#include <cstring>
+#include "archive.h"
+
+static const char HeaderMagic[4] = { 'M', 'C', 'T', 'A' };
+static const char FooterMagic[4] = { 'M', 'C', 'T', 'I' };
+
+CTileArchive::CTileArchive() {
+	m_writing = false;
+	m_endOffset = 0;
+}
+CTileArchive::~CTileArchive() {
+	this->close();
+}
+
+bool CTileArchive::create( const boost::filesystem::path &path )
+{
+	ArchiveHeader header;
+
+	this->close();
+
+	m_file.open( path, std::ios::out | std::ios::binary | std::ios::trunc );
+	if( !m_file.is_open() ) {
+		std::cout << " > Failed: could not create " << path << std::endl;
+		return false;
+	}
+	memcpy( header.magic, HeaderMagic, sizeof( header.magic ) );
+	header.version = ARCHIVE_VERSION;
+	m_file.write( reinterpret_cast<const char*>(&header), sizeof( header ) );
+	if( m_file.fail() ) {
+		std::cout << " > Failed: could not write " << path << std::endl;
+		m_file.close();
+		return false;
+	}
+	m_path = path;
+	m_writing = true;
+	m_endOffset = sizeof( header );
+
+	return true;
+}
+bool CTileArchive::open( const boost::filesystem::path &path )
+{
+	this->close();
+
+	try {
+		m_mappedFile.open( path.string() );
+	}
+	catch( const std::exception& ) {
+		// Fall back to reading through the file
+		if( m_mappedFile.is_open() )
+			m_mappedFile.close();
+	}
+	if( !m_mappedFile.is_open() ) {
+		m_file.open( path, std::ios::in | std::ios::binary );
+		if( !m_file.is_open() ) {
+			std::cout << " > Failed: could not open " << path << std::endl;
+			return false;
+		}
+		m_file.seekg( 0, std::ios::end );
+		m_endOffset = (boost::uint64_t)m_file.tellg();
+	}
+	else
+		m_endOffset = m_mappedFile.size();
+	m_path = path;
+	m_writing = false;
+	if( !this->readIndex() ) {
+		std::cout << " > Failed: " << path << " is not a finished tile archive" << std::endl;
+		this->close();
+		return false;
+	}
+
+	return true;
+}
+bool CTileArchive::close()
+{
+	bool succeeded;
+
+	succeeded = true;
+	if( m_writing ) {
+		succeeded = this->writeIndex();
+		if( !succeeded )
+			std::cout << " > Failed: could not write the index of " << m_path << std::endl;
+	}
+	if( m_file.is_open() )
+		m_file.close();
+	if( m_mappedFile.is_open() )
+		m_mappedFile.close();
+	m_index.clear();
+	m_writing = false;
+	m_endOffset = 0;
+
+	return succeeded;
+}
+bool CTileArchive::isOpen() const {
+	return m_file.is_open() || m_mappedFile.is_open();
+}
+
+bool CTileArchive::writeIndex()
+{
+	ArchiveFooter footer;
+	ArchiveIndexEntry entry;
+
+	// Sorted by name, so the same tiles always give the same index
+	footer.indexOffset = m_endOffset;
+	footer.entryCount = (boost::uint32_t)m_index.size();
+	memcpy( footer.magic, FooterMagic, sizeof( footer.magic ) );
+	for( std::map<std::string, Entry>::const_iterator it = m_index.begin(); it != m_index.end(); it++ ) {
+		entry.offset = it->second.offset;
+		entry.length = it->second.length;
+		entry.nameLength = (boost::uint16_t)it->first.length();
+		m_file.write( reinterpret_cast<const char*>(&entry), sizeof( entry ) );
+		m_file.write( it->first.data(), entry.nameLength );
+	}
+	m_file.write( reinterpret_cast<const char*>(&footer), sizeof( footer ) );
+	m_file.flush();
+
+	return !m_file.fail();
+}
+bool CTileArchive::readIndex()
+{
+	ArchiveHeader header;
+	ArchiveFooter footer;
+	ArchiveIndexEntry entry;
+	boost::uint64_t offset;
+	std::string name;
+	Entry value;
+
+	if( m_endOffset < sizeof( header ) + sizeof( footer ) )
+		return false;
+	if( !this->readAt( 0, &header, sizeof( header ) ) || memcmp( header.magic, HeaderMagic, sizeof( header.magic ) ) != 0 || header.version != ARCHIVE_VERSION )
+		return false;
+	if( !this->readAt( m_endOffset - sizeof( footer ), &footer, sizeof( footer ) ) || memcmp( footer.magic, FooterMagic, sizeof( footer.magic ) ) != 0 ||
+		footer.indexOffset > m_endOffset - sizeof( footer ) )
+		return false;
+
+	offset = footer.indexOffset;
+	for( boost::uint32_t i = 0; i < footer.entryCount; i++ ) {
+		if( !this->readAt( offset, &entry, sizeof( entry ) ) || entry.offset + entry.length > footer.indexOffset )
+			return false;
+		offset += sizeof( entry );
+		name.resize( entry.nameLength );
+		if( entry.nameLength > 0 && !this->readAt( offset, &name[0], entry.nameLength ) )
+			return false;
+		offset += entry.nameLength;
+		value.offset = entry.offset;
+		value.length = entry.length;
+		m_index[name] = value;
+	}
+
+	return true;
+}
+bool CTileArchive::readAt( boost::uint64_t offset, void *pData, size_t length )
+{
+	if( offset + length > m_endOffset )
+		return false;
+	if( m_mappedFile.is_open() ) {
+		memcpy( pData, m_mappedFile.data() + offset, length );
+		return true;
+	}
+
+	std::lock_guard<std::mutex> fileLock( m_fileMutex );
+	m_file.seekg( offset );
+	m_file.read( reinterpret_cast<char*>(pData), length );
+	if( m_file.fail() ) {
+		m_file.clear();
+		return false;
+	}
+	return true;
+}
+
+bool CTileArchive::append( const std::string &name, const std::vector<unsigned char> &data )
+{
+	std::lock_guard<std::mutex> fileLock( m_fileMutex );
+	Entry value;
+
+	_ASSERT_EXPR( m_writing, L"archive is not open for writing" );
+
+	m_file.write( reinterpret_cast<const char*>(data.data()), (std::streamsize)data.size() );
+	if( m_file.fail() )
+		return false;
+	value.offset = m_endOffset;
+	value.length = (boost::uint32_t)data.size();
+	m_index[name] = value;
+	m_endOffset += data.size();
+
+	return true;
+}
+bool CTileArchive::link( const std::string &source, const std::string &name )
+{
+	std::lock_guard<std::mutex> fileLock( m_fileMutex );
+	std::map<std::string, Entry>::const_iterator it;
+
+	it = m_index.find( source );
+	if( it == m_index.end() )
+		return false;
+	m_index[name] = it->second;
+	return true;
+}
+bool CTileArchive::read( const std::string &name, std::vector<unsigned char> *pData )
+{
+	std::map<std::string, Entry>::const_iterator it;
+
+	_ASSERT_EXPR( !m_writing, L"archive is open for writing" );
+
+	// The index doesn't change once the archive is open for reading
+	it = m_index.find( name );
+	if( it == m_index.end() )
+		return false;
+	pData->resize( it->second.length );
+	if( it->second.length == 0 )
+		return true;
+	return this->readAt( it->second.offset, pData->data(), it->second.length );
+}
+
+size_t CTileArchive::getCount() const {
+	return m_index.size();
+}
+const boost::filesystem::path& CTileArchive::getPath() const {
+	return m_path;
+}
\ No newline at end of file
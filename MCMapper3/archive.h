@@ -0,0 +1,136 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <boost\filesystem.hpp>
+#include <boost\filesystem\fstream.hpp>
+#include <boost\integer.hpp>
+#include <boost\iostreams\device\mapped_file.hpp>
+#include <map>
+#include <string>
+#include <vector>
+#include <mutex>
+
+#define ARCHIVE_FILE_NAME "tiles.pack"
+#define ARCHIVE_VERSION 1
+
+// Everything is stored little endian, as it is in memory on every platform this builds for
+#pragma pack(push, 1)
+struct ArchiveHeader
+{
+	char magic[4];
+	boost::uint32_t version;
+};
+struct ArchiveFooter
+{
+	boost::uint64_t indexOffset;
+	boost::uint32_t entryCount;
+	char magic[4];
+};
+// Followed by nameLength bytes of name
+struct ArchiveIndexEntry
+{
+	boost::uint64_t offset;
+	boost::uint32_t length;
+	boost::uint16_t nameLength;
+};
+#pragma pack(pop)
+
+/*
+	Packs every tile of a map into one file instead of one file per tile
+	Tiles are appended as they are written and found through an index written at the end, so a file
+	without a footer was never finished and can't be read. Tiles are named by their path under the map,
+	such as 0/r.1.2-0.jpeg, and several names can share the same data
+*/
+class CTileArchive
+{
+private:
+	struct Entry
+	{
+		boost::uint64_t offset;
+		boost::uint32_t length;
+	};
+
+	boost::filesystem::path m_path;
+	boost::filesystem::fstream m_file;
+	// Archives being read are mapped when they can be, so readers never wait on each other
+	boost::iostreams::mapped_file_source m_mappedFile;
+	bool m_writing;
+	boost::uint64_t m_endOffset;
+	std::map<std::string, Entry> m_index;
+	std::mutex m_fileMutex;
+
+	bool writeIndex();
+	bool readIndex();
+	bool readAt( boost::uint64_t offset, void *pData, size_t length );
+public:
+	CTileArchive();
+	~CTileArchive();
+
+	CTileArchive( CTileArchive const& ) = delete;
+	void operator=( CTileArchive const& ) = delete;
+
+	/*
+		@method: create
+		@returns: if the file was created
+		Replaces any archive at path with an empty one open for appending
+	*/
+	bool create( const boost::filesystem::path &path );
+	/*
+		@method: open
+		@returns: if the archive was finished and its index was read
+		Opens an archive for reading
+	*/
+	bool open( const boost::filesystem::path &path );
+	/*
+		@method: close
+		@returns: if the index was written, always true for archives opened for reading
+	*/
+	bool close();
+	bool isOpen() const;
+
+	/*
+		@method: append
+		@returns: if data was written
+		Adds a tile, a tile already stored under name is replaced in the index but stays in the file
+		Safe to call from several threads
+	*/
+	bool append( const std::string &name, const std::vector<unsigned char> &data );
+	/*
+		@method: link
+		@returns: if source was in the archive
+		Stores name as another name for the data of source
+	*/
+	bool link( const std::string &source, const std::string &name );
+	/*
+		@method: read
+		@returns: if a tile by that name was read
+		Safe to call from several threads
+	*/
+	bool read( const std::string &name, std::vector<unsigned char> *pData );
+
+	size_t getCount() const;
+	const boost::filesystem::path& getPath() const;
+};
\ No newline at end of file
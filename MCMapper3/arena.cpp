@@ -0,0 +1,104 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "arena.h"
+
+CArena::CArena() {
+	m_currentBlock = 0;
+	m_currentOffset = 0;
+	m_allocationCount = 0;
+}
+CArena::~CArena() {
+	this->release();
+}
+
+void CArena::nextBlock( size_t minimumSize )
+{
+	Block block;
+
+	// Reuse the next block if it is big enough
+	if( m_currentBlock+1 < m_blocks.size() && m_blocks[m_currentBlock+1].size >= minimumSize ) {
+		m_currentBlock++;
+		m_currentOffset = 0;
+		return;
+	}
+
+	// Otherwise insert a new one after the current block
+	block.size = minimumSize > ARENA_BLOCK_SIZE ? minimumSize : ARENA_BLOCK_SIZE;
+	block.pMemory = new char[block.size];
+	m_allocationCount++;
+	if( m_blocks.empty() ) {
+		m_blocks.push_back( block );
+		m_currentBlock = 0;
+	}
+	else {
+		m_blocks.insert( m_blocks.begin() + m_currentBlock+1, block );
+		m_currentBlock++;
+	}
+	m_currentOffset = 0;
+}
+
+void* CArena::allocate( size_t size, size_t alignment )
+{
+	size_t offset;
+
+	if( !m_blocks.empty() ) {
+		offset = (m_currentOffset + alignment-1) & ~(alignment-1);
+		if( offset + size <= m_blocks[m_currentBlock].size ) {
+			m_currentOffset = offset + size;
+			return m_blocks[m_currentBlock].pMemory + offset;
+		}
+	}
+
+	// Doesn't fit, blocks from new char[] are aligned for any fundamental type
+	this->nextBlock( size );
+	m_currentOffset = size;
+	return m_blocks[m_currentBlock].pMemory;
+}
+void CArena::reset()
+{
+	m_currentBlock = 0;
+	m_currentOffset = 0;
+}
+void CArena::release()
+{
+	for( auto it = m_blocks.begin(); it != m_blocks.end(); it++ )
+		delete[] (*it).pMemory;
+	m_blocks.clear();
+	m_currentBlock = 0;
+	m_currentOffset = 0;
+}
+
+size_t CArena::getCapacity() const
+{
+	size_t capacity;
+
+	capacity = 0;
+	for( auto it = m_blocks.begin(); it != m_blocks.end(); it++ )
+		capacity += (*it).size;
+	return capacity;
+}
+size_t CArena::getBlockAllocationCount() const {
+	return m_allocationCount;
+}
@@ -0,0 +1,84 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <vector>
+#include <new>
+
+#define ARENA_BLOCK_SIZE 65536
+
+/*
+	Monotonic allocator, memory is handed out from large blocks and only released all at once
+	Nothing allocated from an arena has its destructor called, so only trivially destructible
+	objects (or objects whose members also live in the arena) should be placed in it
+*/
+class CArena
+{
+private:
+	struct Block
+	{
+		char *pMemory;
+		size_t size;
+	};
+
+	std::vector<Block> m_blocks;
+	size_t m_currentBlock;
+	size_t m_currentOffset;
+	size_t m_allocationCount;
+
+	void nextBlock( size_t minimumSize );
+public:
+	CArena();
+	~CArena();
+
+	CArena( CArena const& ) = delete;
+	void operator=( CArena const& ) = delete;
+
+	/*
+		@method: allocate
+		@returns: size bytes of memory aligned to alignment, never null
+	*/
+	void* allocate( size_t size, size_t alignment );
+	/*
+		@method: reset
+		@returns: none
+		Releases everything allocated so far, the blocks are kept for reuse
+	*/
+	void reset();
+	/*
+		@method: release
+		@returns: none
+		Frees all the blocks
+	*/
+	void release();
+
+	template<typename T>
+	T* create() {
+		return new (this->allocate( sizeof( T ), alignof( T ) )) T();
+	}
+
+	size_t getCapacity() const;
+	size_t getBlockAllocationCount() const;
+};
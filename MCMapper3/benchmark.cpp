@@ -0,0 +1,355 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#pragma warning( disable:4996 )
+#include <boost\gil\extension\io\jpeg_dynamic_io.hpp>
+#pragma warning( default:4996 )
+#include "benchmark.h"
+#include <map>
+#include "inflate.h"
+#include "region.h"
+#include "maploader.h"
+#include "renderer.h"
+#include "blocks.h"
+#include "simd.h"
+#include "encoder.h"
+#include "tilewriter.h"
+
+// renderChunk as it was before the color table, a std::map lookup and float shading for every pixel
+static void RenderChunkReference( ChunkData *pChunkData, std::map<int, boost::gil::rgb8_pixel_t> &blockColors, boost::gil::rgb8_image_t::view_t imageView )
+{
+	int xPos, zPos;
+
+	xPos = pChunkData->xPos & 31;
+	zPos = pChunkData->zPos & 31;
+	for( int x = 0; x < CHUNK_LENGTH; x++ ) {
+		for( int z = 0; z < CHUNK_LENGTH; z++ )
+		{
+			int height;
+			unsigned char blockId;
+			boost::gil::rgb8_pixel_t color;
+			float blockShadowMult;
+
+			if( pChunkData->HeightMap[x+z*16] != 0 )
+				height = pChunkData->HeightMap[x+z*16]-1;
+			else
+				height = 0;
+			blockId = GetSectionBlock( pChunkData, x, std::min( height, 255 ), z );
+			if( blockColors.find( blockId ) == blockColors.end() )
+				color = boost::gil::rgb8_pixel_t( 0, 0, 0 );
+			else
+				color = blockColors[blockId];
+
+			blockShadowMult = 1.0f;
+			if( x != 0 ) {
+				if( pChunkData->HeightMap[(x-1)+z*16] > pChunkData->HeightMap[x+z*16] )
+					blockShadowMult = 0.5f;
+			}
+			imageView( x+xPos*16, z+zPos*16 ) = boost::gil::rgb8_pixel_t( (unsigned char)(color[0] * blockShadowMult), (unsigned char)(color[1] * blockShadowMult), (unsigned char)(color[2] * blockShadowMult) );
+		}
+	}
+}
+
+CBenchmark::CBenchmark()
+{
+}
+CBenchmark::~CBenchmark()
+{
+}
+
+bool CBenchmark::loadChunks( boost::filesystem::path regionPath, std::vector<CompressedChunk> &chunks )
+{
+	CRegionFile regionFile;
+
+	if( !regionFile.open( regionPath ) )
+		return false;
+
+	for( unsigned int i = 0; i < REGION_CHUNK_COUNT; i++ )
+	{
+		const char *pData;
+		size_t length;
+		CompressedChunk chunk;
+
+		if( !regionFile.hasChunk( i ) || !regionFile.getChunk( i, &pData, &length, &chunk.compression ) )
+			continue;
+		chunk.data.assign( pData, pData+length );
+		chunks.push_back( std::move( chunk ) );
+	}
+
+	return true;
+}
+
+bool CBenchmark::benchmarkInflate( boost::filesystem::path regionPath, unsigned int iterations )
+{
+	std::vector<CompressedChunk> chunks;
+	size_t compressedBytes;
+
+	if( !this->loadChunks( regionPath, chunks ) )
+		return false;
+	if( chunks.empty() ) {
+		std::cout << "Failed: region file has no chunks" << std::endl;
+		return false;
+	}
+	compressedBytes = 0;
+	for( auto it = chunks.begin(); it != chunks.end(); it++ )
+		compressedBytes += (*it).data.size();
+	std::cout << "Inflating " << chunks.size() << " chunks (" << compressedBytes << " bytes compressed), " << iterations << " iterations" << std::endl;
+
+	for( unsigned int i = 0; i < INFLATE_BACKEND_COUNT; i++ )
+	{
+		InflateBackend backend = (InflateBackend)i;
+		CInflater inflater;
+		size_t inflatedBytes;
+		std::chrono::high_resolution_clock::time_point start;
+		double seconds;
+
+		if( !inflater.setBackend( backend ) ) {
+			std::cout << std::setw( 12 ) << std::left << CInflater::GetBackendName( backend ) << "not available" << std::endl;
+			continue;
+		}
+		// Warm up the output buffer so the timed passes don't include its growth
+		for( auto it = chunks.begin(); it != chunks.end(); it++ )
+			inflater.inflate( &(*it).data[0], (*it).data.size(), (*it).compression );
+
+		inflatedBytes = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for( unsigned int j = 0; j < iterations; j++ )
+		{
+			for( auto it = chunks.begin(); it != chunks.end(); it++ ) {
+				if( !inflater.inflate( &(*it).data[0], (*it).data.size(), (*it).compression ) )
+					return false;
+				inflatedBytes += inflater.getLength();
+			}
+		}
+		seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+
+		std::cout << std::setw( 12 ) << std::left << CInflater::GetBackendName( backend );
+		std::cout << std::fixed << std::setprecision( 3 ) << seconds << "s, ";
+		std::cout << std::setprecision( 1 ) << (inflatedBytes / (1024.0*1024.0)) / seconds << " MB/s out, ";
+		std::cout << std::setprecision( 1 ) << (compressedBytes * (double)iterations / (1024.0*1024.0)) / seconds << " MB/s in" << std::endl;
+	}
+
+	return true;
+}
+bool CBenchmark::decodeChunks( boost::filesystem::path regionPath, CMapLoader &mapLoader, CRenderer &renderer, std::vector<ChunkData*> &chunks )
+{
+	CRegionFile regionFile;
+	RegionWorker decoder;
+
+	if( !regionFile.open( regionPath ) )
+		return false;
+
+	decoder.pRenderer = &renderer;
+	for( unsigned int i = 0; i < REGION_CHUNK_COUNT; i++ )
+	{
+		ChunkData *pChunkData;
+
+		if( !mapLoader.loadChunk( i, regionFile, decoder, &pChunkData ) )
+			return false;
+		if( pChunkData )
+			chunks.push_back( pChunkData );
+	}
+	if( chunks.empty() ) {
+		std::cout << "Failed: region file has no chunks" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool CBenchmark::benchmarkRender( boost::filesystem::path regionPath, unsigned int iterations )
+{
+	CMapLoader mapLoader;
+	CRendererClassic renderer;
+	std::vector<ChunkData*> chunks;
+	std::map<int, boost::gil::rgb8_pixel_t> colorMap;
+	boost::gil::rgb8_image_t referenceImage( REGION_PIXEL_LENGTH, REGION_PIXEL_LENGTH );
+	std::chrono::high_resolution_clock::time_point start;
+	CRendererHillshade hillshadeRenderer;
+	CRenderer *volatile pOpaqueRenderer;
+	CRenderer *pVirtualRenderer;
+	double referenceSeconds, tableSeconds, batchSeconds, hillshadeSeconds, pixels;
+	bool tableMatches, batchMatches;
+	bool success;
+
+	if( !mapLoader.initialize() )
+		return false;
+	mapLoader.setRenderer( &renderer );
+	// The reference finds the top blocks itself
+	mapLoader.addChunkDataFlags( CHUNKDATA_HEIGHTMAP | CHUNKDATA_BLOCKIDS );
+
+	// Decode everything up front so only the drawing is timed
+	success = this->decodeChunks( regionPath, mapLoader, renderer, chunks );
+
+	if( success )
+	{
+		// The same colors as a map, the way CBlockColors used to store them
+		for( unsigned int i = 0; i < BLOCK_ID_COUNT; i++ ) {
+			if( mapLoader.getBlockColors()->isKnownBlock( i ) )
+				colorMap[i] = mapLoader.getBlockColors()->getBlockPixel( i );
+		}
+		std::cout << "Rendering " << chunks.size() << " chunks, " << iterations << " iterations" << std::endl;
+		pixels = (double)chunks.size() * CHUNK_LENGTH*CHUNK_LENGTH * iterations;
+
+		boost::gil::fill_pixels( boost::gil::view( referenceImage ), boost::gil::rgb8_pixel_t( 200, 200, 200 ) );
+		start = std::chrono::high_resolution_clock::now();
+		for( unsigned int j = 0; j < iterations; j++ ) {
+			for( auto it = chunks.begin(); it != chunks.end(); it++ )
+				RenderChunkReference( (*it), colorMap, boost::gil::view( referenceImage ) );
+		}
+		referenceSeconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+
+		// Through a pointer the compiler can't see past, so each chunk costs a virtual call as it does in the loader
+		pOpaqueRenderer = &renderer;
+		pVirtualRenderer = pOpaqueRenderer;
+		renderer.clearRegionImage();
+		start = std::chrono::high_resolution_clock::now();
+		for( unsigned int j = 0; j < iterations; j++ ) {
+			for( auto it = chunks.begin(); it != chunks.end(); it++ )
+				pVirtualRenderer->renderChunk( (*it), mapLoader.getBlockColors() );
+		}
+		tableSeconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+		tableMatches = boost::gil::equal_pixels( boost::gil::const_view( referenceImage ), boost::gil::const_view( renderer.getRegionImage() ) );
+
+		// The same drawing through the batch call, from a blank image so it has to draw everything itself
+		renderer.clearRegionImage();
+		start = std::chrono::high_resolution_clock::now();
+		for( unsigned int j = 0; j < iterations; j++ )
+			pVirtualRenderer->renderChunks( chunks.data(), chunks.size(), mapLoader.getBlockColors() );
+		batchSeconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+		batchMatches = boost::gil::equal_pixels( boost::gil::const_view( referenceImage ), boost::gil::const_view( renderer.getRegionImage() ) );
+
+		// The hillshade renderer only gathers in renderChunk, the drawing happens once per region
+		hillshadeRenderer.clearRegionImage();
+		start = std::chrono::high_resolution_clock::now();
+		for( unsigned int j = 0; j < iterations; j++ ) {
+			for( auto it = chunks.begin(); it != chunks.end(); it++ )
+				hillshadeRenderer.renderChunk( (*it), mapLoader.getBlockColors() );
+			hillshadeRenderer.composeRegion();
+		}
+		hillshadeSeconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+
+		auto printResult = [&]( std::string name, double seconds ) {
+			std::cout << std::setw( 16 ) << std::left << name << std::fixed << std::setprecision( 3 ) << seconds << "s, ";
+			std::cout << std::setprecision( 1 ) << (seconds * 1e9) / (chunks.size() * (double)iterations) << " ns/chunk, " << (pixels / 1e6) / seconds << " Mpixels/s" << std::endl;
+		};
+		printResult( "std::map", referenceSeconds );
+		printResult( std::string( "classic " ) + GetSimdName(), tableSeconds );
+		printResult( "classic batch", batchSeconds );
+		printResult( std::string( "hillshade " ) + GetSimdName(), hillshadeSeconds );
+		std::cout << "Classic images are " << (tableMatches ? "identical" : "different") << ", batch images are " << (batchMatches ? "identical" : "different") << std::endl;
+	}
+
+	for( auto it = chunks.begin(); it != chunks.end(); it++ )
+		delete (*it);
+	mapLoader.setRenderer( 0 );
+
+	return success;
+}
+bool CBenchmark::benchmarkEncode( boost::filesystem::path regionPath, unsigned int iterations )
+{
+	CMapLoader mapLoader;
+	CRendererClassic renderer;
+	std::vector<ChunkData*> chunks;
+	CJpegEncoder encoder;
+	CPngEncoder pngEncoder;
+	std::vector<unsigned char> data, pngData;
+	boost::filesystem::path outputPath, gilPath, encoderPath;
+	std::chrono::high_resolution_clock::time_point start;
+	double gilSeconds, encodeSeconds, writeSeconds;
+	double pngSeconds[3];
+	const int pngLevels[3] = { 1, PNG_DEFAULT_LEVEL, 9 };
+	bool success;
+
+	if( !mapLoader.initialize() )
+		return false;
+	mapLoader.setRenderer( &renderer );
+
+	// Draw the region once, only the encoding and writing is timed
+	success = this->decodeChunks( regionPath, mapLoader, renderer, chunks );
+	if( success ) {
+		renderer.clearRegionImage();
+		renderer.renderChunks( chunks.data(), chunks.size(), mapLoader.getBlockColors() );
+		renderer.composeRegion();
+	}
+	for( auto it = chunks.begin(); it != chunks.end(); it++ )
+		delete (*it);
+	mapLoader.setRenderer( 0 );
+	if( !success )
+		return false;
+
+	outputPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+	if( !boost::filesystem::create_directories( outputPath ) ) {
+		std::cout << "Failed: could not create " << outputPath << std::endl;
+		return false;
+	}
+	gilPath = outputPath / "gil.jpeg";
+	encoderPath = outputPath / "encoder.jpeg";
+	std::cout << "Encoding a " << REGION_PIXEL_LENGTH << "x" << REGION_PIXEL_LENGTH << " region image, " << iterations << " iterations, " << CJpegEncoder::GetLibraryName() << std::endl;
+
+	// A new compressor and file for every image, the way regions used to be written
+	start = std::chrono::high_resolution_clock::now();
+	for( unsigned int j = 0; j < iterations; j++ )
+		boost::gil::jpeg_write_view( gilPath.string(), boost::gil::const_view( renderer.getRegionImage() ) );
+	gilSeconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	for( unsigned int j = 0; j < iterations; j++ )
+		encoder.encode( boost::gil::const_view( renderer.getRegionImage() ), &data );
+	encodeSeconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+
+	// The same image as a palette PNG at a few zlib levels
+	for( int i = 0; i < 3; i++ ) {
+		pngEncoder.setLevel( pngLevels[i] );
+		start = std::chrono::high_resolution_clock::now();
+		for( unsigned int j = 0; j < iterations; j++ )
+			pngEncoder.encode( boost::gil::const_view( renderer.getRegionImage() ), &pngData );
+		pngSeconds[i] = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+		std::cout << "png8 level " << pngLevels[i] << " size " << pngData.size() << " bytes" << std::endl;
+	}
+
+	start = std::chrono::high_resolution_clock::now();
+	for( unsigned int j = 0; j < iterations; j++ )
+		CTileWriter::WriteFile( encoderPath, data );
+	writeSeconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+
+	auto printResult = [&]( std::string name, double seconds ) {
+		std::cout << std::setw( 16 ) << std::left << name << std::fixed << std::setprecision( 3 ) << seconds << "s, ";
+		std::cout << std::setprecision( 2 ) << (seconds * 1e3) / iterations << " ms/image" << std::endl;
+	};
+	printResult( "jpeg_write_view", gilSeconds );
+	printResult( "encode", encodeSeconds );
+	for( int i = 0; i < 3; i++ )
+		printResult( "png8 level " + std::to_string( pngLevels[i] ), pngSeconds[i] );
+	printResult( "write", writeSeconds );
+	std::cout << "Encoded size " << data.size() << " bytes" << std::endl;
+
+	boost::system::error_code error;
+	boost::filesystem::remove_all( outputPath, error );
+
+	return true;
+}
\ No newline at end of file
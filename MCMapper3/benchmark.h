@@ -0,0 +1,70 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <boost\filesystem.hpp>
+#include <vector>
+
+class CMapLoader;
+class CRenderer;
+struct ChunkData;
+
+/*
+	Micro-benchmarks for parts of the map generation, run from the console
+*/
+class CBenchmark
+{
+private:
+	struct CompressedChunk
+	{
+		std::vector<char> data;
+		unsigned char compression;
+	};
+
+	bool loadChunks( boost::filesystem::path regionPath, std::vector<CompressedChunk> &chunks );
+	bool decodeChunks( boost::filesystem::path regionPath, CMapLoader &mapLoader, CRenderer &renderer, std::vector<ChunkData*> &chunks );
+public:
+	CBenchmark();
+	~CBenchmark();
+
+	/*
+		@method: benchmarkInflate
+		@returns: if the benchmark ran successfully
+		Decompresses every chunk in a region file with each available backend and reports the throughput
+	*/
+	bool benchmarkInflate( boost::filesystem::path regionPath, unsigned int iterations );
+	/*
+		@method: benchmarkRender
+		@returns: if the benchmark ran successfully
+		Draws every chunk in a region file with the classic and hillshade renderers, and with the old std::map color lookup to compare
+	*/
+	bool benchmarkRender( boost::filesystem::path regionPath, unsigned int iterations );
+	/*
+		@method: benchmarkEncode
+		@returns: if the benchmark ran successfully
+		Writes a rendered region with jpeg_write_view, then encodes it with a reused CJpegEncoder and writes it separately
+	*/
+	bool benchmarkEncode( boost::filesystem::path regionPath, unsigned int iterations );
+};
@@ -23,11 +23,17 @@
 */
 
 #include <iostream>
+#include <algorithm>
 #include <boost\property_tree\xml_parser.hpp>
 #include <boost\filesystem.hpp>
 #include "blocks.h"
 
-CBlockColors::CBlockColors() {
+CBlockColors::CBlockColors()
+{
+	m_unknownColor = boost::gil::rgb8_pixel_t( 0, 0, 0 );
+	m_shadedColors.resize( SHADE_LEVELS*BLOCK_COLOR_COUNT, m_unknownColor );
+	m_packedColors.resize( SHADE_LEVELS*BLOCK_COLOR_COUNT, 0 );
+	m_knownColors.resize( BLOCK_COLOR_COUNT, false );
 }
 CBlockColors::~CBlockColors() {
 }
@@ -36,6 +42,7 @@ bool CBlockColors::loadBlockColors()
 {
 	boost::property_tree::ptree colorTree;
 	boost::filesystem::path defaultBlockPath;
+	boost::gil::rgb8_pixel_t *pColors;
 
 	// Find the default blocks
 	defaultBlockPath = boost::filesystem::current_path();
@@ -54,30 +61,97 @@ bool CBlockColors::loadBlockColors()
 	}
 	// Parse all the blocks
 	colorTree = colorTree.get_child( "blocks", boost::property_tree::ptree() );
-	// For each block
-	for( auto it = colorTree.begin(); it != colorTree.end(); it++ )
+	// The unshaded colors live in the neutral level, the others are built from it
+	pColors = &m_shadedColors[SHADE_NEUTRAL*BLOCK_COLOR_COUNT];
+	std::fill( m_knownColors.begin(), m_knownColors.end(), false );
+	// First the blocks that apply to every meta value, then the ones for a specific meta value on top
+	for( int pass = 0; pass < 2; pass++ )
 	{
-		int blockId;
-		boost::gil::rgb8_pixel_t color;
-		// Skip non-blocks
-		if( (*it).first.compare( "block" ) != 0 )
-			continue;
-		// Get id
-		blockId = (*it).second.get( "<xmlattr>.id", 0 );
-		// Get color
-		color = boost::gil::rgb8_pixel_t( (*it).second.get( "<xmlattr>.r", 0 ), (*it).second.get( "<xmlattr>.g", 0 ), (*it).second.get( "<xmlattr>.b", 0 ) );
-		// Put it into the map
-		if( m_blockColors.find( blockId ) != m_blockColors.end() )
-			continue; // ignore
-		m_blockColors.insert( std::pair<int, boost::gil::rgb8_pixel_t>( blockId, color ) );
+		std::vector<bool> setThisPass( BLOCK_COLOR_COUNT, false );
+
+		for( auto it = colorTree.begin(); it != colorTree.end(); it++ )
+		{
+			int blockId, meta;
+			boost::gil::rgb8_pixel_t color;
+			// Skip non-blocks
+			if( (*it).first.compare( "block" ) != 0 )
+				continue;
+			// Get id and meta, no meta means all of them
+			blockId = (*it).second.get( "<xmlattr>.id", 0 );
+			meta = (*it).second.get( "<xmlattr>.meta", -1 );
+			if( (pass == 0) != (meta < 0) )
+				continue;
+			if( blockId < 0 || blockId >= BLOCK_ID_COUNT || meta >= BLOCK_META_COUNT ) {
+				std::cout << "Warning: block id " << blockId << ":" << meta << " is out of range, ignoring" << std::endl;
+				continue;
+			}
+			// Get color
+			color = boost::gil::rgb8_pixel_t( (*it).second.get( "<xmlattr>.r", 0 ), (*it).second.get( "<xmlattr>.g", 0 ), (*it).second.get( "<xmlattr>.b", 0 ) );
+			// Put it into the table
+			for( int m = (meta < 0 ? 0 : meta); m <= (meta < 0 ? BLOCK_META_COUNT-1 : meta); m++ ) {
+				unsigned int index = CBlockColors::GetColorIndex( blockId, m );
+				if( setThisPass[index] )
+					continue; // ignore
+				setThisPass[index] = true;
+				m_knownColors[index] = true;
+				pColors[index] = color;
+			}
+		}
 	}
+	// Optional color for blocks that aren't listed
+	auto unknownTree = colorTree.get_child_optional( "unknown" );
+	if( unknownTree )
+		m_unknownColor = boost::gil::rgb8_pixel_t( (*unknownTree).get( "<xmlattr>.r", 0 ), (*unknownTree).get( "<xmlattr>.g", 0 ), (*unknownTree).get( "<xmlattr>.b", 0 ) );
+	this->compileColors();
 
 	return true;
 }
-boost::gil::rgb8_pixel_t CBlockColors::getBlockPixel( int blockId )
+void CBlockColors::compileColors()
+{
+	const boost::gil::rgb8_pixel_t *pBase;
+
+	pBase = &m_shadedColors[SHADE_NEUTRAL*BLOCK_COLOR_COUNT];
+	for( unsigned int i = 0; i < BLOCK_COLOR_COUNT; i++ ) {
+		if( !m_knownColors[i] )
+			m_shadedColors[SHADE_NEUTRAL*BLOCK_COLOR_COUNT + i] = m_unknownColor;
+	}
+	for( unsigned int shade = 0; shade < SHADE_LEVELS; shade++ )
+	{
+		if( shade == SHADE_NEUTRAL )
+			continue;
+		for( unsigned int i = 0; i < BLOCK_COLOR_COUNT; i++ ) {
+			// Truncates the same way multiplying by shade/8.0f and converting back did
+			m_shadedColors[shade*BLOCK_COLOR_COUNT + i] = boost::gil::rgb8_pixel_t( std::min( (pBase[i][0]*shade) >> 3, 255u ), std::min( (pBase[i][1]*shade) >> 3, 255u ), std::min( (pBase[i][2]*shade) >> 3, 255u ) );
+		}
+	}
+	for( unsigned int i = 0; i < SHADE_LEVELS*BLOCK_COLOR_COUNT; i++ ) {
+		const boost::gil::rgb8_pixel_t &color = m_shadedColors[i];
+		m_packedColors[i] = color[0] | (color[1] << 8) | (color[2] << 16);
+	}
+}
+
+void CBlockColors::setUnknownColor( boost::gil::rgb8_pixel_t color )
+{
+	m_unknownColor = color;
+	this->compileColors();
+}
+boost::gil::rgb8_pixel_t CBlockColors::getUnknownColor() const {
+	return m_unknownColor;
+}
+bool CBlockColors::isKnownBlock( unsigned int blockId, unsigned int meta ) const {
+	return m_knownColors[CBlockColors::GetColorIndex( blockId, meta )];
+}
+
+boost::gil::rgb8_pixel_t CBlockColors::getBlockPixel( int blockId ) const {
+	return this->getShadedPixel( CBlockColors::GetColorIndex( blockId ), SHADE_NEUTRAL );
+}
+const boost::gil::rgb8_pixel_t* CBlockColors::getShadeTable( unsigned int shade ) const
+{
+	_ASSERT_EXPR( shade < SHADE_LEVELS, L"shade level out of range" );
+	return &m_shadedColors[shade*BLOCK_COLOR_COUNT];
+}
+const boost::uint32_t* CBlockColors::getPackedShadeTable( unsigned int shade ) const
 {
-	if( m_blockColors.find( blockId ) == m_blockColors.end() )
-		return boost::gil::rgb8_pixel_t( 0, 0, 0 );
-	else
-		return m_blockColors[blockId];
+	_ASSERT_EXPR( shade < SHADE_LEVELS, L"shade level out of range" );
+	return &m_packedColors[shade*BLOCK_COLOR_COUNT];
 }
\ No newline at end of file
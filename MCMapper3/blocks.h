@@ -25,19 +25,74 @@
 #pragma once
 
 #include <boost\gil\gil_all.hpp>
-#include <map>
+#include <vector>
 
 #define DEFAULT_BLOCKS "data\\default-blocks.xml"
 
+#define BLOCK_ID_COUNT 256
+#define BLOCK_META_COUNT 16
+#define BLOCK_COLOR_COUNT (BLOCK_ID_COUNT*BLOCK_META_COUNT)
+
+// Shade level L scales a color by L/8, so shading is a multiply and a shift
+// Levels above neutral brighten, saturating at 255
+#define SHADE_LEVELS 13
+#define SHADE_NEUTRAL 8
+#define SHADE_HALF 4
+#define SHADE_BRIGHTEST (SHADE_LEVELS-1)
+
+/*
+	Block colors compiled into a flat table indexed by shade level and id:meta
+	Looking up a shaded color is a single indexed load
+*/
 class CBlockColors
 {
 private:
-	std::map<int, boost::gil::rgb8_pixel_t> m_blockColors;
+	std::vector<boost::gil::rgb8_pixel_t> m_shadedColors;
+	std::vector<boost::uint32_t> m_packedColors;
+	std::vector<bool> m_knownColors;
+	boost::gil::rgb8_pixel_t m_unknownColor;
+
+	void compileColors();
 public:
+	static inline unsigned int GetColorIndex( unsigned int blockId, unsigned int meta = 0 ) {
+		return ((blockId & (BLOCK_ID_COUNT-1)) << 4) | (meta & (BLOCK_META_COUNT-1));
+	}
+
 	CBlockColors();
 	~CBlockColors();
 
+	/*
+		@method: loadBlockColors
+		@returns: if the colors were loaded
+		Reads the block XML and builds the color table
+	*/
 	bool loadBlockColors();
 
-	boost::gil::rgb8_pixel_t getBlockPixel( int blockId );
+	/*
+		@method: setUnknownColor
+		@returns: none
+		Sets the color drawn for blocks that aren't in the XML, black by default
+	*/
+	void setUnknownColor( boost::gil::rgb8_pixel_t color );
+	boost::gil::rgb8_pixel_t getUnknownColor() const;
+	bool isKnownBlock( unsigned int blockId, unsigned int meta = 0 ) const;
+
+	boost::gil::rgb8_pixel_t getBlockPixel( int blockId ) const;
+	/*
+		@method: getShadedPixel
+		@returns: the color for a color index, scaled by shade/8
+	*/
+	inline const boost::gil::rgb8_pixel_t& getShadedPixel( unsigned int colorIndex, unsigned int shade ) const {
+		return m_shadedColors[shade*BLOCK_COLOR_COUNT + colorIndex];
+	}
+	/*
+		@method: getShadeTable
+		@returns: the BLOCK_COLOR_COUNT colors for one shade level
+	*/
+	const boost::gil::rgb8_pixel_t* getShadeTable( unsigned int shade ) const;
+	/*
+		@method: getPackedShadeTable
+		@returns: the same colors as getShadeTable packed into 32 bits as R, G, B, 0 bytes, for the SIMD kernels
+	*/
+	const boost::uint32_t* getPackedShadeTable( unsigned int shade ) const;
 };
\ No newline at end of file
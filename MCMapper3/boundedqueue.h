@@ -0,0 +1,128 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+/*
+	Thread safe FIFO with a fixed capacity
+	push blocks while the queue is full, which is what throttles a stage that is running ahead of the next one
+*/
+template<typename T>
+class CBoundedQueue
+{
+private:
+	std::deque<T> m_items;
+	size_t m_capacity;
+	bool m_closed;
+
+	std::mutex m_mutex;
+	std::condition_variable m_notEmpty;
+	std::condition_variable m_notFull;
+public:
+	CBoundedQueue( size_t capacity ) {
+		m_capacity = capacity > 0 ? capacity : 1;
+		m_closed = false;
+	}
+
+	CBoundedQueue( CBoundedQueue const& ) = delete;
+	void operator=( CBoundedQueue const& ) = delete;
+
+	/*
+		@method: push
+		@returns: false if the queue was closed
+		Waits for room if the queue is full
+	*/
+	bool push( T item )
+	{
+		std::unique_lock<std::mutex> lock( m_mutex );
+		m_notFull.wait( lock, [this] { return m_closed || m_items.size() < m_capacity; } );
+		if( m_closed )
+			return false;
+		m_items.push_back( std::move( item ) );
+		lock.unlock();
+		m_notEmpty.notify_one();
+		return true;
+	}
+	/*
+		@method: pop
+		@returns: false once the queue is closed and empty
+		Waits for an item if the queue is empty
+	*/
+	bool pop( T *pItem )
+	{
+		std::unique_lock<std::mutex> lock( m_mutex );
+		m_notEmpty.wait( lock, [this] { return m_closed || !m_items.empty(); } );
+		if( m_items.empty() )
+			return false;
+		(*pItem) = std::move( m_items.front() );
+		m_items.pop_front();
+		lock.unlock();
+		m_notFull.notify_one();
+		return true;
+	}
+	/*
+		@method: popBatch
+		@returns: how many items were written to pItems, 0 once the queue is closed and empty
+		Waits for an item like pop, then also takes whatever else is queued, up to maxCount
+	*/
+	size_t popBatch( T *pItems, size_t maxCount )
+	{
+		size_t count;
+
+		std::unique_lock<std::mutex> lock( m_mutex );
+		m_notEmpty.wait( lock, [this] { return m_closed || !m_items.empty(); } );
+		for( count = 0; count < maxCount && !m_items.empty(); count++ ) {
+			pItems[count] = std::move( m_items.front() );
+			m_items.pop_front();
+		}
+		lock.unlock();
+		if( count > 1 )
+			m_notFull.notify_all();
+		else if( count == 1 )
+			m_notFull.notify_one();
+		return count;
+	}
+	/*
+		@method: close
+		@returns: none
+		No more items can be pushed, anything already queued can still be popped
+	*/
+	void close()
+	{
+		{
+			std::unique_lock<std::mutex> lock( m_mutex );
+			m_closed = true;
+		}
+		m_notEmpty.notify_all();
+		m_notFull.notify_all();
+	}
+
+	size_t getCapacity() const {
+		return m_capacity;
+	}
+};
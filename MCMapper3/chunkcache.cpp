@@ -0,0 +1,380 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "chunkcache.h"
+
+static const char IndexMagic[4] = { 'M', 'C', 'C', 'I' };
+static const char DataMagic[4] = { 'M', 'C', 'C', 'D' };
+
+CChunkCache::CChunkCache() {
+	m_stateSize = 0;
+	m_generation = 0;
+	m_enabled = false;
+	m_failed = false;
+	m_previousCount = 0;
+	m_recordCount = 0;
+	m_hitCount = 0;
+	m_storedCount = 0;
+}
+CChunkCache::~CChunkCache() {
+}
+
+bool CChunkCache::open( const boost::filesystem::path &directory, const std::string &settingsKey, size_t stateSize, bool ignorePrevious )
+{
+	boost::filesystem::path dataPath;
+
+	_ASSERT_EXPR( !m_enabled, L"chunk cache is already open" );
+
+	m_directory = directory;
+	m_settingsKey = settingsKey;
+	m_stateSize = stateSize;
+	m_failed = false;
+	m_hitCount = 0;
+	m_storedCount = 0;
+	m_records.clear();
+
+	if( ignorePrevious || !this->readRecords() ) {
+		if( !this->create() ) {
+			std::cout << " > Failed: could not create the chunk cache in " << m_directory << std::endl;
+			return false;
+		}
+	}
+	dataPath = m_directory / CHUNKCACHE_DATA_NAME;
+	m_previousCount = m_recordCount;
+	if( m_previousCount > 0 )
+	{
+		try {
+			m_mappedData.open( dataPath.string(), sizeof( ChunkCacheDataHeader ) + (size_t)m_previousCount*m_stateSize );
+		}
+		catch( const std::exception& ) {
+			// Fall back to reading through the file
+			if( m_mappedData.is_open() )
+				m_mappedData.close();
+		}
+		if( !m_mappedData.is_open() ) {
+			m_readFile.open( dataPath, std::ios::in | std::ios::binary );
+			if( !m_readFile.is_open() )
+				m_previousCount = 0;
+		}
+	}
+	// New records go on the end, so nothing read above moves
+	m_indexFile.open( m_directory / CHUNKCACHE_INDEX_NAME, std::ios::out | std::ios::binary | std::ios::app );
+	m_dataFile.open( dataPath, std::ios::out | std::ios::binary | std::ios::app );
+	if( !m_indexFile.is_open() || !m_dataFile.is_open() ) {
+		std::cout << " > Failed: could not open the chunk cache in " << m_directory << std::endl;
+		this->closeFiles();
+		return false;
+	}
+	m_enabled = true;
+
+	return true;
+}
+bool CChunkCache::close( const std::unordered_set<boost::uint64_t> &liveHashes )
+{
+	size_t liveCount;
+	bool succeeded;
+
+	if( !m_enabled )
+		return true;
+	this->closeFiles();
+	succeeded = !m_failed && !m_indexFile.fail() && !m_dataFile.fail();
+
+	liveCount = 0;
+	for( std::unordered_map<boost::uint64_t, Entry>::const_iterator it = m_records.begin(); it != m_records.end(); it++ ) {
+		if( liveHashes.count( it->first ) > 0 )
+			liveCount++;
+	}
+	if( succeeded && m_recordCount > liveCount*CHUNKCACHE_COMPACT_RATIO )
+		succeeded = this->compact( liveHashes );
+	if( !succeeded )
+		std::cout << " > Failed: could not write the chunk cache in " << m_directory << std::endl;
+
+	m_records.clear();
+	m_recordCount = 0;
+	m_previousCount = 0;
+	m_enabled = false;
+
+	return succeeded;
+}
+bool CChunkCache::isEnabled() const {
+	return m_enabled;
+}
+
+void CChunkCache::closeFiles()
+{
+	if( m_indexFile.is_open() )
+		m_indexFile.close();
+	if( m_dataFile.is_open() )
+		m_dataFile.close();
+	if( m_mappedData.is_open() )
+		m_mappedData.close();
+	if( m_readFile.is_open() )
+		m_readFile.close();
+}
+bool CChunkCache::writeHeaders( boost::filesystem::ofstream &indexFile, boost::filesystem::ofstream &dataFile ) const
+{
+	ChunkCacheIndexHeader indexHeader;
+	ChunkCacheDataHeader dataHeader;
+
+	memcpy( indexHeader.magic, IndexMagic, sizeof( indexHeader.magic ) );
+	indexHeader.version = CHUNKCACHE_VERSION;
+	indexHeader.generation = m_generation;
+	indexHeader.stateSize = (boost::uint32_t)m_stateSize;
+	indexHeader.keyLength = (boost::uint16_t)m_settingsKey.length();
+	indexFile.write( reinterpret_cast<const char*>(&indexHeader), sizeof( indexHeader ) );
+	indexFile.write( m_settingsKey.data(), indexHeader.keyLength );
+
+	memcpy( dataHeader.magic, DataMagic, sizeof( dataHeader.magic ) );
+	dataHeader.version = CHUNKCACHE_VERSION;
+	dataHeader.generation = m_generation;
+	dataFile.write( reinterpret_cast<const char*>(&dataHeader), sizeof( dataHeader ) );
+
+	return !indexFile.fail() && !dataFile.fail();
+}
+bool CChunkCache::create()
+{
+	boost::filesystem::ofstream indexFile, dataFile;
+	std::random_device random;
+
+	m_generation = ((boost::uint64_t)random() << 32) | random();
+	m_records.clear();
+	m_recordCount = 0;
+
+	indexFile.open( m_directory / CHUNKCACHE_INDEX_NAME, std::ios::out | std::ios::binary | std::ios::trunc );
+	dataFile.open( m_directory / CHUNKCACHE_DATA_NAME, std::ios::out | std::ios::binary | std::ios::trunc );
+	if( !indexFile.is_open() || !dataFile.is_open() )
+		return false;
+	if( !this->writeHeaders( indexFile, dataFile ) )
+		return false;
+	indexFile.close();
+	dataFile.close();
+
+	return !indexFile.fail() && !dataFile.fail();
+}
+bool CChunkCache::readRecords()
+{
+	boost::filesystem::path indexPath, dataPath;
+	boost::filesystem::ifstream indexFile, dataFile;
+	ChunkCacheIndexHeader indexHeader;
+	ChunkCacheDataHeader dataHeader;
+	std::string settingsKey;
+	std::vector<ChunkCacheRecord> records;
+	boost::uintmax_t indexLength, dataLength, indexStart, count;
+	boost::system::error_code error;
+	Entry entry;
+
+	indexPath = m_directory / CHUNKCACHE_INDEX_NAME;
+	dataPath = m_directory / CHUNKCACHE_DATA_NAME;
+	indexLength = boost::filesystem::file_size( indexPath, error );
+	if( error )
+		return false;
+	dataLength = boost::filesystem::file_size( dataPath, error );
+	if( error || dataLength < sizeof( dataHeader ) )
+		return false;
+
+	indexFile.open( indexPath, std::ios::in | std::ios::binary );
+	dataFile.open( dataPath, std::ios::in | std::ios::binary );
+	if( !indexFile.is_open() || !dataFile.is_open() )
+		return false;
+	indexFile.read( reinterpret_cast<char*>(&indexHeader), sizeof( indexHeader ) );
+	if( indexFile.fail() || memcmp( indexHeader.magic, IndexMagic, sizeof( indexHeader.magic ) ) != 0 || indexHeader.version != CHUNKCACHE_VERSION ||
+		indexHeader.stateSize != m_stateSize )
+		return false;
+	settingsKey.resize( indexHeader.keyLength );
+	if( indexHeader.keyLength > 0 )
+		indexFile.read( &settingsKey[0], indexHeader.keyLength );
+	if( indexFile.fail() || settingsKey.compare( m_settingsKey ) != 0 )
+		return false;
+	dataFile.read( reinterpret_cast<char*>(&dataHeader), sizeof( dataHeader ) );
+	if( dataFile.fail() || memcmp( dataHeader.magic, DataMagic, sizeof( dataHeader.magic ) ) != 0 || dataHeader.version != CHUNKCACHE_VERSION ||
+		dataHeader.generation != indexHeader.generation )
+		return false;
+	dataFile.close();
+
+	// A run that stopped part way through can leave one file a little ahead of the other
+	indexStart = sizeof( indexHeader ) + indexHeader.keyLength;
+	count = std::min( (indexLength - indexStart) / sizeof( ChunkCacheRecord ), (dataLength - sizeof( dataHeader )) / m_stateSize );
+	if( count > UINT32_MAX )
+		return false;
+
+	m_records.reserve( (size_t)count );
+	records.resize( CHUNKCACHE_READ_BATCH );
+	for( boost::uintmax_t i = 0; i < count; ) {
+		size_t batch = (size_t)std::min( (boost::uintmax_t)CHUNKCACHE_READ_BATCH, count - i );
+		indexFile.read( reinterpret_cast<char*>(records.data()), batch*sizeof( ChunkCacheRecord ) );
+		if( indexFile.fail() ) {
+			m_records.clear();
+			return false;
+		}
+		for( size_t j = 0; j < batch; j++ ) {
+			entry.index = (boost::uint32_t)(i + j);
+			entry.position = records[j].position;
+			m_records.emplace( records[j].hash, entry );
+		}
+		i += batch;
+	}
+	indexFile.close();
+
+	if( indexLength != indexStart + count*sizeof( ChunkCacheRecord ) )
+		boost::filesystem::resize_file( indexPath, indexStart + count*sizeof( ChunkCacheRecord ), error );
+	if( !error && dataLength != sizeof( dataHeader ) + count*m_stateSize )
+		boost::filesystem::resize_file( dataPath, sizeof( dataHeader ) + count*m_stateSize, error );
+	if( error ) {
+		m_records.clear();
+		return false;
+	}
+	m_generation = indexHeader.generation;
+	m_recordCount = (boost::uint32_t)count;
+
+	return true;
+}
+bool CChunkCache::compact( const std::unordered_set<boost::uint64_t> &liveHashes )
+{
+	boost::filesystem::path indexPath, dataPath, indexTempPath, dataTempPath;
+	boost::filesystem::ifstream indexFile, dataFile;
+	boost::filesystem::ofstream indexOutput, dataOutput;
+	std::unordered_set<boost::uint64_t> written;
+	std::vector<char> state;
+	ChunkCacheRecord record;
+	std::random_device random;
+	boost::system::error_code error;
+
+	indexPath = m_directory / CHUNKCACHE_INDEX_NAME;
+	dataPath = m_directory / CHUNKCACHE_DATA_NAME;
+	indexTempPath = indexPath;
+	indexTempPath += ".tmp";
+	dataTempPath = dataPath;
+	dataTempPath += ".tmp";
+
+	indexFile.open( indexPath, std::ios::in | std::ios::binary );
+	dataFile.open( dataPath, std::ios::in | std::ios::binary );
+	if( !indexFile.is_open() || !dataFile.is_open() )
+		return false;
+	indexFile.seekg( sizeof( ChunkCacheIndexHeader ) + m_settingsKey.length() );
+	dataFile.seekg( sizeof( ChunkCacheDataHeader ) );
+
+	// A new generation, in case only one of the files makes it into place
+	m_generation = ((boost::uint64_t)random() << 32) | random();
+	indexOutput.open( indexTempPath, std::ios::out | std::ios::binary | std::ios::trunc );
+	dataOutput.open( dataTempPath, std::ios::out | std::ios::binary | std::ios::trunc );
+	if( !indexOutput.is_open() || !dataOutput.is_open() || !this->writeHeaders( indexOutput, dataOutput ) )
+		return false;
+
+	state.resize( m_stateSize );
+	for( boost::uint32_t i = 0; i < m_recordCount; i++ ) {
+		indexFile.read( reinterpret_cast<char*>(&record), sizeof( record ) );
+		dataFile.read( state.data(), state.size() );
+		if( indexFile.fail() || dataFile.fail() )
+			return false;
+		if( liveHashes.count( record.hash ) == 0 || !written.insert( record.hash ).second )
+			continue;
+		indexOutput.write( reinterpret_cast<const char*>(&record), sizeof( record ) );
+		dataOutput.write( state.data(), state.size() );
+	}
+	indexFile.close();
+	dataFile.close();
+	indexOutput.close();
+	dataOutput.close();
+	if( indexOutput.fail() || dataOutput.fail() )
+		return false;
+
+	boost::filesystem::rename( dataTempPath, dataPath, error );
+	if( !error )
+		boost::filesystem::rename( indexTempPath, indexPath, error );
+	return !error;
+}
+
+bool CChunkCache::find( boost::uint64_t hash, unsigned int *pPosition, unsigned char *pState )
+{
+	std::unordered_map<boost::uint64_t, Entry>::const_iterator it;
+	boost::uint64_t offset;
+	Entry entry;
+
+	{
+		std::lock_guard<std::mutex> cacheLock( m_mutex );
+		it = m_records.find( hash );
+		if( it == m_records.end() )
+			return false;
+		entry = it->second;
+	}
+	// Records stored this run are still being written, they are for chunks already drawn anyway
+	if( entry.index >= m_previousCount )
+		return false;
+	offset = sizeof( ChunkCacheDataHeader ) + (boost::uint64_t)entry.index*m_stateSize;
+	if( m_mappedData.is_open() )
+		memcpy( pState, m_mappedData.data() + offset, m_stateSize );
+	else
+	{
+		std::lock_guard<std::mutex> cacheLock( m_mutex );
+		m_readFile.seekg( offset );
+		m_readFile.read( reinterpret_cast<char*>(pState), m_stateSize );
+		if( m_readFile.fail() ) {
+			m_readFile.clear();
+			return false;
+		}
+	}
+	(*pPosition) = entry.position;
+	m_hitCount++;
+
+	return true;
+}
+bool CChunkCache::store( boost::uint64_t hash, unsigned int position, const unsigned char *pState )
+{
+	std::lock_guard<std::mutex> cacheLock( m_mutex );
+	ChunkCacheRecord record;
+	Entry entry;
+
+	if( m_failed )
+		return false;
+	if( m_records.find( hash ) != m_records.end() )
+		return true;
+	if( m_recordCount == UINT32_MAX )
+		return false;
+
+	record.hash = hash;
+	record.position = (boost::uint16_t)position;
+	m_dataFile.write( reinterpret_cast<const char*>(pState), m_stateSize );
+	m_indexFile.write( reinterpret_cast<const char*>(&record), sizeof( record ) );
+	if( m_dataFile.fail() || m_indexFile.fail() ) {
+		m_failed = true;
+		return false;
+	}
+	entry.index = m_recordCount++;
+	entry.position = record.position;
+	m_records[hash] = entry;
+	m_storedCount++;
+
+	return true;
+}
+
+unsigned int CChunkCache::getHitCount() const {
+	return m_hitCount;
+}
+unsigned int CChunkCache::getStoredCount() const {
+	return m_storedCount;
+}
\ No newline at end of file
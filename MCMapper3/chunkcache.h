@@ -0,0 +1,146 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+#pragma once
+
+#include <boost\filesystem.hpp>
+#include <boost\filesystem\fstream.hpp>
+#include <boost\integer.hpp>
+#include <boost\iostreams\device\mapped_file.hpp>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#define CHUNKCACHE_INDEX_NAME "chunks.idx"
+#define CHUNKCACHE_DATA_NAME "chunks.dat"
+#define CHUNKCACHE_VERSION 1
+// Stale records are only dropped once there are more of them than records still in use
+#define CHUNKCACHE_COMPACT_RATIO 2
+#define CHUNKCACHE_READ_BATCH 4096
+
+#pragma pack(push, 1)
+// Followed by keyLength bytes of settings key, then a ChunkCacheRecord for every state in the data file
+struct ChunkCacheIndexHeader
+{
+	char magic[4];
+	boost::uint32_t version;
+	// Written to both files, so an index is never read with the data of another
+	boost::uint64_t generation;
+	boost::uint32_t stateSize;
+	boost::uint16_t keyLength;
+};
+// Followed by stateSize bytes of renderer state for each record, in the same order as the index
+struct ChunkCacheDataHeader
+{
+	char magic[4];
+	boost::uint32_t version;
+	boost::uint64_t generation;
+};
+struct ChunkCacheRecord
+{
+	boost::uint64_t hash;
+	// Where in the region the chunk drew itself, x + z*32
+	boost::uint16_t position;
+};
+#pragma pack(pop)
+
+/*
+	Remembers what each chunk rendered to, found by the hash of its compressed bytes in the region file
+	Servers and backups rewrite chunks that haven't changed, those are copied back into the renderer
+	without being decoded. Records are only ever appended, the small index is read in whole on open and
+	states are read as they are needed. Once most records are for chunks no longer in the map, both files
+	are written again with just the ones still in use
+*/
+class CChunkCache
+{
+private:
+	struct Entry
+	{
+		boost::uint32_t index;
+		boost::uint16_t position;
+	};
+
+	boost::filesystem::path m_directory;
+	std::string m_settingsKey;
+	size_t m_stateSize;
+	boost::uint64_t m_generation;
+	bool m_enabled;
+	bool m_failed;
+
+	boost::filesystem::ofstream m_indexFile;
+	boost::filesystem::ofstream m_dataFile;
+	// States from earlier runs, mapped when possible so lookups from several threads don't wait on each other
+	boost::iostreams::mapped_file_source m_mappedData;
+	boost::filesystem::ifstream m_readFile;
+	boost::uint32_t m_previousCount;
+	boost::uint32_t m_recordCount;
+	std::unordered_map<boost::uint64_t, Entry> m_records;
+	std::mutex m_mutex;
+
+	std::atomic<unsigned int> m_hitCount;
+	std::atomic<unsigned int> m_storedCount;
+
+	bool create();
+	bool readRecords();
+	bool compact( const std::unordered_set<boost::uint64_t> &liveHashes );
+	void closeFiles();
+	bool writeHeaders( boost::filesystem::ofstream &indexFile, boost::filesystem::ofstream &dataFile ) const;
+public:
+	CChunkCache();
+	~CChunkCache();
+
+	CChunkCache( CChunkCache const& ) = delete;
+	void operator=( CChunkCache const& ) = delete;
+
+	/*
+		@method: open
+		@returns: if the cache can be used
+		Reads the index in directory if it was written with the same settingsKey and stateSize, starts a new cache otherwise
+	*/
+	bool open( const boost::filesystem::path &directory, const std::string &settingsKey, size_t stateSize, bool ignorePrevious );
+	/*
+		@method: close
+		@returns: if every record was written
+		liveHashes are the chunks still in the map, the files are compacted to them if they are mostly stale
+	*/
+	bool close( const std::unordered_set<boost::uint64_t> &liveHashes );
+	bool isEnabled() const;
+
+	/*
+		@method: find
+		@returns: if a chunk with that hash was cached by an earlier run, pPosition and pState are then filled in
+		Safe to call from several threads
+	*/
+	bool find( boost::uint64_t hash, unsigned int *pPosition, unsigned char *pState );
+	/*
+		@method: store
+		@returns: if the record was written or the hash was already cached
+		Safe to call from several threads
+	*/
+	bool store( boost::uint64_t hash, unsigned int position, const unsigned char *pState );
+
+	unsigned int getHitCount() const;
+	unsigned int getStoredCount() const;
+};
\ No newline at end of file
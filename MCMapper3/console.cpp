@@ -27,11 +27,40 @@
 #include <iostream>
 #include <string>
 #include <algorithm>
+#include <memory>
 #include <boost\filesystem.hpp>
 #include "def.h"
 #include "console.h"
 #include "maploader.h"
 #include "renderer.h"
+#include "benchmark.h"
+#include "threadpool.h"
+#include "tileserver.h"
+#include "tilewriter.h"
+
+/*
+	@function: ParseImageOption
+	@returns: how many arguments the option at index used, 0 if it is not an image option or -1 if its value is invalid
+	Reads --format and --png-level, which generate and serve share
+*/
+static int ParseImageOption( const std::vector<char*> &arguments, size_t index, GenerateSettings *pSettings )
+{
+	if( index+1 >= arguments.size() )
+		return 0;
+	if( strcmp( arguments[index], "--format" ) == 0 ) {
+		pSettings->format = CImageEncoder::GetFormatByName( arguments[index+1] );
+		if( pSettings->format == IMAGE_FORMAT_COUNT ) {
+			std::cout << "\'" << arguments[index+1] << "\' is not a valid format, expected jpeg or png8" << std::endl;
+			return -1;
+		}
+		return 2;
+	}
+	if( strcmp( arguments[index], "--png-level" ) == 0 ) {
+		pSettings->compressionLevel = std::max( 0, std::min( 9, atoi( arguments[index+1] ) ) );
+		return 2;
+	}
+	return 0;
+}
 
 CConsole& CConsole::getInstance() {
 	static CConsole instance;
@@ -84,16 +113,104 @@ bool CConsole::run( std::vector<char*> &arguments )
 		}
 		std::string map, output;
 		std::vector<char> flags;
-		map = arguments[1];
-		if( arguments.size() >= 3 ) 
-			flags = std::vector<char>( arguments[2], arguments[2]+strlen( arguments[2] ) );
-		if( arguments.size() >= 4 )
-			output = arguments[3];
-		return this->commandGenerate( map, flags, output );
+		std::vector<char*> positional;
+		GenerateSettings settings;
+		std::string pipelineString;
+		int optionLength;
+		// Pull out the options, whatever is left is positional
+		settings.threadCount = CThreadPool::GetDefaultThreadCount();
+		settings.pipelined = false;
+		settings.format = IMAGE_FORMAT_JPEG;
+		settings.compressionLevel = PNG_DEFAULT_LEVEL;
+		settings.archive = false;
+		settings.full = false;
+		for( size_t i = 1; i < arguments.size(); i++ ) {
+			if( (optionLength = ParseImageOption( arguments, i, &settings )) != 0 ) {
+				if( optionLength < 0 )
+					return false;
+				i += optionLength - 1;
+			}
+			else if( strcmp( arguments[i], "--archive" ) == 0 )
+				settings.archive = true;
+			else if( strcmp( arguments[i], "--full" ) == 0 )
+				settings.full = true;
+			else if( strcmp( arguments[i], "-j" ) == 0 && i+1 < arguments.size() ) {
+				settings.threadCount = std::max( 1, atoi( arguments[i+1] ) );
+				i++;
+			}
+			else if( strcmp( arguments[i], "-p" ) == 0 && i+1 < arguments.size() ) {
+				settings.pipelined = true;
+				pipelineString = arguments[i+1];
+				i++;
+			}
+			else
+				positional.push_back( arguments[i] );
+		}
+		if( settings.pipelined ) {
+			if( pipelineString.compare( "auto" ) == 0 )
+				settings.pipeline = CRegionPipeline::GetDefaultSettings( settings.threadCount );
+			else if( !CRegionPipeline::ParseSettings( pipelineString, &settings.pipeline ) ) {
+				std::cout << "\'" << pipelineString << "\' is not a valid pipeline, expected read,inflate,parse,render,encode thread counts" << std::endl;
+				return false;
+			}
+		}
+		if( positional.empty() ) {
+			this->commandHelp( "generate" );
+			return true;
+		}
+		map = positional[0];
+		if( positional.size() >= 2 ) 
+			flags = std::vector<char>( positional[1], positional[1]+strlen( positional[1] ) );
+		if( positional.size() >= 3 )
+			output = positional[2];
+		return this->commandGenerate( map, flags, output, settings );
+	}
+	else if( command.compare( "serve" ) == 0 ) {
+		std::vector<char> flags;
+		std::vector<char*> positional;
+		GenerateSettings settings;
+		int optionLength;
+		unsigned short port = TILESERVER_DEFAULT_PORT;
+		settings.threadCount = CThreadPool::GetDefaultThreadCount();
+		settings.pipelined = false;
+		settings.format = IMAGE_FORMAT_JPEG;
+		settings.compressionLevel = PNG_DEFAULT_LEVEL;
+		settings.archive = false;
+		settings.full = false;
+		for( size_t i = 1; i < arguments.size(); i++ ) {
+			if( (optionLength = ParseImageOption( arguments, i, &settings )) != 0 ) {
+				if( optionLength < 0 )
+					return false;
+				i += optionLength - 1;
+			}
+			else if( strcmp( arguments[i], "-j" ) == 0 && i+1 < arguments.size() ) {
+				settings.threadCount = std::max( 1, atoi( arguments[i+1] ) );
+				i++;
+			}
+			else
+				positional.push_back( arguments[i] );
+		}
+		if( positional.empty() ) {
+			this->commandHelp( "serve" );
+			return true;
+		}
+		if( positional.size() >= 2 )
+			flags = std::vector<char>( positional[1], positional[1]+strlen( positional[1] ) );
+		if( positional.size() >= 3 )
+			port = (unsigned short)std::max( 1, std::min( 65535, atoi( positional[2] ) ) );
+		return this->commandServe( positional[0], flags, port, settings );
 	}
 	else if( command.compare( "genblocks" ) == 0 ) {
 		return this->commandGenBlocks();
 	}
+	else if( command.compare( "benchmark" ) == 0 ) {
+		if( arguments.size() < 3 ) {
+			this->commandHelp( "benchmark" );
+			return true;
+		}
+		std::vector<char*> testArguments( arguments.begin()+2, arguments.end() );
+		return this->commandBenchmark( arguments[1], testArguments );
+	}
 	else {
 		std::cout << "\'" << arguments[0] << "\' is not a valid command" << std::endl;
 		this->commandHelp();
@@ -115,7 +232,9 @@ void CConsole::commandHelp()
 
 	std::cout << "HELP\t\tDisplays help information" << std::endl;
 	std::cout << "GENERATE\tGenerates map data from a save file" << std::endl;
+	std::cout << "SERVE\t\tRenders map tiles for the viewer as they are asked for" << std::endl;
 	std::cout << "GENBLOCKS\tGenerates block colors from Minecraft data" << std::endl;
+	std::cout << "BENCHMARK\tTimes parts of map generation" << std::endl;
 }
 void CConsole::commandHelp( std::string command )
 {
@@ -124,50 +243,83 @@ void CConsole::commandHelp( std::string command )
 		std::cout << "Displays general help information, or help for a command specified by [command]" << std::endl;
 	}
 	else if( command.compare( "generate" ) == 0 ) {
-		std::cout << "Usage: generate [save] [flags] [output]" << std::endl;
+		std::cout << "Usage: generate [save] [flags] [output] [-j threads] [-p stages] [--format format] [--png-level level] [--archive] [--full]" << std::endl;
 		std::cout << "Generates map data from the save file specified by [save]\n[save] can be either a path relative to the .minecraft %appdata% folder or an absolute path.\nOutput path is optional, will be outputted to current directory if none is specified" << std::endl;
 		std::cout << "Flag format is -[flag chars], valid flags are:" << std::endl;
 		std::cout << "O\tWill ignore transparency, including water" << std::endl;
+		std::cout << "H\tShades the whole region from its height field, lit from the north west" << std::endl;
+		std::cout << "M\tAlso writes magnified zoom levels for each region, by default only zoomed out tiles are written" << std::endl;
+		std::cout << "-j [threads] sets how many regions are rendered at once, defaults to the number of hardware threads" << std::endl;
+		std::cout << "-p [stages] renders with a pipeline, [stages] is the thread count for each stage as read,inflate,parse,render,encode\nor auto to split the -j threads between them" << std::endl;
+		std::cout << "--format [format] sets how tiles are encoded, jpeg (default) or png8 for lossless palette PNGs" << std::endl;
+		std::cout << "--png-level [level] sets the zlib level for png8 from 0 (fastest) to 9 (smallest), defaults to " << PNG_DEFAULT_LEVEL << std::endl;
+		std::cout << "Regions rendered before are only drawn where their chunks have changed, the cache is kept in maps/[map]/" << RENDERCACHE_DIRECTORY << std::endl;
+		std::cout << "Chunks that are saved again without changing are copied from the cache instead of being drawn" << std::endl;
+		std::cout << "--full draws every region again and rebuilds the cache" << std::endl;
+		std::cout << "--archive packs every tile into maps/[map]/" << ARCHIVE_FILE_NAME << " instead of one file each, serve can read it but the viewer can't on its own" << std::endl;
+	}
+	else if( command.compare( "serve" ) == 0 ) {
+		std::cout << "Usage: serve [save] [flags] [port] [-j threads] [--format format] [--png-level level]" << std::endl;
+		std::cout << "Serves the viewer and its tiles from the save file specified by [save] at http://localhost:[port]/, port defaults to " << TILESERVER_DEFAULT_PORT << std::endl;
+		std::cout << "Tiles are rendered from the region files when first asked for, tiles already written by generate are used as they are\nif it was last run with the same flags and format and the region hasn't changed since" << std::endl;
+		std::cout << "If generate was run with --archive the tiles are read from its " << ARCHIVE_FILE_NAME << std::endl;
+		std::cout << "Takes the same flags, --format and --png-level as generate, the viewer files are read from mapsrc in the current directory" << std::endl;
+		std::cout << "-j [threads] sets how many requests are handled at once, defaults to the number of hardware threads" << std::endl;
 	}
 	else if( command.compare( "genblocks" ) == 0 ) {
 		std::cout << "Usage: genblocks" << std::endl;
 		std::cout << "Generates a config file for block colors based on Minecraft's data" << std::endl;
 	}
+	else if( command.compare( "benchmark" ) == 0 ) {
+		std::cout << "Usage: benchmark [test] [arguments]" << std::endl;
+		std::cout << "Times part of map generation, valid tests are:" << std::endl;
+		std::cout << "inflate [region] [iterations]\tDecompresses every chunk in the .mca file [region] with each available backend" << std::endl;
+		std::cout << "render [region] [iterations]\tDraws every chunk in the .mca file [region], needs the block data" << std::endl;
+		std::cout << "encode [region] [iterations]\tEncodes and writes the image of the .mca file [region], needs the block data" << std::endl;
+	}
 	else
 		std::cout << "No help found for command" << std::endl;
 }
-bool CConsole::commandGenerate( std::string map, std::vector<char> flags, std::string output )
+bool CConsole::findMap( std::string map, boost::filesystem::path *pFullPath )
 {
 	TCHAR appdataPath[MAX_PATH];
-	boost::filesystem::path fullMapPath;
 	bool foundPath;
-	CMapLoader mapLoader;
-	CRenderer *pRenderer;
-
-	// Find the map file
 
 	// Check app data first
 	foundPath = false;
 	if( SUCCEEDED( SHGetFolderPath( NULL, CSIDL_APPDATA, NULL, 0, appdataPath ) ) ) {
-		fullMapPath = appdataPath;
-		fullMapPath /= ".minecraft";
-		fullMapPath /= "saves";
-		fullMapPath /= map;
-		if( boost::filesystem::is_directory( fullMapPath ) )
+		(*pFullPath) = appdataPath;
+		(*pFullPath) /= ".minecraft";
+		(*pFullPath) /= "saves";
+		(*pFullPath) /= map;
+		if( boost::filesystem::is_directory( *pFullPath ) )
 			foundPath = true; // use this
 	}
 	// Try absolute path
 	if( !foundPath ) {
-		fullMapPath = map;
-		if( boost::filesystem::is_directory( fullMapPath ) )
+		(*pFullPath) = map;
+		if( boost::filesystem::is_directory( *pFullPath ) )
 			foundPath = true;
 	}
 	// If we didnt find anything
 	if( !foundPath ) {
-		std::cout << "Could not find map in %appdata% or at \'" << fullMapPath.string().c_str() << "\'" << std::endl;
+		std::cout << "Could not find map in %appdata% or at \'" << pFullPath->string().c_str() << "\'" << std::endl;
 		return false;
 	}
 
+	return true;
+}
+bool CConsole::commandGenerate( std::string map, std::vector<char> flags, std::string output, const GenerateSettings &settings )
+{
+	boost::filesystem::path fullMapPath;
+	CMapLoader mapLoader;
+	CRenderer *pRenderer;
+	RenderSettings renderSettings;
+
+	// Find the map file
+	if( !this->findMap( map, &fullMapPath ) )
+		return false;
+
 	// Load the map
 	std::cout << "\n\tMCMapper3\n\tTimothy Volpe (c) 2016\n\tVersion: " << MCMAPPER_VERSION_STRING << std::endl << std::endl;
 
@@ -177,17 +329,58 @@ bool CConsole::commandGenerate( std::string map, std::vector<char> flags, std::s
 	if( !mapLoader.load( fullMapPath ) )
 		return false;
 	std::cout << "Successfully loaded map" << std::endl;
+	if( settings.archive && !mapLoader.openArchive() )
+		return false;
 
 	// Render each region
-	std::cout << "Rendering regions (total: " << mapLoader.getRegionCount() << ")..." << std::endl;
-	pRenderer = new CRendererClassic();
+	if( std::find( flags.begin(), flags.end(), 'H' ) != flags.end() )
+		pRenderer = new CRendererHillshade();
+	else
+		pRenderer = new CRendererClassic();
+	renderSettings = pRenderer->getSettings();
+	renderSettings.magnify = std::find( flags.begin(), flags.end(), 'M' ) != flags.end();
+	renderSettings.format = settings.format;
+	renderSettings.compressionLevel = settings.compressionLevel;
+	pRenderer->setSettings( renderSettings );
 	mapLoader.setRenderer( pRenderer );
-	for( unsigned int i = 0; i < mapLoader.getRegionCount(); i++ ) {
-		// Render the next region
-		if( !mapLoader.nextRegion() )
-			return false;
+	// Without it everything is drawn, which is only slower
+	mapLoader.openRenderCache( settings.full );
+	if( settings.pipelined ) {
+		std::cout << "Rendering regions (total: " << mapLoader.getRegionCount() << ", pipeline:";
+		for( unsigned int i = 0; i < PIPELINE_STAGE_COUNT; i++ )
+			std::cout << " " << CRegionPipeline::GetStageName( (PipelineStage)i ) << "=" << settings.pipeline.stageThreads[i];
+		std::cout << ")..." << std::endl;
+	}
+	else
+		std::cout << "Rendering regions (total: " << mapLoader.getRegionCount() << ", threads: " << settings.threadCount << ")..." << std::endl;
+	if( !(settings.pipelined ? mapLoader.renderRegionsPipelined( settings.pipeline ) : mapLoader.renderRegions( settings.threadCount )) ) {
+		mapLoader.setRenderer( 0 );
+		delete pRenderer;
+		return false;
 	}
 	std::cout << "Successfully rendered regions" << std::endl;
+	std::cout << " > Skipped " << mapLoader.getTileWriter().getSkippedCount() << " blank tiles, linked " << mapLoader.getTileWriter().getLinkedCount() << " duplicate tiles" << std::endl;
+	if( mapLoader.getChunkCache().isEnabled() )
+		std::cout << " > Copied " << mapLoader.getChunkCache().getHitCount() << " chunks from the chunk cache, cached " << mapLoader.getChunkCache().getStoredCount() << " new chunks" << std::endl;
+
+	// Zoomed out levels need every region, so they come last
+	std::cout << "Building zoomed out tiles..." << std::endl;
+	if( !mapLoader.buildTilePyramid( settings.threadCount ) ) {
+		mapLoader.setRenderer( 0 );
+		delete pRenderer;
+		return false;
+	}
+	if( settings.archive && !mapLoader.closeArchive() ) {
+		mapLoader.setRenderer( 0 );
+		delete pRenderer;
+		return false;
+	}
+	// Only once the tiles are all written, so the cache never claims more than is on disk
+	if( !mapLoader.saveRenderCache() ) {
+		mapLoader.setRenderer( 0 );
+		delete pRenderer;
+		return false;
+	}
 
 	// Clean up
 	mapLoader.setRenderer( 0 );
@@ -198,7 +391,79 @@ bool CConsole::commandGenerate( std::string map, std::vector<char> flags, std::s
 
 	return true;
 }
+bool CConsole::commandServe( std::string map, std::vector<char> flags, unsigned short port, const GenerateSettings &settings )
+{
+	boost::filesystem::path fullMapPath;
+	CMapLoader mapLoader;
+	std::unique_ptr<CRenderer> pRenderer;
+	RenderSettings renderSettings;
+
+	if( !this->findMap( map, &fullMapPath ) )
+		return false;
+
+	std::cout << "\n\tMCMapper3\n\tTimothy Volpe (c) 2016\n\tVersion: " << MCMAPPER_VERSION_STRING << std::endl << std::endl;
+
+	if( !mapLoader.initialize() )
+		return false;
+	std::cout << "Loading map at \'"<< fullMapPath.string().c_str() << "\'" << std::endl;
+	if( !mapLoader.load( fullMapPath ) )
+		return false;
+
+	if( std::find( flags.begin(), flags.end(), 'H' ) != flags.end() )
+		pRenderer.reset( new CRendererHillshade() );
+	else
+		pRenderer.reset( new CRendererClassic() );
+	renderSettings = pRenderer->getSettings();
+	// Magnified levels are always served, the flag only has to match generate's for its tiles to be reused
+	renderSettings.magnify = std::find( flags.begin(), flags.end(), 'M' ) != flags.end();
+	renderSettings.format = settings.format;
+	renderSettings.compressionLevel = settings.compressionLevel;
+	pRenderer->setSettings( renderSettings );
+	mapLoader.setRenderer( pRenderer.get() );
+
+	// Only returns if something went wrong
+	{
+		CTileServer tileServer( mapLoader );
+		if( !tileServer.start( settings.threadCount ) || !tileServer.run( port ) ) {
+			mapLoader.setRenderer( 0 );
+			return false;
+		}
+	}
+	mapLoader.setRenderer( 0 );
+
+	return true;
+}
 bool CConsole::commandGenBlocks()
 {
 	return true;
+}
+bool CConsole::commandBenchmark( std::string test, std::vector<char*> &arguments )
+{
+	CBenchmark benchmark;
+
+	std::transform( test.begin(), test.end(), test.begin(), ::tolower );
+
+	if( test.compare( "inflate" ) == 0 ) {
+		unsigned int iterations = 10;
+		if( arguments.size() >= 2 )
+			iterations = std::max( 1, atoi( arguments[1] ) );
+		return benchmark.benchmarkInflate( arguments[0], iterations );
+	}
+	else if( test.compare( "render" ) == 0 ) {
+		unsigned int iterations = 100;
+		if( arguments.size() >= 2 )
+			iterations = std::max( 1, atoi( arguments[1] ) );
+		return benchmark.benchmarkRender( arguments[0], iterations );
+	}
+	else if( test.compare( "encode" ) == 0 ) {
+		unsigned int iterations = 20;
+		if( arguments.size() >= 2 )
+			iterations = std::max( 1, atoi( arguments[1] ) );
+		return benchmark.benchmarkEncode( arguments[0], iterations );
+	}
+	else {
+		std::cout << "\'" << test << "\' is not a valid benchmark" << std::endl;
+		this->commandHelp( "benchmark" );
+		return true;
+	}
 }
\ No newline at end of file
@@ -25,6 +25,24 @@
 #pragma once
 
 #include <vector>
+#include <string>
+#include <boost\filesystem.hpp>
+#include "pipeline.h"
+#include "encoder.h"
+
+// Options for generate and serve that come from switches rather than position
+struct GenerateSettings
+{
+	unsigned int threadCount;
+	bool pipelined;
+	PipelineSettings pipeline;
+	ImageFormat format;
+	int compressionLevel;
+	// Pack the tiles into one file
+	bool archive;
+	// Draw every region even if the cache says it hasn't changed
+	bool full;
+};
 
 class CConsole
 {
@@ -33,8 +51,16 @@ private:
 
 	void commandHelp();
 	void commandHelp( std::string command );
-	bool commandGenerate( std::string map, std::vector<char> flags, std::string output );
+	/*
+		@method: findMap
+		@returns: if a save was found
+		Looks for the save in the .minecraft %appdata% folder, then as a path
+	*/
+	bool findMap( std::string map, boost::filesystem::path *pFullPath );
+	bool commandGenerate( std::string map, std::vector<char> flags, std::string output, const GenerateSettings &settings );
+	bool commandServe( std::string map, std::vector<char> flags, unsigned short port, const GenerateSettings &settings );
 	bool commandGenBlocks();
+	bool commandBenchmark( std::string test, std::vector<char*> &arguments );
 public:
 	static CConsole& getInstance();
 
@@ -27,3 +27,8 @@
 #define MCMAPPER_VERSION_MAJOR 0
 #define MCMAPPER_VERSION_MINOR 1
 #define MCMAPPER_VERSION_STRING "1b"
+
+// Optional chunk decompression backends, define to build them in
+// The library has to be on the include and library paths, zlib is always available
+//#define MCMAPPER_USE_LIBDEFLATE
+//#define MCMAPPER_USE_ZLIBNG
\ No newline at end of file
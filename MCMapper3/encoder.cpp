@@ -0,0 +1,359 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <csetjmp>
+#include <algorithm>
+extern "C" {
+#include <jpeglib.h>
+}
+#include <png.h>
+#include "encoder.h"
+#include "threadpool.h"
+
+#pragma comment( lib, "libpng.lib" )
+
+// Grow the output in steps this big, a 512x512 tile is usually well under it
+#define JPEG_OUTPUT_BLOCK 65536
+// Open addressed, so keep it well over the palette size
+#define PNG_COLOR_TABLE_SIZE 1024
+
+struct VectorDestination
+{
+	jpeg_destination_mgr manager;
+	std::vector<unsigned char> *pOutput;
+};
+struct JumpErrorManager
+{
+	jpeg_error_mgr manager;
+	jmp_buf jumpBuffer;
+};
+
+static void InitDestination( j_compress_ptr pInfo )
+{
+	VectorDestination *pDestination = reinterpret_cast<VectorDestination*>(pInfo->dest);
+
+	pDestination->pOutput->resize( JPEG_OUTPUT_BLOCK );
+	pDestination->manager.next_output_byte = pDestination->pOutput->data();
+	pDestination->manager.free_in_buffer = pDestination->pOutput->size();
+}
+static boolean EmptyOutputBuffer( j_compress_ptr pInfo )
+{
+	VectorDestination *pDestination = reinterpret_cast<VectorDestination*>(pInfo->dest);
+	size_t used;
+
+	// libjpeg only calls this once the whole buffer is full, whatever free_in_buffer says
+	used = pDestination->pOutput->size();
+	pDestination->pOutput->resize( used*2 );
+	pDestination->manager.next_output_byte = pDestination->pOutput->data() + used;
+	pDestination->manager.free_in_buffer = pDestination->pOutput->size() - used;
+	return TRUE;
+}
+static void TermDestination( j_compress_ptr pInfo )
+{
+	VectorDestination *pDestination = reinterpret_cast<VectorDestination*>(pInfo->dest);
+	pDestination->pOutput->resize( pDestination->pOutput->size() - pDestination->manager.free_in_buffer );
+}
+static void JumpOnError( j_common_ptr pInfo )
+{
+	JumpErrorManager *pError = reinterpret_cast<JumpErrorManager*>(pInfo->err);
+	longjmp( pError->jumpBuffer, 1 );
+}
+
+struct CJpegEncoder::JpegState
+{
+	jpeg_compress_struct info;
+	JumpErrorManager error;
+	VectorDestination destination;
+	bool created;
+};
+
+const char* CJpegEncoder::GetLibraryName()
+{
+#ifdef LIBJPEG_TURBO_VERSION
+	return "libjpeg-turbo";
+#else
+	return "libjpeg";
+#endif
+}
+
+CJpegEncoder::CJpegEncoder()
+{
+	m_quality = JPEG_DEFAULT_QUALITY;
+
+	m_pState = new JpegState;
+	m_pState->info.err = jpeg_std_error( &m_pState->error.manager );
+	m_pState->error.manager.error_exit = JumpOnError;
+	m_pState->destination.manager.init_destination = InitDestination;
+	m_pState->destination.manager.empty_output_buffer = EmptyOutputBuffer;
+	m_pState->destination.manager.term_destination = TermDestination;
+	m_pState->destination.pOutput = 0;
+	// Only fails if libjpeg is out of memory, encode tries again in that case
+	m_pState->created = false;
+	if( !setjmp( m_pState->error.jumpBuffer ) ) {
+		jpeg_create_compress( &m_pState->info );
+		m_pState->created = true;
+	}
+}
+CJpegEncoder::~CJpegEncoder()
+{
+	if( m_pState->created )
+		jpeg_destroy_compress( &m_pState->info );
+	delete m_pState;
+}
+
+void CJpegEncoder::setQuality( int quality ) {
+	m_quality = quality;
+}
+int CJpegEncoder::getQuality() const {
+	return m_quality;
+}
+
+bool CJpegEncoder::encode( const boost::gil::rgb8_image_t::const_view_t &view, std::vector<unsigned char> *pOutput )
+{
+	jpeg_compress_struct &info = m_pState->info;
+	JSAMPROW pRow;
+
+	// Anything that fails inside libjpeg comes back here, aborting keeps the compressor usable for the next image
+	if( setjmp( m_pState->error.jumpBuffer ) ) {
+		if( m_pState->created )
+			jpeg_abort_compress( &info );
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: could not encode JPEG" << std::endl;
+		return false;
+	}
+	if( !m_pState->created ) {
+		jpeg_create_compress( &info );
+		m_pState->created = true;
+	}
+
+	m_pState->destination.pOutput = pOutput;
+	info.dest = &m_pState->destination.manager;
+
+	info.image_width = (JDIMENSION)view.width();
+	info.image_height = (JDIMENSION)view.height();
+	info.input_components = 3;
+	info.in_color_space = JCS_RGB;
+	jpeg_set_defaults( &info );
+	jpeg_set_quality( &info, m_quality, TRUE );
+
+	jpeg_start_compress( &info, TRUE );
+	for( int y = 0; y < (int)view.height(); y++ ) {
+		pRow = const_cast<JSAMPROW>(reinterpret_cast<const JSAMPLE*>(&view( 0, y )));
+		jpeg_write_scanlines( &info, &pRow, 1 );
+	}
+	jpeg_finish_compress( &info );
+
+	return true;
+}
+
+/////////////////
+// CPngEncoder //
+/////////////////
+
+static void WritePngData( png_structp pPng, png_bytep pData, png_size_t length )
+{
+	std::vector<unsigned char> *pOutput = reinterpret_cast<std::vector<unsigned char>*>(png_get_io_ptr( pPng ));
+	pOutput->insert( pOutput->end(), pData, pData + length );
+}
+static void FlushPngData( png_structp ) {
+}
+
+CPngEncoder::CPngEncoder() {
+	m_level = PNG_DEFAULT_LEVEL;
+}
+CPngEncoder::~CPngEncoder() {
+}
+
+void CPngEncoder::setLevel( int level ) {
+	m_level = std::min( std::max( level, 0 ), 9 );
+}
+int CPngEncoder::getLevel() const {
+	return m_level;
+}
+
+bool CPngEncoder::buildPalette( const boost::gil::rgb8_image_t::const_view_t &view )
+{
+	boost::uint32_t lastColor;
+	unsigned char lastIndex;
+
+	m_indices.resize( view.width() * view.height() );
+	m_colorKeys.assign( PNG_COLOR_TABLE_SIZE, 0 );
+	m_colorIndices.resize( PNG_COLOR_TABLE_SIZE );
+	m_palette.clear();
+
+	// Neighbouring pixels are usually the same block, so check the last color before the table
+	lastColor = 0;
+	lastIndex = 0;
+	for( int y = 0; y < (int)view.height(); y++ )
+	{
+		const unsigned char *pPixel = reinterpret_cast<const unsigned char*>(&view( 0, y ));
+		unsigned char *pIndex = &m_indices[y * view.width()];
+
+		for( int x = 0; x < (int)view.width(); x++, pPixel += 3 )
+		{
+			// The top bit marks a used slot, so black is still a valid key
+			boost::uint32_t color = 0x80000000u | pPixel[0] | (pPixel[1] << 8) | (pPixel[2] << 16);
+			size_t slot;
+
+			if( color == lastColor ) {
+				pIndex[x] = lastIndex;
+				continue;
+			}
+			slot = (color * 2654435761u) >> 22;
+			while( m_colorKeys[slot] != 0 && m_colorKeys[slot] != color )
+				slot = (slot + 1) & (PNG_COLOR_TABLE_SIZE - 1);
+			if( m_colorKeys[slot] == 0 ) {
+				if( m_palette.size() == PNG_PALETTE_SIZE )
+					return false;
+				m_colorKeys[slot] = color;
+				m_colorIndices[slot] = (unsigned char)m_palette.size();
+				m_palette.push_back( color );
+			}
+			lastColor = color;
+			lastIndex = m_colorIndices[slot];
+			pIndex[x] = lastIndex;
+		}
+	}
+	return true;
+}
+bool CPngEncoder::encode( const boost::gil::rgb8_image_t::const_view_t &view, std::vector<unsigned char> *pOutput )
+{
+	png_structp pPng;
+	png_infop pInfo;
+	png_color palette[PNG_PALETTE_SIZE];
+	bool indexed;
+	int bitDepth;
+
+	indexed = this->buildPalette( view );
+
+	pPng = png_create_write_struct( PNG_LIBPNG_VER_STRING, 0, 0, 0 );
+	if( !pPng )
+		return false;
+	pInfo = png_create_info_struct( pPng );
+	if( !pInfo ) {
+		png_destroy_write_struct( &pPng, 0 );
+		return false;
+	}
+	if( setjmp( png_jmpbuf( pPng ) ) ) {
+		png_destroy_write_struct( &pPng, &pInfo );
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: could not encode PNG" << std::endl;
+		return false;
+	}
+
+	pOutput->clear();
+	png_set_write_fn( pPng, pOutput, WritePngData, FlushPngData );
+	png_set_compression_level( pPng, m_level );
+
+	if( indexed )
+	{
+		// Fewer colors pack into fewer bits
+		bitDepth = m_palette.size() <= 2 ? 1 : m_palette.size() <= 4 ? 2 : m_palette.size() <= 16 ? 4 : 8;
+		for( size_t i = 0; i < m_palette.size(); i++ ) {
+			palette[i].red = (png_byte)(m_palette[i] & 0xFF);
+			palette[i].green = (png_byte)((m_palette[i] >> 8) & 0xFF);
+			palette[i].blue = (png_byte)((m_palette[i] >> 16) & 0xFF);
+		}
+		png_set_IHDR( pPng, pInfo, (png_uint_32)view.width(), (png_uint_32)view.height(), bitDepth, PNG_COLOR_TYPE_PALETTE,
+			PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT );
+		png_set_PLTE( pPng, pInfo, palette, (int)m_palette.size() );
+		// Filters don't help palette images, they only cost time
+		png_set_filter( pPng, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE );
+		png_write_info( pPng, pInfo );
+		if( bitDepth < 8 )
+			png_set_packing( pPng );
+		for( int y = 0; y < (int)view.height(); y++ )
+			png_write_row( pPng, &m_indices[y * view.width()] );
+	}
+	else
+	{
+		png_set_IHDR( pPng, pInfo, (png_uint_32)view.width(), (png_uint_32)view.height(), 8, PNG_COLOR_TYPE_RGB,
+			PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT );
+		png_write_info( pPng, pInfo );
+		for( int y = 0; y < (int)view.height(); y++ )
+			png_write_row( pPng, const_cast<png_bytep>(reinterpret_cast<const png_byte*>(&view( 0, y ))) );
+	}
+	png_write_end( pPng, pInfo );
+	png_destroy_write_struct( &pPng, &pInfo );
+
+	return true;
+}
+
+///////////////////
+// CImageEncoder //
+///////////////////
+
+const char* CImageEncoder::GetFormatName( ImageFormat format )
+{
+	switch( format )
+	{
+	case IMAGE_FORMAT_JPEG:
+		return "jpeg";
+	case IMAGE_FORMAT_PNG8:
+		return "png8";
+	default:
+		return "unknown";
+	}
+}
+ImageFormat CImageEncoder::GetFormatByName( std::string name )
+{
+	std::transform( name.begin(), name.end(), name.begin(), ::tolower );
+	for( unsigned int i = 0; i < IMAGE_FORMAT_COUNT; i++ ) {
+		if( name.compare( CImageEncoder::GetFormatName( (ImageFormat)i ) ) == 0 )
+			return (ImageFormat)i;
+	}
+	return IMAGE_FORMAT_COUNT;
+}
+const char* CImageEncoder::GetExtension( ImageFormat format ) {
+	return format == IMAGE_FORMAT_PNG8 ? ".png" : ".jpeg";
+}
+const char* CImageEncoder::GetContentType( ImageFormat format ) {
+	return format == IMAGE_FORMAT_PNG8 ? "image/png" : "image/jpeg";
+}
+
+CImageEncoder::CImageEncoder() {
+	m_format = IMAGE_FORMAT_JPEG;
+}
+CImageEncoder::~CImageEncoder() {
+}
+
+void CImageEncoder::setFormat( ImageFormat format, int compressionLevel )
+{
+	_ASSERT_EXPR( format < IMAGE_FORMAT_COUNT, L"invalid image format" );
+
+	m_format = format;
+	m_pngEncoder.setLevel( compressionLevel );
+}
+ImageFormat CImageEncoder::getFormat() const {
+	return m_format;
+}
+
+bool CImageEncoder::encode( const boost::gil::rgb8_image_t::const_view_t &view, std::vector<unsigned char> *pOutput )
+{
+	if( m_format == IMAGE_FORMAT_PNG8 )
+		return m_pngEncoder.encode( view, pOutput );
+	return m_jpegEncoder.encode( view, pOutput );
+}
\ No newline at end of file
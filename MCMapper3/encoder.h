@@ -0,0 +1,154 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <boost\gil\gil_all.hpp>
+#include <vector>
+#include <string>
+
+#define JPEG_DEFAULT_QUALITY 100
+// zlib level for PNG, 0 is stored and 9 is smallest
+#define PNG_DEFAULT_LEVEL 6
+#define PNG_PALETTE_SIZE 256
+
+enum ImageFormat : unsigned int
+{
+	IMAGE_FORMAT_JPEG	= 0,
+	IMAGE_FORMAT_PNG8	= 1,
+	IMAGE_FORMAT_COUNT
+};
+
+/*
+	Encodes images to JPEG in memory, for when the result isn't going straight to a file
+	The compressor is set up once and reused for every image, so keep one for each thread
+	Works with plain libjpeg 6, so it brings its own destination manager
+*/
+class CJpegEncoder
+{
+private:
+	// libjpeg state, kept out of the header because jpeglib.h clashes with windows.h
+	struct JpegState;
+	JpegState *m_pState;
+	int m_quality;
+public:
+	/*
+		@method: GetLibraryName
+		@returns: which libjpeg the encoder was built against
+	*/
+	static const char* GetLibraryName();
+
+	CJpegEncoder();
+	~CJpegEncoder();
+
+	CJpegEncoder( CJpegEncoder const& ) = delete;
+	void operator=( CJpegEncoder const& ) = delete;
+
+	void setQuality( int quality );
+	int getQuality() const;
+
+	/*
+		@method: encode
+		@returns: if the image was encoded
+		Replaces the contents of pOutput with the encoded image
+	*/
+	bool encode( const boost::gil::rgb8_image_t::const_view_t &view, std::vector<unsigned char> *pOutput );
+};
+
+/*
+	Encodes images to PNG in memory, with a palette when the image has few enough colors
+	Tiles of the classic renderer only use the shades of the blocks in them, which nearly always fit
+	Images with more than 256 colors are written as 24-bit RGB instead
+*/
+class CPngEncoder
+{
+private:
+	int m_level;
+
+	// Reused between images, the palette index of every pixel and a small hash table of colors seen so far
+	std::vector<unsigned char> m_indices;
+	std::vector<boost::uint32_t> m_colorKeys;
+	std::vector<unsigned char> m_colorIndices;
+	std::vector<boost::uint32_t> m_palette;
+
+	bool buildPalette( const boost::gil::rgb8_image_t::const_view_t &view );
+public:
+	CPngEncoder();
+	~CPngEncoder();
+
+	/*
+		@method: setLevel
+		@returns: none
+		Sets the zlib compression level, from 0 to 9
+	*/
+	void setLevel( int level );
+	int getLevel() const;
+
+	/*
+		@method: encode
+		@returns: if the image was encoded
+		Replaces the contents of pOutput with the encoded image
+	*/
+	bool encode( const boost::gil::rgb8_image_t::const_view_t &view, std::vector<unsigned char> *pOutput );
+};
+
+/*
+	Encodes with whichever format it is set to
+*/
+class CImageEncoder
+{
+private:
+	ImageFormat m_format;
+	CJpegEncoder m_jpegEncoder;
+	CPngEncoder m_pngEncoder;
+public:
+	static const char* GetFormatName( ImageFormat format );
+	/*
+		@method: GetFormatByName
+		@returns: IMAGE_FORMAT_COUNT if there is no format by that name
+	*/
+	static ImageFormat GetFormatByName( std::string name );
+	/*
+		@method: GetExtension
+		@returns: the file extension for the format, with its dot
+	*/
+	static const char* GetExtension( ImageFormat format );
+	static const char* GetContentType( ImageFormat format );
+
+	CImageEncoder();
+	~CImageEncoder();
+
+	CImageEncoder( CImageEncoder const& ) = delete;
+	void operator=( CImageEncoder const& ) = delete;
+
+	/*
+		@method: setFormat
+		@returns: none
+		compressionLevel is only used by PNG
+	*/
+	void setFormat( ImageFormat format, int compressionLevel );
+	ImageFormat getFormat() const;
+
+	bool encode( const boost::gil::rgb8_image_t::const_view_t &view, std::vector<unsigned char> *pOutput );
+};
\ No newline at end of file
@@ -0,0 +1,77 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include <cstring>
+#include "hash.h"
+
+#define MURMUR_MULTIPLIER 0xc6a4a7935bd1e995ULL
+#define MURMUR_SHIFT 47
+
+boost::uint64_t HashBytes( const void *pData, size_t length, boost::uint64_t seed )
+{
+	const unsigned char *pBytes = reinterpret_cast<const unsigned char*>(pData);
+	const unsigned char *pEnd = pBytes + (length & ~(size_t)7);
+	boost::uint64_t hash, block;
+
+	hash = seed ^ (length * MURMUR_MULTIPLIER);
+	for( ; pBytes != pEnd; pBytes += 8 )
+	{
+		// memcpy so unaligned rows are fine, it compiles to a plain load
+		memcpy( &block, pBytes, sizeof( block ) );
+		block *= MURMUR_MULTIPLIER;
+		block ^= block >> MURMUR_SHIFT;
+		block *= MURMUR_MULTIPLIER;
+
+		hash ^= block;
+		hash *= MURMUR_MULTIPLIER;
+	}
+	// Whatever is left over
+	switch( length & 7 )
+	{
+	case 7: hash ^= (boost::uint64_t)pBytes[6] << 48;
+	case 6: hash ^= (boost::uint64_t)pBytes[5] << 40;
+	case 5: hash ^= (boost::uint64_t)pBytes[4] << 32;
+	case 4: hash ^= (boost::uint64_t)pBytes[3] << 24;
+	case 3: hash ^= (boost::uint64_t)pBytes[2] << 16;
+	case 2: hash ^= (boost::uint64_t)pBytes[1] << 8;
+	case 1: hash ^= (boost::uint64_t)pBytes[0];
+		hash *= MURMUR_MULTIPLIER;
+	}
+
+	hash ^= hash >> MURMUR_SHIFT;
+	hash *= MURMUR_MULTIPLIER;
+	hash ^= hash >> MURMUR_SHIFT;
+
+	return hash;
+}
+boost::uint64_t HashImage( const boost::gil::rgb8_image_t::const_view_t &view )
+{
+	boost::uint64_t hash;
+
+	// Each row seeds the next, so the size is part of the hash as well
+	hash = ((boost::uint64_t)view.width() << 32) | (boost::uint64_t)view.height();
+	for( int y = 0; y < (int)view.height(); y++ )
+		hash = HashBytes( &view( 0, y ), view.width() * sizeof( boost::gil::rgb8_pixel_t ), hash );
+	return hash;
+}
\ No newline at end of file
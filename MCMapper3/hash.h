@@ -0,0 +1,42 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <boost\integer.hpp>
+#include <boost\gil\gil_all.hpp>
+#include <cstddef>
+
+/*
+	@function: HashBytes
+	@returns: a 64-bit hash of length bytes at pData
+	MurmurHash64A, fast enough to run on every tile before it is encoded
+	Not meant to resist collisions on purpose, only to tell apart tiles that differ
+*/
+boost::uint64_t HashBytes( const void *pData, size_t length, boost::uint64_t seed = 0 );
+/*
+	@function: HashImage
+	@returns: a 64-bit hash of the pixels in view, row by row
+*/
+boost::uint64_t HashImage( const boost::gil::rgb8_image_t::const_view_t &view );
\ No newline at end of file
@@ -0,0 +1,291 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include "inflate.h"
+#include "threadpool.h"
+#ifdef MCMAPPER_USE_LIBDEFLATE
+#include <libdeflate.h>
+#pragma comment( lib, "libdeflate.lib" )
+#endif
+#ifdef MCMAPPER_USE_ZLIBNG
+#pragma comment( lib, "zlib-ng.lib" )
+#endif
+
+bool CInflater::IsBackendAvailable( InflateBackend backend )
+{
+	switch( backend )
+	{
+	case INFLATE_ZLIB:
+		return true;
+#ifdef MCMAPPER_USE_LIBDEFLATE
+	case INFLATE_LIBDEFLATE:
+		return true;
+#endif
+#ifdef MCMAPPER_USE_ZLIBNG
+	case INFLATE_ZLIBNG:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+const char* CInflater::GetBackendName( InflateBackend backend )
+{
+	switch( backend )
+	{
+	case INFLATE_ZLIB:
+		return "zlib";
+	case INFLATE_LIBDEFLATE:
+		return "libdeflate";
+	case INFLATE_ZLIBNG:
+		return "zlib-ng";
+	default:
+		return "unknown";
+	}
+}
+bool CInflater::GetBackendByName( std::string name, InflateBackend *pBackend )
+{
+	for( unsigned int i = 0; i < INFLATE_BACKEND_COUNT; i++ ) {
+		if( name.compare( CInflater::GetBackendName( (InflateBackend)i ) ) == 0 ) {
+			(*pBackend) = (InflateBackend)i;
+			return true;
+		}
+	}
+	return false;
+}
+InflateBackend CInflater::GetDefaultBackend()
+{
+#if defined( MCMAPPER_USE_LIBDEFLATE )
+	return INFLATE_LIBDEFLATE;
+#elif defined( MCMAPPER_USE_ZLIBNG )
+	return INFLATE_ZLIBNG;
+#else
+	return INFLATE_ZLIB;
+#endif
+}
+
+CInflater::CInflater()
+{
+	m_backend = CInflater::GetDefaultBackend();
+	m_outputLength = 0;
+	m_zlibInitialized = false;
+#ifdef MCMAPPER_USE_LIBDEFLATE
+	m_pLibdeflate = 0;
+#endif
+#ifdef MCMAPPER_USE_ZLIBNG
+	m_zngInitialized = false;
+#endif
+}
+CInflater::~CInflater()
+{
+	if( m_zlibInitialized ) {
+		inflateEnd( &m_zlibStream );
+		m_zlibInitialized = false;
+	}
+#ifdef MCMAPPER_USE_LIBDEFLATE
+	if( m_pLibdeflate ) {
+		libdeflate_free_decompressor( m_pLibdeflate );
+		m_pLibdeflate = 0;
+	}
+#endif
+#ifdef MCMAPPER_USE_ZLIBNG
+	if( m_zngInitialized ) {
+		zng_inflateEnd( &m_zngStream );
+		m_zngInitialized = false;
+	}
+#endif
+}
+
+bool CInflater::setBackend( InflateBackend backend )
+{
+	if( !CInflater::IsBackendAvailable( backend ) )
+		return false;
+	m_backend = backend;
+	return true;
+}
+InflateBackend CInflater::getBackend() const {
+	return m_backend;
+}
+
+bool CInflater::inflate( const char *pSource, size_t length, unsigned char compression )
+{
+	m_outputLength = 0;
+	if( compression != COMPRESSION_GZIP && compression != COMPRESSION_ZLIB ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: unknown compression type " << (int)compression << std::endl;
+		return false;
+	}
+	// Start with a buffer big enough for most chunks, it only ever grows
+	if( m_output.size() < INFLATE_MIN_OUTPUT )
+		m_output.resize( INFLATE_MIN_OUTPUT );
+
+	switch( m_backend )
+	{
+	case INFLATE_LIBDEFLATE:
+		return this->inflateLibdeflate( pSource, length, compression );
+	case INFLATE_ZLIBNG:
+		return this->inflateZlibng( pSource, length );
+	default:
+		return this->inflateZlib( pSource, length );
+	}
+}
+
+bool CInflater::inflateZlib( const char *pSource, size_t length )
+{
+	int result;
+
+	// The stream is set up once and reset for every chunk, window bits of 15+32 detect zlib or gzip headers
+	if( !m_zlibInitialized ) {
+		m_zlibStream.zalloc = Z_NULL;
+		m_zlibStream.zfree = Z_NULL;
+		m_zlibStream.opaque = Z_NULL;
+		m_zlibStream.next_in = Z_NULL;
+		m_zlibStream.avail_in = 0;
+		if( inflateInit2( &m_zlibStream, 15+32 ) != Z_OK ) {
+			std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+			std::cout << " > Failed: could not initialize zlib" << std::endl;
+			return false;
+		}
+		m_zlibInitialized = true;
+	}
+	else
+		inflateReset( &m_zlibStream );
+
+	m_zlibStream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(pSource));
+	m_zlibStream.avail_in = (uInt)length;
+	m_zlibStream.next_out = reinterpret_cast<Bytef*>(&m_output[0]);
+	m_zlibStream.avail_out = (uInt)m_output.size();
+	for( ;; )
+	{
+		result = ::inflate( &m_zlibStream, Z_FINISH );
+		if( result == Z_STREAM_END )
+			break;
+		// Out of room, grow the buffer and keep going
+		if( (result == Z_BUF_ERROR || result == Z_OK) && m_zlibStream.avail_out == 0 ) {
+			size_t used = m_output.size();
+			m_output.resize( used*2 );
+			m_zlibStream.next_out = reinterpret_cast<Bytef*>(&m_output[used]);
+			m_zlibStream.avail_out = (uInt)(m_output.size() - used);
+			continue;
+		}
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: could not decompress chunk (" << (m_zlibStream.msg ? m_zlibStream.msg : "truncated data") << ")" << std::endl;
+		return false;
+	}
+	m_outputLength = m_zlibStream.total_out;
+
+	return true;
+}
+bool CInflater::inflateLibdeflate( const char *pSource, size_t length, unsigned char compression )
+{
+#ifdef MCMAPPER_USE_LIBDEFLATE
+	libdeflate_result result;
+	size_t actualLength;
+
+	if( !m_pLibdeflate ) {
+		m_pLibdeflate = libdeflate_alloc_decompressor();
+		if( !m_pLibdeflate ) {
+			std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+			std::cout << " > Failed: could not initialize libdeflate" << std::endl;
+			return false;
+		}
+	}
+
+	// libdeflate needs the whole output at once, so retry with a bigger buffer until it fits
+	for( ;; )
+	{
+		if( compression == COMPRESSION_GZIP )
+			result = libdeflate_gzip_decompress( m_pLibdeflate, pSource, length, &m_output[0], m_output.size(), &actualLength );
+		else
+			result = libdeflate_zlib_decompress( m_pLibdeflate, pSource, length, &m_output[0], m_output.size(), &actualLength );
+		if( result != LIBDEFLATE_INSUFFICIENT_SPACE )
+			break;
+		m_output.resize( m_output.size()*2 );
+	}
+	if( result != LIBDEFLATE_SUCCESS ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: could not decompress chunk (libdeflate error " << (int)result << ")" << std::endl;
+		return false;
+	}
+	m_outputLength = actualLength;
+
+	return true;
+#else
+	return false;
+#endif
+}
+bool CInflater::inflateZlibng( const char *pSource, size_t length )
+{
+#ifdef MCMAPPER_USE_ZLIBNG
+	int32_t result;
+
+	if( !m_zngInitialized ) {
+		memset( &m_zngStream, 0, sizeof( m_zngStream ) );
+		if( zng_inflateInit2( &m_zngStream, 15+32 ) != Z_OK ) {
+			std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+			std::cout << " > Failed: could not initialize zlib-ng" << std::endl;
+			return false;
+		}
+		m_zngInitialized = true;
+	}
+	else
+		zng_inflateReset( &m_zngStream );
+
+	m_zngStream.next_in = reinterpret_cast<const uint8_t*>(pSource);
+	m_zngStream.avail_in = (uint32_t)length;
+	m_zngStream.next_out = reinterpret_cast<uint8_t*>(&m_output[0]);
+	m_zngStream.avail_out = (uint32_t)m_output.size();
+	for( ;; )
+	{
+		result = zng_inflate( &m_zngStream, Z_FINISH );
+		if( result == Z_STREAM_END )
+			break;
+		if( (result == Z_BUF_ERROR || result == Z_OK) && m_zngStream.avail_out == 0 ) {
+			size_t used = m_output.size();
+			m_output.resize( used*2 );
+			m_zngStream.next_out = reinterpret_cast<uint8_t*>(&m_output[used]);
+			m_zngStream.avail_out = (uint32_t)(m_output.size() - used);
+			continue;
+		}
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: could not decompress chunk (" << (m_zngStream.msg ? m_zngStream.msg : "truncated data") << ")" << std::endl;
+		return false;
+	}
+	m_outputLength = m_zngStream.total_out;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+const char* CInflater::getData() const {
+	return m_output.empty() ? 0 : &m_output[0];
+}
+size_t CInflater::getLength() const {
+	return m_outputLength;
+}
@@ -0,0 +1,112 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <zlib.h>
+#include "def.h"
+
+#ifdef MCMAPPER_USE_LIBDEFLATE
+struct libdeflate_decompressor;
+#endif
+#ifdef MCMAPPER_USE_ZLIBNG
+#include <zlib-ng.h>
+#endif
+
+// Chunk compression types from the region file
+enum : unsigned char
+{
+	COMPRESSION_GZIP	= 1,
+	COMPRESSION_ZLIB	= 2
+};
+
+enum InflateBackend : unsigned int
+{
+	INFLATE_ZLIB		= 0,
+	INFLATE_LIBDEFLATE	= 1,
+	INFLATE_ZLIBNG		= 2,
+	INFLATE_BACKEND_COUNT
+};
+
+#define INFLATE_MIN_OUTPUT 65536
+
+/*
+	Decompresses whole chunks in one call into an output buffer that is kept and grown as needed
+	Not thread safe, each worker should have its own
+*/
+class CInflater
+{
+private:
+	InflateBackend m_backend;
+	std::vector<char> m_output;
+	size_t m_outputLength;
+
+	z_stream m_zlibStream;
+	bool m_zlibInitialized;
+#ifdef MCMAPPER_USE_LIBDEFLATE
+	libdeflate_decompressor *m_pLibdeflate;
+#endif
+#ifdef MCMAPPER_USE_ZLIBNG
+	zng_stream m_zngStream;
+	bool m_zngInitialized;
+#endif
+
+	bool inflateZlib( const char *pSource, size_t length );
+	bool inflateLibdeflate( const char *pSource, size_t length, unsigned char compression );
+	bool inflateZlibng( const char *pSource, size_t length );
+public:
+	static bool IsBackendAvailable( InflateBackend backend );
+	static const char* GetBackendName( InflateBackend backend );
+	static bool GetBackendByName( std::string name, InflateBackend *pBackend );
+	/*
+		@method: GetDefaultBackend
+		@returns: the fastest backend that was compiled in
+	*/
+	static InflateBackend GetDefaultBackend();
+
+	CInflater();
+	~CInflater();
+
+	CInflater( CInflater const& ) = delete;
+	void operator=( CInflater const& ) = delete;
+
+	/*
+		@method: setBackend
+		@returns: if the backend is available
+	*/
+	bool setBackend( InflateBackend backend );
+	InflateBackend getBackend() const;
+
+	/*
+		@method: inflate
+		@returns: if the data was decompressed successfully
+		Decompresses a whole chunk, the result is valid until the next call
+	*/
+	bool inflate( const char *pSource, size_t length, unsigned char compression );
+
+	const char* getData() const;
+	size_t getLength() const;
+};
@@ -0,0 +1,129 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <mutex>
+#include <list>
+#include <map>
+#include <atomic>
+
+/*
+	Thread safe least recently used cache with a budget on the total cost of its entries
+	Values are copied in and out, so use shared pointers for anything large
+*/
+template<typename Key, typename Value>
+class CLruCache
+{
+private:
+	struct Entry
+	{
+		Key key;
+		Value value;
+		size_t cost;
+	};
+	typedef std::list<Entry> EntryList;
+
+	// Most recently used at the front
+	EntryList m_entries;
+	std::map<Key, typename EntryList::iterator> m_index;
+	size_t m_capacity;
+	size_t m_totalCost;
+
+	std::mutex m_mutex;
+	std::atomic<unsigned long long> m_hits;
+	std::atomic<unsigned long long> m_misses;
+public:
+	CLruCache( size_t capacity ) {
+		m_capacity = capacity;
+		m_totalCost = 0;
+		m_hits = 0;
+		m_misses = 0;
+	}
+
+	CLruCache( CLruCache const& ) = delete;
+	void operator=( CLruCache const& ) = delete;
+
+	/*
+		@method: get
+		@returns: if the key was in the cache
+		Copies the value out and marks it as the most recently used
+	*/
+	bool get( const Key &key, Value *pValue )
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		typename std::map<Key, typename EntryList::iterator>::iterator it = m_index.find( key );
+		if( it == m_index.end() ) {
+			m_misses++;
+			return false;
+		}
+		m_entries.splice( m_entries.begin(), m_entries, it->second );
+		(*pValue) = it->second->value;
+		m_hits++;
+		return true;
+	}
+	/*
+		@method: put
+		@returns: none
+		Adds or replaces the value for key, then drops the least recently used entries until the cache is back in budget
+		The new entry is always kept, even if it is over budget on its own
+	*/
+	void put( const Key &key, const Value &value, size_t cost )
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		typename std::map<Key, typename EntryList::iterator>::iterator it = m_index.find( key );
+		if( it != m_index.end() ) {
+			m_totalCost -= it->second->cost;
+			m_entries.erase( it->second );
+			m_index.erase( it );
+		}
+		Entry entry = { key, value, cost };
+		m_entries.push_front( entry );
+		m_index[key] = m_entries.begin();
+		m_totalCost += cost;
+
+		while( m_totalCost > m_capacity && m_entries.size() > 1 ) {
+			m_totalCost -= m_entries.back().cost;
+			m_index.erase( m_entries.back().key );
+			m_entries.pop_back();
+		}
+	}
+
+	unsigned long long getHits() const {
+		return m_hits;
+	}
+	unsigned long long getMisses() const {
+		return m_misses;
+	}
+	size_t getCount()
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		return m_entries.size();
+	}
+	size_t getTotalCost()
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		return m_totalCost;
+	}
+};
\ No newline at end of file
@@ -23,20 +23,59 @@
 */
 
 #include <iostream>
-#include <boost\endian\conversion.hpp>
+#include <algorithm>
 #include <boost\timer.hpp>
 #include "maploader.h"
 #include "nbt.h"
+#include "pool.h"
 #include "renderer.h"
 #include "blocks.h"
+#include "threadpool.h"
+#include "tilewriter.h"
+#include "hash.h"
+
+// Chunk tag paths, resolved once and reused for every chunk
+static const CTagPath XPosPath( "Level.xPos" );
+static const CTagPath ZPosPath( "Level.zPos" );
+static const CTagPath HeightMapPath( "Level.HeightMap" );
+static const CTagPath SectionsPath( "Level.Sections" );
+static const CTagPath SectionYPath( "Y" );
+static const CTagPath SectionBlocksPath( "Blocks" );
+
+static CBlockPool SectionPool( sizeof( ChunkSection ), SECTION_POOL_MAX_FREE );
+static CBlockPool ChunkDataPool( sizeof( ChunkData ), CHUNKDATA_POOL_MAX_FREE );
+
+void* ChunkSection::operator new( size_t size ) {
+	return SectionPool.allocate( size );
+}
+void ChunkSection::operator delete( void *pSection ) {
+	SectionPool.free( pSection );
+}
+ChunkData::~ChunkData()
+{
+	for( int section = 0; section < CHUNK_SECTION_COUNT; section++ ) {
+		if( SectionMask & (1 << section) )
+			delete pSections[section];
+	}
+}
+void* ChunkData::operator new( size_t size ) {
+	return ChunkDataPool.allocate( size );
+}
+void ChunkData::operator delete( void *pChunkData ) {
+	ChunkDataPool.free( pChunkData );
+}
 
 CMapLoader::CMapLoader()
 {
 	m_mapName = "";
+	m_regionsStarted = 0;
 	m_regionsRendered = 0;
 	m_regionCount = 0;
 	m_pRenderer = 0;
 	m_pBlockColors = 0;
+	m_chunkDataFlags = 0;
+	m_mainWorker.pRenderer = 0;
+	m_pThreadPool = 0;
 }
 CMapLoader::~CMapLoader()
 {
@@ -65,6 +104,7 @@ bool CMapLoader::load( boost::filesystem::path fullPath )
 	std::vector<boost::filesystem::path> regionFiles;
 
 	m_mapName = fullPath.string().substr( fullPath.string().find_last_of( "\\" )+1 );
+	m_tilePyramid.begin( boost::filesystem::current_path() / "maps" / m_mapName, &m_tileWriter );
 
 	levelDatPath = fullPath / "level.dat";
 	// First load level.dat
@@ -94,101 +134,441 @@ bool CMapLoader::load( boost::filesystem::path fullPath )
 bool CMapLoader::nextRegion()
 {
 	boost::filesystem::path currentPath;
-	boost::filesystem::ifstream inputStream;
-	RegionHeader regionHeader;
-	boost::timer renderTimer;
-	
+
 	_ASSERT_EXPR( m_regionPaths.size() > 0, L"region queue was empty" );
 	_ASSERT_EXPR( m_pRenderer, L"no renderer" );
 
 	// Get the current path
 	currentPath = m_regionPaths.front();
+	m_regionPaths.pop();
+
+	m_mainWorker.pRenderer = m_pRenderer;
+	return this->renderRegion( currentPath, m_mainWorker, 0 );
+}
+bool CMapLoader::renderRegions( unsigned int threadCount )
+{
+	CThreadPool threadPool;
+	std::atomic<bool> failed;
+
+	_ASSERT_EXPR( m_pRenderer, L"no renderer" );
+
+	// Files are written in the background while the next region is drawn
+	if( !m_tileWriter.start( TILEWRITER_THREAD_COUNT ) )
+		return false;
 
-	std::cout << " > Rendering region " << currentPath.stem() << " (" << m_regionsRendered+1 << "/" << m_regionCount << ")..." << std::endl;
+	// Nothing to gain from threads
+	if( threadCount <= 1 ) {
+		while( !m_regionPaths.empty() ) {
+			if( !this->nextRegion() ) {
+				m_tileWriter.flush();
+				return false;
+			}
+		}
+		return m_tileWriter.flush();
+	}
+
+	// Every worker gets its own renderer, so they each have their own region image
+	m_workers = std::vector<RegionWorker>( threadCount );
+	for( unsigned int i = 0; i < threadCount; i++ )
+		m_workers[i].pRenderer = m_pRenderer->clone();
+	if( !threadPool.start( threadCount ) ) {
+		for( unsigned int i = 0; i < threadCount; i++ )
+			delete m_workers[i].pRenderer;
+		m_workers.clear();
+		return false;
+	}
+	m_pThreadPool = &threadPool;
+
+	// Regions don't share anything, queue them all and let the workers take them as they are free
+	failed = false;
+	while( !m_regionPaths.empty() )
+	{
+		boost::filesystem::path regionPath = m_regionPaths.front();
+		m_regionPaths.pop();
+		threadPool.enqueue( [this, regionPath, &failed]( unsigned int workerIndex ) {
+			// Stop picking up regions once one has failed, same as the single threaded path
+			if( failed )
+				return;
+			if( !this->renderRegion( regionPath, m_workers[workerIndex], workerIndex ) )
+				failed = true;
+		} );
+	}
+	threadPool.wait();
+	threadPool.stop();
+	m_pThreadPool = 0;
+
+	for( unsigned int i = 0; i < threadCount; i++ )
+		delete m_workers[i].pRenderer;
+	m_workers.clear();
+
+	return m_tileWriter.flush() && !failed;
+}
+bool CMapLoader::renderRegionsPipelined( const PipelineSettings &settings )
+{
+	CRegionPipeline pipeline( *this, settings );
+	bool succeeded;
+
+	_ASSERT_EXPR( m_pRenderer, L"no renderer" );
+
+	if( !m_tileWriter.start( TILEWRITER_THREAD_COUNT ) )
+		return false;
+	succeeded = pipeline.run();
+	return m_tileWriter.flush() && succeeded;
+}
+bool CMapLoader::buildTilePyramid( unsigned int threadCount )
+{
+	_ASSERT_EXPR( m_pRenderer, L"no renderer" );
+
+	if( !m_tilePyramid.build( threadCount ) ) {
+		m_tileWriter.flush();
+		return false;
+	}
+	if( !m_tileWriter.flush() )
+		return false;
+	return m_tilePyramid.writeViewerInfo( m_pRenderer->getSettings().magnify ? ZOOM_LEVELS-1 : 0 );
+}
+bool CMapLoader::openArchive()
+{
+	if( !m_tileWriter.openArchive( boost::filesystem::current_path() / "maps" / m_mapName ) )
+		return false;
+	std::cout << "Packing tiles into " << ARCHIVE_FILE_NAME << std::endl;
+	return true;
+}
+bool CMapLoader::openRenderCache( bool ignorePrevious )
+{
+	boost::filesystem::path directory;
+	std::string settingsKey;
+
+	_ASSERT_EXPR( m_pRenderer, L"no renderer" );
+
+	settingsKey = this->getSettingsKey( m_tileWriter.isArchiving() );
+	directory = boost::filesystem::current_path() / "maps" / m_mapName / RENDERCACHE_DIRECTORY;
+	if( !m_renderCache.open( directory, settingsKey, ignorePrevious ) )
+		return false;
+	// Only used through the render cache, which knows which chunks are still in the map
+	m_chunkCache.open( directory, settingsKey, m_pRenderer->getChunkStateSize(), ignorePrevious );
+	return true;
+}
+std::string CMapLoader::getSettingsKey( bool archive ) const
+{
+	std::string settingsKey;
+	RenderSettings settings;
+
+	_ASSERT_EXPR( m_pRenderer, L"no renderer" );
+
+	settings = m_pRenderer->getSettings();
+	settingsKey = std::string( MCMAPPER_VERSION_STRING ) + " " + m_pRenderer->getName() + " " + CImageEncoder::GetFormatName( settings.format );
+	if( settings.format == IMAGE_FORMAT_PNG8 )
+		settingsKey += " level " + std::to_string( settings.compressionLevel );
+	if( settings.magnify )
+		settingsKey += " magnify";
+	// Unchanged regions only get loose tiles written if the last run wrote them too, an archive is rebuilt every run anyway
+	if( archive )
+		settingsKey += " archive";
+	// Cached pixels are only right for the colors they were drawn with
+	settingsKey += " colors " + std::to_string( HashBytes( m_pBlockColors->getPackedShadeTable( SHADE_NEUTRAL ), BLOCK_COLOR_COUNT*sizeof( boost::uint32_t ) ) );
+	return settingsKey;
+}
+bool CMapLoader::saveRenderCache()
+{
+	std::unordered_set<boost::uint64_t> liveHashes;
+	bool saved;
+
+	saved = m_renderCache.save();
+	m_renderCache.getCommittedHashes( &liveHashes );
+	if( !m_chunkCache.close( liveHashes ) )
+		saved = false;
+	return saved;
+}
+bool CMapLoader::closeArchive()
+{
+	bool flushed;
+
+	flushed = m_tileWriter.flush();
+	return m_tileWriter.closeArchive() && flushed;
+}
+void CMapLoader::addToPyramid( const boost::filesystem::path &regionPath, const CRenderer *pRenderer )
+{
+	int regionX, regionZ;
+
+	// The coordinates only come from the file name, anything else can't be placed
+	if( !CRegionFile::ParseName( regionPath.stem().string(), &regionX, &regionZ ) ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Region " << regionPath.stem() << " has no coordinates in its name, leaving it out of the zoomed out tiles" << std::endl;
+		return;
+	}
+	m_tilePyramid.addRegion( regionX, regionZ, pRenderer->getRegionImage() );
+}
+bool CMapLoader::renderRegion( boost::filesystem::path regionPath, RegionWorker &worker, unsigned int workerIndex )
+{
+	boost::timer renderTimer;
+	RegionUpdate update;
+	ChunkSet chunks;
+	ChunkHashes hashes;
+
+	{
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Rendering region " << regionPath.stem() << " (" << ++m_regionsStarted << "/" << m_regionCount << ")..." << std::endl;
+	}
 
 	// Attempt to open the region file
-	if( !boost::filesystem::is_regular_file( currentPath ) ) {
+	if( !worker.regionFile.open( regionPath ) ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
 		std::cout << " > Failed: could not open region file, skipping region" << std::endl;
 		return false;
 	}
-	inputStream.open( currentPath, std::ios::in | std::ios::binary );
+	worker.pRenderer->beginRegion( m_mapName, regionPath.stem().string() );
+	update = this->prepareRegion( regionPath, worker.regionFile, worker.pRenderer, &chunks, &hashes );
+	if( update != REGION_UPDATE_NONE && !this->drawChunks( worker, workerIndex, chunks, m_chunkCache.isEnabled() ? &hashes : 0 ) )
+		return false;
+	this->completeRegion( regionPath, worker.pRenderer, update, hashes );
+	worker.regionFile.close();
 
-	// Read the chunk locations
-	for( unsigned int i = 0; i < 1024; i++ )
+	// Show how long it took
+	m_regionsRendered++;
 	{
-		unsigned char offset[3];
-		inputStream.read( reinterpret_cast<char*>(&offset), 3 );
-		regionHeader.locations[i].offset = offset[2] + (offset[1] << 8) + (offset[0] << 16);
-		//regionHeader.locations[i].offset = boost::endian::big_to_native( regionHeader.locations[i].offset );
-		inputStream.read( reinterpret_cast<char*>(&(regionHeader.locations[i].sectorCount)), 1 );
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Finished region " << regionPath.stem() << " (" << CRenderCache::DescribeUpdate( update, chunks ) << "t=" << renderTimer.elapsed() << "s)" << std::endl;
 	}
-	// Read the chunk timestamps
-	for( unsigned int i = 0; i < 1024; i++ ){
-		inputStream.read( reinterpret_cast<char*>(&regionHeader.timestamps[i]), sizeof( boost::int32_t ) );
-		regionHeader.timestamps[i] = boost::endian::big_to_native( regionHeader.timestamps[i] );
+
+	return true;
+}
+bool CMapLoader::drawRegion( boost::filesystem::path regionPath, RegionWorker &worker, unsigned int workerIndex )
+{
+	ChunkSet chunks;
+
+	// Attempt to open the region file
+	if( !worker.regionFile.open( regionPath ) ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: could not open region file, skipping region" << std::endl;
+		return false;
 	}
 
 	// Load each chunk and render
-	m_pRenderer->beginRegion( m_mapName, currentPath.stem().string() );
-	for( unsigned int i = 0; i < 1024; i++ )
+	worker.pRenderer->beginRegion( m_mapName, regionPath.stem().string() );
+	chunks.set();
+	return this->drawChunks( worker, workerIndex, chunks, 0 );
+}
+bool CMapLoader::drawChunks( RegionWorker &worker, unsigned int workerIndex, const ChunkSet &chunks, const ChunkHashes *pHashes )
+{
+	std::atomic<bool> failed;
+
+	failed = false;
+	if( m_pThreadPool )
 	{
-		boost::int32_t chunkLength;
-		unsigned char compression;
-		char *pChunkData;
-		InputStream decompStream;
-		CNBTReader chunkReader;
-		ChunkData *pParsedChunk;
+		// Each chunk only touches its own tile of the region image, so rows of chunks can go to any idle worker
+		// Helpers decode with their own inflater and reader but draw with this region's renderer
+		m_pThreadPool->parallelFor( REGION_CHUNK_COUNT / 32, workerIndex, [this, &worker, &chunks, pHashes, &failed]( size_t row, unsigned int helperIndex ) {
+			if( !failed && !this->renderChunkRow( (unsigned int)row, chunks, pHashes, worker.regionFile, worker.pRenderer, m_workers[helperIndex] ) )
+				failed = true;
+		} );
+	}
+	else
+	{
+		for( unsigned int row = 0; row < REGION_CHUNK_COUNT / 32; row++ ) {
+			if( !this->renderChunkRow( row, chunks, pHashes, worker.regionFile, worker.pRenderer, worker ) ) {
+				failed = true;
+				break;
+			}
+		}
+	}
 
-		// Check if we have a chunk here
-		if( regionHeader.locations[i].sectorCount == 0 )
+	return !failed;
+}
+RegionUpdate CMapLoader::prepareRegion( const boost::filesystem::path &regionPath, const CRegionFile &regionFile, CRenderer *pRenderer, ChunkSet *pChunks, ChunkHashes *pHashes )
+{
+	std::string regionName = regionPath.stem().string();
+	RegionUpdate update;
+	ChunkSet changed;
+	ChunkHashes previous;
+	bool removed;
+
+	pChunks->reset();
+	pHashes->fill( 0 );
+	for( unsigned int i = 0; i < REGION_CHUNK_COUNT; i++ ) {
+		if( regionFile.hasChunk( i ) )
+			pChunks->set( i );
+	}
+	if( !m_renderCache.isEnabled() )
+		return REGION_UPDATE_FULL;
+
+	// Even an unchanged region needs its image for the zoomed out levels
+	// loadCache leaves the renderer as it was when it fails, so it can still draw everything
+	update = REGION_UPDATE_FULL;
+	removed = false;
+	previous.fill( 0 );
+	if( m_renderCache.findChanges( regionName, regionFile, &changed, &previous ) && pRenderer->loadCache( m_renderCache.getRegionPath( regionName ), m_pBlockColors ) )
+	{
+		update = REGION_UPDATE_PARTIAL;
+		// Chunks that are gone have to be cleared, the rest are drawn over their old tile
+		for( unsigned int i = 0; i < REGION_CHUNK_COUNT; i++ ) {
+			if( changed.test( i ) && !pChunks->test( i ) ) {
+				pRenderer->clearChunk( i % 32, i / 32 );
+				removed = true;
+			}
+		}
+	}
+	else
+		changed = *pChunks;
+
+	for( unsigned int i = 0; i < REGION_CHUNK_COUNT; i++ )
+	{
+		if( !pChunks->test( i ) )
 			continue;
-		// If we do, jump to it
-		inputStream.seekg( regionHeader.locations[i].offset * 4096, std::ios::beg );
-		// Read the length
-		inputStream.read( reinterpret_cast<char*>(&chunkLength), sizeof( boost::int32_t ) );
-		chunkLength = boost::endian::big_to_native( chunkLength );
-		// Read compression
-		inputStream.read( reinterpret_cast<char*>(&compression), 1 );
-		if( compression != 2 ) {
-			std::cout << " > Failed: Compressiong type was GZip, only ZLib is supported, skipping chunk" << std::endl;
+		if( !changed.test( i ) ) {
+			pChunks->reset( i );
+			(*pHashes)[i] = previous[i];
 			continue;
 		}
-		// Read the chunk data
-		if( chunkLength <= 0 ) {
-			std::cout << " > Failed: found empty chunk, skipping chunk" << std::endl;
+		if( !m_chunkCache.isEnabled() )
 			continue;
-		}
-		pChunkData = new char[chunkLength-1];
-		inputStream.read( pChunkData, chunkLength-1 );
-		// Setup decompression and run nbt reader
-		decompStream.push( boost::iostreams::zlib_decompressor() );
-		decompStream.push( boost::iostreams::array_source( pChunkData, chunkLength-1 ) );
-		if( !chunkReader.read( decompStream ) ) {
-			std::cout << " > Failed: could not read chunk data, skipping chunk" << std::endl;
+		// A chunk saved again without changing keeps what it drew last time
+		(*pHashes)[i] = this->hashChunk( i, regionFile );
+		if( update == REGION_UPDATE_PARTIAL && (*pHashes)[i] != 0 && (*pHashes)[i] == previous[i] )
+			pChunks->reset( i );
+	}
+
+	if( update == REGION_UPDATE_PARTIAL && pChunks->none() && !removed )
+		return REGION_UPDATE_NONE;
+	return update;
+}
+void CMapLoader::completeRegion( const boost::filesystem::path &regionPath, CRenderer *pRenderer, RegionUpdate update, const ChunkHashes &hashes )
+{
+	std::string regionName = regionPath.stem().string();
+
+	// Tiles of an unchanged region are already written, but the zoomed out levels still need its image
+	// Archives start empty every run, so they need every tile again
+	if( update == REGION_UPDATE_NONE && !m_tileWriter.isArchiving() )
+		pRenderer->composeRegion();
+	else if( !pRenderer->finishRegion() )
+		return;
+	this->addToPyramid( regionPath, pRenderer );
+
+	if( !m_renderCache.isEnabled() )
+		return;
+	if( update != REGION_UPDATE_NONE && !pRenderer->saveCache( m_renderCache.getRegionPath( regionName ) ) ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: could not cache region " << regionName << ", it will be drawn in full next time" << std::endl;
+		return;
+	}
+	m_renderCache.commit( regionName, hashes );
+}
+bool CMapLoader::renderChunkRow( unsigned int row, const ChunkSet &chunks, const ChunkHashes *pHashes, const CRegionFile &regionFile, CRenderer *pRenderer, RegionWorker &decoder )
+{
+	ChunkData *parsedChunks[32];
+	boost::uint64_t parsedHashes[32];
+	size_t parsedCount;
+	bool succeeded;
+
+	// Parse the whole row first, then draw it in one batch
+	parsedCount = 0;
+	succeeded = true;
+	for( unsigned int i = row*32; i < row*32+32; i++ )
+	{
+		boost::uint64_t hash;
+		ChunkData *pParsedChunk;
+
+		if( !chunks.test( i ) )
 			continue;
+		hash = pHashes ? (*pHashes)[i] : 0;
+		if( this->loadCachedChunk( hash, pRenderer ) )
+			continue;
+		if( !this->loadChunk( i, regionFile, decoder, &pParsedChunk ) ) {
+			succeeded = false;
+			break;
 		}
-		boost::iostreams::close( decompStream );
-		if( pChunkData ) {
-			delete[] pChunkData;
-			pChunkData = 0;
-		}
-
-		// Parse the data
-		pParsedChunk = this->parseChunkData( chunkReader );
 		if( !pParsedChunk )
-			return false;
-		m_pRenderer->renderChunk( pParsedChunk, m_pBlockColors );
-		delete pParsedChunk;
-		pParsedChunk = 0;
+			continue;
+		parsedHashes[parsedCount] = hash;
+		parsedChunks[parsedCount++] = pParsedChunk;
 	}
-	m_pRenderer->finishRegion();
+	if( succeeded )
+		pRenderer->renderChunks( parsedChunks, parsedCount, m_pBlockColors );
 
-	// Pop off the queue
-	m_regionPaths.pop();
+	for( size_t i = 0; i < parsedCount; i++ ) {
+		if( succeeded )
+			this->storeCachedChunk( parsedHashes[i], parsedChunks[i], pRenderer );
+		delete parsedChunks[i];
+	}
+	return succeeded;
+}
+boost::uint64_t CMapLoader::hashChunk( unsigned int index, const CRegionFile &regionFile ) const
+{
+	const char *pCompressedData;
+	size_t compressedLength;
+	unsigned char compression;
 
-	// Show how long it took
-	std::cout << " > Finished region (t=" << renderTimer.elapsed() << "s)" << std::endl;
-	m_regionsRendered++;
+	if( !regionFile.getChunk( index, &pCompressedData, &compressedLength, &compression ) )
+		return 0;
+	// The chunk's own coordinates are in the data, so the same bytes never turn up in two places
+	return HashBytes( pCompressedData, compressedLength, compression );
+}
+bool CMapLoader::loadCachedChunk( boost::uint64_t hash, CRenderer *pRenderer )
+{
+	std::vector<unsigned char> state;
+	unsigned int position;
+
+	if( hash == 0 )
+		return false;
+	state.resize( pRenderer->getChunkStateSize() );
+	if( !m_chunkCache.find( hash, &position, state.data() ) )
+		return false;
+	pRenderer->loadChunk( position % 32, position / 32, state.data(), m_pBlockColors );
+	return true;
+}
+void CMapLoader::storeCachedChunk( boost::uint64_t hash, const ChunkData *pChunkData, const CRenderer *pRenderer )
+{
+	std::vector<unsigned char> state;
+	int x, z;
+
+	if( hash == 0 )
+		return;
+	// Wherever the chunk drew itself, which is where its own coordinates put it
+	x = pChunkData->xPos & 31;
+	z = pChunkData->zPos & 31;
+	state.resize( pRenderer->getChunkStateSize() );
+	pRenderer->saveChunk( x, z, state.data() );
+	m_chunkCache.store( hash, x + z*32, state.data() );
+}
+bool CMapLoader::loadChunk( unsigned int index, const CRegionFile &regionFile, RegionWorker &decoder, ChunkData **ppChunkData )
+{
+	const char *pCompressedData;
+	size_t compressedLength;
+	unsigned char compression;
+
+	(*ppChunkData) = 0;
+
+	// Check if we have a chunk here
+	if( !regionFile.hasChunk( index ) )
+		return true;
+	// If we do, get a pointer to its data
+	if( !regionFile.getChunk( index, &pCompressedData, &compressedLength, &compression ) ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Skipping chunk" << std::endl;
+		return true;
+	}
+	if( compression != COMPRESSION_GZIP && compression != COMPRESSION_ZLIB ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: unknown compression type, skipping chunk" << std::endl;
+		return true;
+	}
+	// Decompress the whole chunk into the inflater's buffer, then run the nbt reader over it
+	if( !decoder.inflater.inflate( pCompressedData, compressedLength, compression ) ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Skipping chunk" << std::endl;
+		return true;
+	}
+	decoder.chunkReader.deleteTags();
+	if( decoder.inflater.getLength() == 0 || !decoder.chunkReader.read( decoder.inflater.getData(), decoder.inflater.getLength(), &m_chunkProjection ) ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: could not read chunk data, skipping chunk" << std::endl;
+		return true;
+	}
+
+	// Parse the data
+	(*ppChunkData) = this->parseChunkData( decoder.chunkReader );
+	if( !(*ppChunkData) )
+		return false;
 
 	return true;
 }
@@ -200,14 +580,18 @@ ChunkData* CMapLoader::parseChunkData( CNBTReader &nbtReader )
 	CTagInt *pXpos, *pZpos;
 	CTagIntArray *pHeightMap;
 	CTagList *pSections;
-	TagList sectionTags;
+	const boost::int32_t *pHeights;
+	unsigned short topBlocks[CHUNK_LENGTH*CHUNK_LENGTH];
 	int section;
+	unsigned int flags;
 
 	if( nbtReader.getRootTags().size() < 1 ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
 		std::cout << " > Failed: Could not parse empty chunk, skipping chunk" << std::endl;
 		return 0;
 	}
 	else if( nbtReader.getRootTags()[0]->getId() != TAGID_COMPOUND ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
 		std::cout << " > Failed: Could not find root tag, skipping chunk" << std::endl;
 		return 0;
 	}
@@ -215,11 +599,11 @@ ChunkData* CMapLoader::parseChunkData( CNBTReader &nbtReader )
 	pRootTag = reinterpret_cast<CTagCompound*>(nbtReader.getRootTags()[0]);
 
 	// Save the position
-	pXpos = reinterpret_cast<CTagInt*>(pRootTag->getChildPath( "Level.xPos", TAGID_INT ));
-	pZpos = reinterpret_cast<CTagInt*>(pRootTag->getChildPath( "Level.zPos", TAGID_INT ));
-	pHeightMap = reinterpret_cast<CTagIntArray*>(pRootTag->getChildPath( "Level.HeightMap", TAGID_INT_ARRAY ));
-	pSections = reinterpret_cast<CTagList*>(pRootTag->getChildPath( "Level.Sections", TAGID_LIST ));
-	if( !pXpos || !pZpos || !pHeightMap || !pSections ) {
+	flags = m_chunkDataFlags;
+	pXpos = reinterpret_cast<CTagInt*>(pRootTag->getChildPath( XPosPath, TAGID_INT ));
+	pZpos = reinterpret_cast<CTagInt*>(pRootTag->getChildPath( ZPosPath, TAGID_INT ));
+	if( !pXpos || !pZpos ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
 		std::cout << " > Failed: invalid chunk data" << std::endl;
 		return 0;
 	}
@@ -227,44 +611,90 @@ ChunkData* CMapLoader::parseChunkData( CNBTReader &nbtReader )
 	pChunkData = new ChunkData();
 	pChunkData->xPos = pXpos->getPayload();
 	pChunkData->zPos = pZpos->getPayload();
+	pChunkData->flags = flags;
+
+	// Save the height map, the surface is found from it too
+	if( flags & (CHUNKDATA_HEIGHTMAP | CHUNKDATA_SURFACE) ) {
+		pHeightMap = reinterpret_cast<CTagIntArray*>(pRootTag->getChildPath( HeightMapPath, TAGID_INT_ARRAY ));
+		if( !pHeightMap ) {
+			std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+			std::cout << " > Failed: invalid chunk data" << std::endl;
+			delete pChunkData;
+			return 0;
+		}
+		if( pHeightMap->getSize() != CHUNK_LENGTH*CHUNK_LENGTH ) {
+			std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+			std::cout << " > Failed: invalid height map dimensions, skipping chunk" << std::endl;
+			delete pChunkData;
+			return 0;
+		}
+		pHeights = pHeightMap->getData();
+		if( flags & CHUNKDATA_HEIGHTMAP )
+			memcpy( &pChunkData->HeightMap[0], pHeights, sizeof( boost::int32_t )*256 );
+		if( flags & CHUNKDATA_SURFACE ) {
+			// The top block is the one below the height, kept inside the sections
+			for( int i = 0; i < CHUNK_LENGTH*CHUNK_LENGTH; i++ ) {
+				topBlocks[i] = (unsigned short)std::min( std::max( pHeights[i] - 1, 0 ), 255 );
+				pChunkData->Surface.Heights[i] = (boost::int16_t)std::min( std::max( pHeights[i], -32767 ), 32767 );
+			}
+		}
+	}
 
-	// Save the height map
-	if( pHeightMap->getPayload().size() != CHUNK_LENGTH*CHUNK_LENGTH ) {
-		std::cout << " > Failed: invalid height map dimensions, skipping chunk" << std::endl;
+	// Save the block sections
+	if( !(flags & (CHUNKDATA_BLOCKIDS | CHUNKDATA_SURFACE)) )
+		return pChunkData;
+	pSections = reinterpret_cast<CTagList*>(pRootTag->getChildPath( SectionsPath, TAGID_LIST ));
+	if( !pSections ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: invalid chunk data" << std::endl;
 		delete pChunkData;
 		return 0;
 	}
-	memcpy( &pChunkData->HeightMap[0], &pHeightMap->getPayload()[0], sizeof( boost::int32_t )*256 );
-
-	// Save the block sections
-	sectionTags = pSections->getChildren();
-	section = 0;
-	for( auto it = sectionTags.begin(); it != sectionTags.end(); it++ )
+	for( CTag *pSection = pSections->getFirstChild(); pSection; pSection = pSection->getNextSibling() )
 	{
-		ChunkSection sectionData;
-		CTagList *pCurrentSection;
+		CTagCompound *pCurrentSection;
+		const boost::uint8_t *pBlocks;
 		CTagByte *pY;
 		CTagByteArray *pBlockIds;
 
-		if( (*it)->getId() != TAGID_COMPOUND ) {
+		if( pSection->getId() != TAGID_COMPOUND ) {
+			std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
 			std::cout << " > Failed: invalid section tag, skipping chunk" << std::endl;
 			delete pChunkData;
 			return 0;
 		}
-		pCurrentSection = reinterpret_cast<CTagList*>((*it));
-		pY = reinterpret_cast<CTagByte*>(pCurrentSection->getChildName( "Y" ));
-		pBlockIds = reinterpret_cast<CTagByteArray*>(pCurrentSection->getChildName( "Blocks" ));
-		if( !pY || !pBlockIds ) {
+		pCurrentSection = reinterpret_cast<CTagCompound*>(pSection);
+		pY = reinterpret_cast<CTagByte*>(pCurrentSection->getChildPath( SectionYPath, TAGID_BYTE ));
+		pBlockIds = reinterpret_cast<CTagByteArray*>(pCurrentSection->getChildPath( SectionBlocksPath, TAGID_BYTE_ARRAY ));
+		if( !pY || !pBlockIds || pBlockIds->getSize() != 4096 ) {
+			std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
 			std::cout << " > Failed: invalid section tag, skipping chunk" << std::endl;
 			delete pChunkData;
 			return 0;
 		}
-		// Copy the data
-		sectionData.Y = pY->getPayload();
-		memcpy( &sectionData.BlockIds[0], &pBlockIds->getPayload()[0], 4096 );
+		pBlocks = reinterpret_cast<const boost::uint8_t*>(pBlockIds->getData());
+
+		// Sections are placed by their Y, the list leaves out empty ones so its order can't be trusted
+		section = pY->getPayload();
+		if( section < 0 || section >= CHUNK_SECTION_COUNT )
+			continue;
 
-		pChunkData->Sections[section] = sectionData;
-		section++;
+		// Only keep the top block of each column that ends in this section
+		if( flags & CHUNKDATA_SURFACE ) {
+			for( int i = 0; i < CHUNK_LENGTH*CHUNK_LENGTH; i++ ) {
+				if( (topBlocks[i] >> 4) == section )
+					pChunkData->Surface.BlockIds[i] = pBlocks[(topBlocks[i] & 15)*CHUNK_LENGTH*CHUNK_LENGTH + i];
+			}
+		}
+		// Copy the data
+		if( flags & CHUNKDATA_BLOCKIDS ) {
+			if( !pChunkData->pSections[section] ) {
+				pChunkData->pSections[section] = new ChunkSection;
+				pChunkData->SectionMask |= (boost::uint16_t)(1 << section);
+			}
+			pChunkData->pSections[section]->Y = (boost::int8_t)section;
+			memcpy( &pChunkData->pSections[section]->BlockIds[0], pBlocks, 4096 );
+		}
 	}
 
 	return pChunkData;
@@ -273,9 +703,63 @@ ChunkData* CMapLoader::parseChunkData( CNBTReader &nbtReader )
 size_t CMapLoader::getRegionCount() const {
 	return m_regionCount;
 }
+const std::string& CMapLoader::getMapName() const {
+	return m_mapName;
+}
+const CTileWriter& CMapLoader::getTileWriter() const {
+	return m_tileWriter;
+}
+const CChunkCache& CMapLoader::getChunkCache() const {
+	return m_chunkCache;
+}
+
+std::vector<boost::filesystem::path> CMapLoader::getRegionPaths() const
+{
+	std::vector<boost::filesystem::path> regionPaths;
+	std::queue<boost::filesystem::path> remaining = m_regionPaths;
+
+	while( !remaining.empty() ) {
+		regionPaths.push_back( remaining.front() );
+		remaining.pop();
+	}
+	return regionPaths;
+}
+
+void CMapLoader::setRenderer( CRenderer *pRenderer )
+{
+	RenderSettings settings;
 
-void CMapLoader::setRenderer( CRenderer *pRenderer ) {
 	m_pRenderer = pRenderer;
+
+	// Only read the parts of a chunk the renderer will use
+	m_chunkProjection.clear();
+	m_chunkDataFlags = 0;
+	if( !m_pRenderer )
+		return;
+	// Everything it draws goes through the loader's writer, set before any clones are made
+	settings = m_pRenderer->getSettings();
+	settings.pTileWriter = &m_tileWriter;
+	m_pRenderer->setSettings( settings );
+	// Zoomed out tiles are written the same way as the regions
+	m_tilePyramid.setFormat( settings.format, settings.compressionLevel );
+
+	this->addChunkDataFlags( m_pRenderer->getChunkDataFlags() );
+}
+void CMapLoader::addChunkDataFlags( unsigned int flags )
+{
+	m_chunkDataFlags |= flags;
+	m_chunkProjection.clear();
+	m_chunkProjection.addPath( "Level.xPos" );
+	m_chunkProjection.addPath( "Level.zPos" );
+	if( m_chunkDataFlags & (CHUNKDATA_HEIGHTMAP | CHUNKDATA_SURFACE) )
+		m_chunkProjection.addPath( "Level.HeightMap" );
+	if( m_chunkDataFlags & (CHUNKDATA_BLOCKIDS | CHUNKDATA_SURFACE) ) {
+		m_chunkProjection.addPath( "Level.Sections.Y" );
+		m_chunkProjection.addPath( "Level.Sections.Blocks" );
+	}
+}
+CBlockColors* CMapLoader::getBlockColors() const {
+	return m_pBlockColors;
 }
 CRenderer* CMapLoader::getRenderer() const {
 	return m_pRenderer;
@@ -26,58 +26,159 @@
 
 #include <boost\filesystem.hpp>
 #include <queue>
+#include <vector>
+#include <atomic>
+#include <mutex>
 #include "nbt.h"
+#include "inflate.h"
+#include "region.h"
+#include "pipeline.h"
+#include "pyramid.h"
+#include "tilewriter.h"
+#include "rendercache.h"
+#include "chunkcache.h"
 
 #define CHUNK_LENGTH 16
 #define SECTION_HEIGHT 16
+#define CHUNK_SECTION_COUNT 16
+// Freed sections and chunks kept for reuse, 16MB and 2MB worth
+#define SECTION_POOL_MAX_FREE 4096
+#define CHUNKDATA_POOL_MAX_FREE 1024
 
 enum : unsigned int
 {
 	CHUNKDATA_NONE			= 1 << 0,
 	CHUNKDATA_HEIGHTMAP		= 1 << 1,
-	CHUNKDATA_BLOCKIDS		= 1 << 2
+	CHUNKDATA_BLOCKIDS		= 1 << 2,
+	// Only the top block of each column, found while parsing so the sections needn't be kept
+	CHUNKDATA_SURFACE		= 1 << 3
 };
 
-#pragma pack(push, 1)
-struct ChunkLocation
-{
-	boost::int32_t offset;
-	unsigned char sectorCount;
-};
-struct RegionHeader
-{
-	ChunkLocation locations[1024];
-	boost::int32_t timestamps[1024];
-};
-#pragma pack(pop)
-
+// Allocated from a pool, a chunk is parsed and freed for every one drawn
 struct ChunkSection
 {
 	boost::int8_t Y;
 	boost::int8_t BlockIds[4096];
+
+	static void* operator new( size_t size );
+	static void operator delete( void *pSection );
+};
+// 768 bytes instead of the 64KB of sections
+struct ChunkSurface
+{
+	// Height map values clamped to 16 bits
+	boost::int16_t Heights[CHUNK_LENGTH*CHUNK_LENGTH];
+	// The block below each height, 0 where its section is missing
+	boost::uint8_t BlockIds[CHUNK_LENGTH*CHUNK_LENGTH];
 };
+/*
+	The parts of a chunk a renderer asked for, flags says which were read
+	With CHUNKDATA_BLOCKIDS pSections is indexed by section Y, only the sections the chunk has are set
+	and SectionMask has their bits set, so empty ones can be skipped without looking at them
+	new and delete go through a pool like the sections
+*/
 struct ChunkData
 {
 	boost::int32_t xPos, zPos;
+	unsigned int flags;
+	ChunkSurface Surface;
 	boost::int32_t HeightMap[CHUNK_LENGTH*CHUNK_LENGTH];
-	ChunkSection Sections[16];
+	boost::uint16_t SectionMask;
+	ChunkSection *pSections[CHUNK_SECTION_COUNT];
+
+	ChunkData() = default;
+	~ChunkData();
+
+	ChunkData( ChunkData const& ) = delete;
+	void operator=( ChunkData const& ) = delete;
+
+	static void* operator new( size_t size );
+	static void operator delete( void *pChunkData );
 };
 
+/*
+	@function: GetSectionBlock
+	@returns: The id of the block at x, y, z in a chunk read with CHUNKDATA_BLOCKIDS, 0 if its section is missing
+*/
+inline unsigned char GetSectionBlock( const ChunkData *pChunkData, int x, int y, int z ) {
+	const ChunkSection *pSection = pChunkData->pSections[y >> 4];
+	return pSection ? (unsigned char)pSection->BlockIds[x + z*CHUNK_LENGTH + (y & 15)*CHUNK_LENGTH*CHUNK_LENGTH] : 0;
+}
+
 class CRenderer;
 class CBlockColors;
+class CThreadPool;
+
+/*
+	Everything needed to render a region on its own, one for each thread
+*/
+struct RegionWorker
+{
+	CRenderer *pRenderer;
+	CRegionFile regionFile;
+	CInflater inflater;
+	CNBTReader chunkReader;
+};
 
 class CMapLoader
 {
+	friend class CRegionPipeline;
 private:
 	std::string m_mapName;
 
 	std::queue<boost::filesystem::path> m_regionPaths;
+	std::mutex m_regionQueueMutex;
 	unsigned int m_regionCount;
-	unsigned int m_regionsRendered;
+	std::atomic<unsigned int> m_regionsStarted;
+	std::atomic<unsigned int> m_regionsRendered;
 
 	CRenderer *m_pRenderer;
 	CBlockColors *m_pBlockColors;
+	unsigned int m_chunkDataFlags;
+	CNBTProjection m_chunkProjection;
+	RegionWorker m_mainWorker;
+	std::vector<RegionWorker> m_workers;
+	CThreadPool *m_pThreadPool;
+	CTileWriter m_tileWriter;
+	CTilePyramid m_tilePyramid;
+	CRenderCache m_renderCache;
+	CChunkCache m_chunkCache;
 
+	void addToPyramid( const boost::filesystem::path &regionPath, const CRenderer *pRenderer );
+	/*
+		@method: prepareRegion
+		@returns: how much of the region has changed since it was cached
+		Call after beginRegion, loads the cached state of the region into the renderer if it can be used
+		pChunks is set to the chunks that need to be drawn and pHashes to the hash of every chunk, if the chunk cache is open
+	*/
+	RegionUpdate prepareRegion( const boost::filesystem::path &regionPath, const CRegionFile &regionFile, CRenderer *pRenderer, ChunkSet *pChunks, ChunkHashes *pHashes );
+	/*
+		@method: completeRegion
+		@returns: none
+		Writes the region's tiles if they changed, adds it to the pyramid and caches it for next time
+	*/
+	void completeRegion( const boost::filesystem::path &regionPath, CRenderer *pRenderer, RegionUpdate update, const ChunkHashes &hashes );
+	// pHashes may be null, then nothing is taken from or added to the chunk cache
+	bool drawChunks( RegionWorker &worker, unsigned int workerIndex, const ChunkSet &chunks, const ChunkHashes *pHashes );
+	bool renderRegion( boost::filesystem::path regionPath, RegionWorker &worker, unsigned int workerIndex );
+	// Draws the chunks of row (32 chunks along x) that are in chunks, pHashes as in drawChunks
+	bool renderChunkRow( unsigned int row, const ChunkSet &chunks, const ChunkHashes *pHashes, const CRegionFile &regionFile, CRenderer *pRenderer, RegionWorker &decoder );
+	/*
+		@method: hashChunk
+		@returns: the hash the chunk at index is cached under, 0 if it can't be read
+	*/
+	boost::uint64_t hashChunk( unsigned int index, const CRegionFile &regionFile ) const;
+	/*
+		@method: loadCachedChunk
+		@returns: if the chunk was in the chunk cache and was put back into the renderer, it needn't be decoded then
+	*/
+	bool loadCachedChunk( boost::uint64_t hash, CRenderer *pRenderer );
+	/*
+		@method: storeCachedChunk
+		@returns: none
+		Adds a chunk that was just drawn to the chunk cache
+	*/
+	void storeCachedChunk( boost::uint64_t hash, const ChunkData *pChunkData, const CRenderer *pRenderer );
 	ChunkData* parseChunkData( CNBTReader &nbtReader );
 public:
 	CMapLoader();
@@ -103,8 +204,91 @@ public:
 		Loads the next region into memory
 	*/
 	bool nextRegion();
+	/*
+		@method: renderRegions
+		@returns: if every remaining region was rendered successfully
+		Renders the remaining regions on threadCount threads, each with its own clone of the renderer
+		Threads that run out of regions help render the chunks of the ones still going
+	*/
+	bool renderRegions( unsigned int threadCount );
+	/*
+		@method: renderRegionsPipelined
+		@returns: if every remaining region was rendered successfully
+		Renders the remaining regions with a CRegionPipeline, reading, decoding and writing images in separate stages
+	*/
+	bool renderRegionsPipelined( const PipelineSettings &settings );
+	/*
+		@method: buildTilePyramid
+		@returns: if all the zoomed out tiles were written
+		Builds the zoomed out levels from every region rendered since load, call once rendering is done
+	*/
+	bool buildTilePyramid( unsigned int threadCount );
+	/*
+		@method: openArchive
+		@returns: if the archive was created
+		Packs every tile written from now on into maps/[map]/tiles.pack, call after load
+	*/
+	bool openArchive();
+	/*
+		@method: closeArchive
+		@returns: if every tile was written and the archive index was saved
+	*/
+	bool closeArchive();
+	/*
+		@method: openRenderCache
+		@returns: if the cache can be used
+		Call after setRenderer, regions rendered before with the same settings are only drawn where their chunks changed
+		If ignorePrevious is set everything is drawn, but the cache is still saved for next time
+	*/
+	bool openRenderCache( bool ignorePrevious );
+	/*
+		@method: getSettingsKey
+		@returns: what the render cache is keyed on for the renderer's settings, tiles going to an archive or not
+		Anything that changes how tiles look or where they go is in it
+	*/
+	std::string getSettingsKey( bool archive ) const;
+	/*
+		@method: saveRenderCache
+		@returns: if the manifest and chunk cache were written
+		Call once every region is rendered
+	*/
+	bool saveRenderCache();
 
+	/*
+		@method: setRenderer
+		@returns: none
+		Sets the renderer, only the chunk data it asks for in getChunkDataFlags is read from now on
+	*/
 	void setRenderer( CRenderer *pRenderer );
+	/*
+		@method: addChunkDataFlags
+		@returns: none
+		Reads more of each chunk than the renderer asks for, call after setRenderer
+	*/
+	void addChunkDataFlags( unsigned int flags );
 	CRenderer* getRenderer() const;
+	CBlockColors* getBlockColors() const;
+
+	/*
+		@method: loadChunk
+		@returns: false if the chunk data was invalid and rendering should stop
+		Decompresses and parses a chunk using the decoder's buffers, ppChunkData is left null if the chunk was skipped
+	*/
+	bool loadChunk( unsigned int index, const CRegionFile &regionFile, RegionWorker &decoder, ChunkData **ppChunkData );
+	/*
+		@method: drawRegion
+		@returns: if every chunk was drawn
+		Opens a region and draws all its chunks with the worker's renderer without writing anything
+		The renderer still needs composeRegion or finishRegion called before its image is complete
+	*/
+	bool drawRegion( boost::filesystem::path regionPath, RegionWorker &worker, unsigned int workerIndex );
 	size_t getRegionCount() const;
+	const std::string& getMapName() const;
+	const CTileWriter& getTileWriter() const;
+	const CChunkCache& getChunkCache() const;
+	/*
+		@method: getRegionPaths
+		@returns: the regions still waiting to be rendered
+	*/
+	std::vector<boost::filesystem::path> getRegionPaths() const;
 };
@@ -26,35 +26,536 @@
 #include <boost\endian\conversion.hpp>
 #include <boost\algorithm\string.hpp>
 #include "nbt.h"
+#include "simd.h"
 
-CTag* CNBTReader::createTag( boost::int8_t tagId )
+// Reads a big endian value from an unaligned position in a buffer
+template<typename T>
+static T ReadBig( const char *pData )
+{
+	T value;
+	memcpy( &value, pData, sizeof( T ) );
+	return boost::endian::big_to_native( value );
+}
+
+////////////////////
+// CNBTProjection //
+////////////////////
+
+CNBTProjection::CNBTProjection() {
+	this->clear();
+}
+CNBTProjection::~CNBTProjection() {
+}
+
+void CNBTProjection::addPath( std::string path )
+{
+	std::vector<std::string> tokens;
+	size_t node;
+
+	// Walk down the tree adding any nodes that are missing
+	boost::split( tokens, path, boost::is_any_of( "." ) );
+	node = NBTPROJECTION_ROOT;
+	for( auto it = tokens.begin(); it != tokens.end(); it++ )
+	{
+		size_t next;
+
+		next = NBTPROJECTION_SKIP;
+		for( auto child = m_nodes[node].children.begin(); child != m_nodes[node].children.end(); child++ ) {
+			if( m_nodes[(*child)].name.compare( (*it) ) == 0 ) {
+				next = (*child);
+				break;
+			}
+		}
+		if( next == NBTPROJECTION_SKIP ) {
+			Node newNode;
+			newNode.name = (*it);
+			newNode.whole = false;
+			next = m_nodes.size();
+			m_nodes.push_back( newNode );
+			m_nodes[node].children.push_back( next );
+		}
+		node = next;
+	}
+	m_nodes[node].whole = true;
+}
+void CNBTProjection::clear()
+{
+	Node root;
+
+	root.whole = false;
+	m_nodes.clear();
+	m_nodes.push_back( root );
+}
+
+size_t CNBTProjection::getChild( size_t node, boost::string_ref name ) const
+{
+	// Everything below a wanted path is wanted
+	if( m_nodes[node].whole )
+		return node;
+	for( auto it = m_nodes[node].children.begin(); it != m_nodes[node].children.end(); it++ ) {
+		if( name == m_nodes[(*it)].name )
+			return (*it);
+	}
+	return NBTPROJECTION_SKIP;
+}
+
+//////////////////////
+// CNBTBufferReader //
+//////////////////////
+
+boost::string_ref CNBTBufferReader::GetName( const NBTView &view ) {
+	return boost::string_ref( view.pName, view.nameLength );
+}
+boost::int8_t CNBTBufferReader::GetByte( const NBTView &view ) {
+	return static_cast<boost::int8_t>(view.pPayload[0]);
+}
+boost::int16_t CNBTBufferReader::GetShort( const NBTView &view ) {
+	return ReadBig<boost::int16_t>( view.pPayload );
+}
+boost::int32_t CNBTBufferReader::GetInt( const NBTView &view ) {
+	return ReadBig<boost::int32_t>( view.pPayload );
+}
+boost::int64_t CNBTBufferReader::GetLong( const NBTView &view ) {
+	return ReadBig<boost::int64_t>( view.pPayload );
+}
+float CNBTBufferReader::GetFloat( const NBTView &view )
+{
+	boost::int32_t bits;
+	float value;
+
+	bits = ReadBig<boost::int32_t>( view.pPayload );
+	memcpy( &value, &bits, sizeof( float ) );
+	return value;
+}
+double CNBTBufferReader::GetDouble( const NBTView &view )
+{
+	boost::int64_t bits;
+	double value;
+
+	bits = ReadBig<boost::int64_t>( view.pPayload );
+	memcpy( &value, &bits, sizeof( double ) );
+	return value;
+}
+boost::string_ref CNBTBufferReader::GetString( const NBTView &view ) {
+	return boost::string_ref( view.pPayload, view.payloadLength );
+}
+void CNBTBufferReader::CopyByteArray( const NBTView &view, boost::int8_t *pBytes )
+{
+	if( view.count > 0 )
+		memcpy( pBytes, view.pPayload, view.count );
+}
+void CNBTBufferReader::CopyIntArray( const NBTView &view, boost::int32_t *pInts )
+{
+	if( view.count > 0 ) {
+		memcpy( pInts, view.pPayload, view.count*sizeof( boost::int32_t ) );
+		BigToNativeInt32Array( pInts, view.count );
+	}
+}
+
+CNBTBufferReader::CNBTBufferReader() {
+	m_pBegin = 0;
+	m_pEnd = 0;
+	m_lastRoot = NBTVIEW_NONE;
+}
+CNBTBufferReader::~CNBTBufferReader() {
+}
+
+bool CNBTBufferReader::readName( const char **ppCursor, const char **ppName, boost::uint16_t *pNameLength )
+{
+	if( m_pEnd - (*ppCursor) < 2 )
+		return false;
+	(*pNameLength) = ReadBig<boost::uint16_t>( (*ppCursor) );
+	(*ppCursor) += 2;
+	if( (size_t)(m_pEnd - (*ppCursor)) < (*pNameLength) )
+		return false;
+	(*ppName) = (*ppCursor);
+	(*ppCursor) += (*pNameLength);
+	return true;
+}
+
+bool CNBTBufferReader::visitTag( const char **ppCursor, boost::int8_t tagId, const char *pName, boost::uint16_t nameLength, unsigned int depth, size_t node, CNBTVisitor &visitor, const CNBTProjection *pProjection )
+{
+	const char *pCursor;
+	NBTView view;
+	boost::int32_t length;
+	size_t elementSize;
+
+	pCursor = (*ppCursor);
+	if( depth > NBT_MAX_DEPTH ) {
+		std::cout << "Failed: tags are nested too deeply" << std::endl;
+		return false;
+	}
+
+	view.tagId = tagId;
+	view.pName = pName;
+	view.nameLength = nameLength;
+	view.pPayload = pCursor;
+	view.payloadLength = 0;
+	view.count = 0;
+	view.childrenId = TAGID_END;
+	view.firstChild = NBTVIEW_NONE;
+	view.nextSibling = NBTVIEW_NONE;
+
+	elementSize = 0;
+	switch( tagId )
+	{
+	case TAGID_BYTE:
+		elementSize = sizeof( boost::int8_t );
+		break;
+	case TAGID_SHORT:
+		elementSize = sizeof( boost::int16_t );
+		break;
+	case TAGID_INT:
+	case TAGID_FLOAT:
+		elementSize = sizeof( boost::int32_t );
+		break;
+	case TAGID_LONG:
+	case TAGID_DOUBLE:
+		elementSize = sizeof( boost::int64_t );
+		break;
+	case TAGID_BYTE_ARRAY:
+	case TAGID_INT_ARRAY:
+		// Read the element count, the payload follows it
+		if( m_pEnd - pCursor < 4 )
+			goto truncated;
+		length = ReadBig<boost::int32_t>( pCursor );
+		pCursor += 4;
+		if( length < 0 )
+			length = 0;
+		view.count = length;
+		elementSize = (size_t)length * (tagId == TAGID_BYTE_ARRAY ? sizeof( boost::int8_t ) : sizeof( boost::int32_t ));
+		break;
+	case TAGID_STRING:
+		if( m_pEnd - pCursor < 2 )
+			goto truncated;
+		elementSize = ReadBig<boost::uint16_t>( pCursor );
+		pCursor += 2;
+		view.count = (boost::int32_t)elementSize;
+		break;
+	case TAGID_LIST:
+		// Read the type of the entries and how many there are
+		if( m_pEnd - pCursor < 5 )
+			goto truncated;
+		view.childrenId = pCursor[0];
+		length = ReadBig<boost::int32_t>( pCursor+1 );
+		pCursor += 5;
+		// End tags have no payload, a list of them is empty whatever its count says, the same as skipPayload
+		if( length < 0 || view.childrenId == TAGID_END )
+			length = 0;
+		view.pPayload = pCursor;
+		view.count = length;
+		if( !visitor.beginTag( view ) )
+			return false;
+		// Entries are unnamed tags of the same type, they share the list's place in the projection
+		for( boost::int32_t i = 0; i < length; i++ ) {
+			if( !this->visitTag( &pCursor, view.childrenId, 0, 0, depth+1, node, visitor, pProjection ) )
+				return false;
+		}
+		view.payloadLength = pCursor - view.pPayload;
+		(*ppCursor) = pCursor;
+		return visitor.endTag( view );
+	case TAGID_COMPOUND:
+		if( !visitor.beginTag( view ) )
+			return false;
+		// Read full tags until the end tag
+		for( ;; ) {
+			boost::int8_t childId;
+			const char *pChildName;
+			boost::uint16_t childNameLength;
+			size_t childNode;
+
+			if( pCursor >= m_pEnd )
+				goto truncated;
+			childId = *pCursor++;
+			if( childId == TAGID_END )
+				break;
+			if( !this->readName( &pCursor, &pChildName, &childNameLength ) )
+				goto truncated;
+			// Skip anything the projection doesn't want
+			childNode = node;
+			if( pProjection ) {
+				childNode = pProjection->getChild( node, boost::string_ref( pChildName, childNameLength ) );
+				if( childNode == NBTPROJECTION_SKIP ) {
+					if( !this->skipPayload( &pCursor, childId, depth+1 ) )
+						return false;
+					continue;
+				}
+			}
+			if( !this->visitTag( &pCursor, childId, pChildName, childNameLength, depth+1, childNode, visitor, pProjection ) )
+				return false;
+			view.count++;
+		}
+		view.payloadLength = pCursor - view.pPayload;
+		(*ppCursor) = pCursor;
+		return visitor.endTag( view );
+	default:
+		std::cout << "Failed: Unknown tag id " << (int)tagId << std::endl;
+		return false;
+	}
+
+	// Fixed size payloads and arrays
+	if( (size_t)(m_pEnd - pCursor) < elementSize )
+		goto truncated;
+	view.pPayload = pCursor;
+	view.payloadLength = elementSize;
+	(*ppCursor) = pCursor + elementSize;
+	return visitor.beginTag( view );
+
+truncated:
+	std::cout << "Failed: NBT data ended unexpectedly" << std::endl;
+	return false;
+}
+bool CNBTBufferReader::skipPayload( const char **ppCursor, boost::int8_t tagId, unsigned int depth )
+{
+	const char *pCursor;
+	boost::int32_t length;
+	boost::int8_t childrenId;
+	size_t size;
+
+	pCursor = (*ppCursor);
+	if( depth > NBT_MAX_DEPTH ) {
+		std::cout << "Failed: tags are nested too deeply" << std::endl;
+		return false;
+	}
+
+	// Anything with a known size is jumped over without looking at it
+	switch( tagId )
+	{
+	case TAGID_BYTE:
+		size = 1;
+		break;
+	case TAGID_SHORT:
+		size = 2;
+		break;
+	case TAGID_INT:
+	case TAGID_FLOAT:
+		size = 4;
+		break;
+	case TAGID_LONG:
+	case TAGID_DOUBLE:
+		size = 8;
+		break;
+	case TAGID_BYTE_ARRAY:
+	case TAGID_INT_ARRAY:
+		if( m_pEnd - pCursor < 4 )
+			goto truncated;
+		length = ReadBig<boost::int32_t>( pCursor );
+		if( length < 0 )
+			length = 0;
+		size = 4 + (size_t)length * (tagId == TAGID_BYTE_ARRAY ? 1 : 4);
+		break;
+	case TAGID_STRING:
+		if( m_pEnd - pCursor < 2 )
+			goto truncated;
+		size = 2 + ReadBig<boost::uint16_t>( pCursor );
+		break;
+	case TAGID_LIST:
+		if( m_pEnd - pCursor < 5 )
+			goto truncated;
+		childrenId = pCursor[0];
+		length = ReadBig<boost::int32_t>( pCursor+1 );
+		pCursor += 5;
+		switch( childrenId )
+		{
+		case TAGID_END:
+			size = 0;
+			break;
+		case TAGID_BYTE:
+			size = 1;
+			break;
+		case TAGID_SHORT:
+			size = 2;
+			break;
+		case TAGID_INT:
+		case TAGID_FLOAT:
+			size = 4;
+			break;
+		case TAGID_LONG:
+		case TAGID_DOUBLE:
+			size = 8;
+			break;
+		default:
+			// Entries with their own lengths have to be walked one at a time
+			for( boost::int32_t i = 0; i < length; i++ ) {
+				if( !this->skipPayload( &pCursor, childrenId, depth+1 ) )
+					return false;
+			}
+			(*ppCursor) = pCursor;
+			return true;
+		}
+		size *= length > 0 ? (size_t)length : 0;
+		break;
+	case TAGID_COMPOUND:
+		for( ;; ) {
+			boost::int8_t childId;
+			const char *pChildName;
+			boost::uint16_t childNameLength;
+
+			if( pCursor >= m_pEnd )
+				goto truncated;
+			childId = *pCursor++;
+			if( childId == TAGID_END )
+				break;
+			if( !this->readName( &pCursor, &pChildName, &childNameLength ) )
+				goto truncated;
+			if( !this->skipPayload( &pCursor, childId, depth+1 ) )
+				return false;
+		}
+		(*ppCursor) = pCursor;
+		return true;
+	default:
+		std::cout << "Failed: Unknown tag id " << (int)tagId << std::endl;
+		return false;
+	}
+
+	if( (size_t)(m_pEnd - pCursor) < size )
+		goto truncated;
+	(*ppCursor) = pCursor + size;
+	return true;
+
+truncated:
+	std::cout << "Failed: NBT data ended unexpectedly" << std::endl;
+	return false;
+}
+
+bool CNBTBufferReader::visit( const char *pData, size_t length, CNBTVisitor &visitor, const CNBTProjection *pProjection )
+{
+	const char *pCursor;
+
+	m_pBegin = pData;
+	m_pEnd = pData + length;
+
+	// Root tags are full tags one after another
+	pCursor = m_pBegin;
+	while( pCursor < m_pEnd )
+	{
+		boost::int8_t tagId;
+		const char *pName;
+		boost::uint16_t nameLength;
+
+		tagId = *pCursor++;
+		if( tagId == TAGID_END ) {
+			std::cout << "Failed: mismatched end tag" << std::endl;
+			return false;
+		}
+		if( !this->readName( &pCursor, &pName, &nameLength ) ) {
+			std::cout << "Failed: NBT data ended unexpectedly" << std::endl;
+			return false;
+		}
+		if( !this->visitTag( &pCursor, tagId, pName, nameLength, 0, NBTPROJECTION_ROOT, visitor, pProjection ) )
+			return false;
+	}
+
+	return true;
+}
+bool CNBTBufferReader::read( const char *pData, size_t length )
+{
+	this->clear();
+	return this->visit( pData, length, *this, 0 );
+}
+
+bool CNBTBufferReader::beginTag( const NBTView &view )
+{
+	size_t index;
+
+	// Link it to the previous sibling or its parent
+	index = m_views.size();
+	m_views.push_back( view );
+	if( m_indexStack.empty() ) {
+		if( m_lastRoot != NBTVIEW_NONE )
+			m_views[m_lastRoot].nextSibling = index;
+		m_lastRoot = index;
+	}
+	else {
+		IndexParent &parent = m_indexStack.back();
+		if( parent.lastChild == NBTVIEW_NONE )
+			m_views[parent.parent].firstChild = index;
+		else
+			m_views[parent.lastChild].nextSibling = index;
+		parent.lastChild = index;
+	}
+
+	// Children of lists and compounds come next
+	if( view.tagId == TAGID_LIST || view.tagId == TAGID_COMPOUND ) {
+		IndexParent parent;
+		parent.parent = index;
+		parent.lastChild = NBTVIEW_NONE;
+		m_indexStack.push_back( parent );
+	}
+	return true;
+}
+bool CNBTBufferReader::endTag( const NBTView &view )
+{
+	NBTView &parent = m_views[m_indexStack.back().parent];
+
+	parent.payloadLength = view.payloadLength;
+	parent.count = view.count;
+	m_indexStack.pop_back();
+	return true;
+}
+
+void CNBTBufferReader::clear()
+{
+	// Keep the capacity so the next chunk doesn't have to allocate
+	m_views.clear();
+	m_indexStack.clear();
+	m_lastRoot = NBTVIEW_NONE;
+	m_pBegin = 0;
+	m_pEnd = 0;
+}
+
+size_t CNBTBufferReader::getViewCount() const {
+	return m_views.size();
+}
+const NBTView& CNBTBufferReader::getView( size_t index ) const {
+	_ASSERT_EXPR( index < m_views.size(), L"view index out of range" );
+	return m_views[index];
+}
+size_t CNBTBufferReader::getRootView() const {
+	return m_views.empty() ? NBTVIEW_NONE : 0;
+}
+size_t CNBTBufferReader::getChildName( size_t parent, boost::string_ref name ) const
+{
+	// Find it in the children list
+	for( size_t child = m_views[parent].firstChild; child != NBTVIEW_NONE; child = m_views[child].nextSibling ) {
+		if( CNBTBufferReader::GetName( m_views[child] ) == name )
+			return child;
+	}
+	return NBTVIEW_NONE;
+}
+
+////////////////
+// CNBTReader //
+////////////////
+
+CTag* CNBTReader::createTag( boost::int8_t tagId, CArena &arena )
 {
 	switch( tagId )
 	{
 	case TAGID_END:
-		return new CTagEnd();
+		return arena.create<CTagEnd>();
 	case TAGID_BYTE:
-		return new CTagByte();
+		return arena.create<CTagByte>();
 	case TAGID_SHORT:
-		return new CTagShort();
+		return arena.create<CTagShort>();
 	case TAGID_INT:
-		return new CTagInt();
+		return arena.create<CTagInt>();
 	case TAGID_LONG:
-		return new CTagLong();
+		return arena.create<CTagLong>();
 	case TAGID_FLOAT:
-		return new CTagFloat();
+		return arena.create<CTagFloat>();
 	case TAGID_DOUBLE:
-		return new CTagDouble();
+		return arena.create<CTagDouble>();
 	case TAGID_BYTE_ARRAY:
-		return new CTagByteArray();
+		return arena.create<CTagByteArray>();
 	case TAGID_STRING:
-		return new CTagString();
+		return arena.create<CTagString>();
 	case TAGID_LIST:
-		return new CTagList();
+		return arena.create<CTagList>();
 	case TAGID_COMPOUND:
-		return new CTagCompound();
+		return arena.create<CTagCompound>();
 	case TAGID_INT_ARRAY:
-		return new CTagIntArray();
+		return arena.create<CTagIntArray>();
 	default:
 		std::cout << "Failed: Unknown tag id " << (int)tagId << std::endl;
 		return 0;
@@ -89,7 +590,7 @@ CTag* CNBTReader::readTag( InputStream &stream, size_t *pBytesRead, bool fullTag
 		return 0;
 
 	// Create the tag
-	pTag = this->createTag( tagId );
+	pTag = this->createTag( tagId, m_arena );
 	if( !pTag )
 		return 0;
 
@@ -104,7 +605,7 @@ CTag* CNBTReader::readTag( InputStream &stream, size_t *pBytesRead, bool fullTag
 	if( pTag->getId() == TAGID_END ) {
 		if( m_parentStack.empty() ) {
 			std::cout << "Failed: mismatched end tag" << std::endl;
-			delete pTag;
+			m_rootTags.pop_back();
 			return 0;
 		}
 		m_parentStack.pop();
@@ -114,12 +615,12 @@ CTag* CNBTReader::readTag( InputStream &stream, size_t *pBytesRead, bool fullTag
 		m_parentStack.push( reinterpret_cast<CTagParent*>( pTag ) );
 
 	// Read the tag
-	pTag->read( stream, pBytesRead, fullTag );
+	pTag->read( stream, pBytesRead, fullTag, m_arena );
 
 	// Check if the list is full
 	if( !m_parentStack.empty() ) {
 		if( m_parentStack.top()->getId() == TAGID_LIST ) {
-			if( m_parentStack.top()->getChildren().size() == reinterpret_cast<CTagList*>(m_parentStack.top())->getChildrenCount() )
+			if( m_parentStack.top()->getChildCount() == reinterpret_cast<CTagList*>(m_parentStack.top())->getChildrenCount() )
 				m_parentStack.pop(); // pop off the list
 		}
 	}
@@ -209,9 +710,6 @@ bool CNBTReader::read( InputStream &stream )
 				return false;
 			else if( !pTag && stream.eof() )
 				break;
-
-			// Add it to the unsorted tag list
-			m_tags.push_back( pTag );
 		}
 	}
 	catch( const boost::filesystem::filesystem_error &e ) {
@@ -221,56 +719,160 @@ bool CNBTReader::read( InputStream &stream )
 
 	return true;
 }
-void CNBTReader::deleteTags()
+bool CNBTReader::read( const char *pData, size_t length, const CNBTProjection *pProjection )
 {
-	// Delete all the tags
-	for( TagList::iterator it = m_tags.begin(); it != m_tags.end(); it++ )
-	{
-		if( (*it) ) {
-			delete (*it);
-			(*it) = 0;
-		}
+	// Build the tags as the buffer is parsed
+	if( !m_bufferReader.visit( pData, length, *this, pProjection ) ) {
+		while( !m_parentStack.empty() )
+			m_parentStack.pop();
+		return false;
 	}
-	m_tags.clear();
+
+	return true;
+}
+bool CNBTReader::beginTag( const NBTView &view )
+{
+	CTag *pTag;
+
+	pTag = this->createTag( view.tagId, m_arena );
+	if( !pTag )
+		return false;
+	pTag->read( view, m_arena );
+
+	// If it has no parents its a root tag
+	if( m_parentStack.empty() )
+		m_rootTags.push_back( pTag );
+	else
+		m_parentStack.top()->addChild( pTag );
+	if( pTag->isParent() )
+		m_parentStack.push( reinterpret_cast<CTagParent*>(pTag) );
+
+	return true;
+}
+bool CNBTReader::endTag( const NBTView &view )
+{
+	// The stream reader keeps the closing end tag as the last child of a compound
+	if( view.tagId == TAGID_COMPOUND )
+		m_parentStack.top()->addChild( this->createTag( TAGID_END, m_arena ) );
+	m_parentStack.pop();
+
+	return true;
+}
+void CNBTReader::deleteTags()
+{
+	// Every tag lives in the arena, so they all go at once
+	m_arena.reset();
 	m_rootTags.clear();
+	while( !m_parentStack.empty() )
+		m_parentStack.pop();
 }
 
-TagList CNBTReader::getRootTags() const {
+const TagList& CNBTReader::getRootTags() const {
 	return m_rootTags;
 }
+const CArena& CNBTReader::getArena() const {
+	return m_arena;
+}
 
 //////////
 // CTag //
 //////////
 
+boost::uint32_t CTag::HashName( boost::string_ref name )
+{
+	boost::uint32_t hash;
+
+	// FNV-1a, names are short so this is only a few multiplies
+	hash = 2166136261u;
+	for( auto it = name.begin(); it != name.end(); it++ ) {
+		hash ^= (unsigned char)(*it);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
 CTag::CTag() {
 	m_tagId = 0;
-	m_tagName = "";
+	this->setName( "", 0 );
+	m_pNextSibling = 0;
 }
 CTag::~CTag() {
 }
 
-void CTag::readName( InputStream &stream, size_t *pBytesRead )
+void CTag::readName( InputStream &stream, size_t *pBytesRead, CArena &arena )
 {
 	boost::int16_t nameLength;
 	char *pName;
 
 	// Read a TAG_String payload for the name
-	CTagString::ReadPayload( stream, pBytesRead, &nameLength, &pName );
+	CTagString::ReadPayload( stream, pBytesRead, &nameLength, &pName, arena );
 	if( nameLength < 0 || !pName )
-		m_tagName = "";
-	else {
-		m_tagName = std::string( pName );
-		delete pName;
-		pName = 0;
+		this->setName( "", 0 );
+	else
+		this->setName( pName, nameLength );
+}
+void CTag::readName( const NBTView &view, CArena &arena )
+{
+	char *pName;
+
+	// Copy the name out of the buffer, it is reused for the next chunk
+	if( view.nameLength == 0 ) {
+		this->setName( "", 0 );
+		return;
 	}
+	pName = reinterpret_cast<char*>(arena.allocate( view.nameLength, 1 ));
+	memcpy( pName, view.pName, view.nameLength );
+	this->setName( pName, view.nameLength );
+}
+void CTag::setName( const char *pName, boost::uint16_t nameLength )
+{
+	m_pName = pName;
+	m_nameLength = nameLength;
+	m_nameHash = CTag::HashName( boost::string_ref( pName, nameLength ) );
 }
 
 boost::int8_t CTag::getId() const {
 	return m_tagId;
 }
 std::string CTag::getName() const {
-	return m_tagName;
+	return std::string( m_pName, m_nameLength );
+}
+boost::string_ref CTag::getNameRef() const {
+	return boost::string_ref( m_pName, m_nameLength );
+}
+boost::uint32_t CTag::getNameHash() const {
+	return m_nameHash;
+}
+CTag* CTag::getNextSibling() const {
+	return m_pNextSibling;
+}
+
+//////////////
+// CTagPath //
+//////////////
+
+CTagPath::CTagPath( std::string path )
+{
+	std::vector<std::string> tokens;
+
+	// Split into tokens once
+	m_path = path;
+	boost::split( tokens, path, boost::is_any_of( "." ) );
+	for( auto it = tokens.begin(); it != tokens.end(); it++ ) {
+		Element element;
+		element.name = (*it);
+		element.hash = CTag::HashName( element.name );
+		m_elements.push_back( element );
+	}
+}
+CTagPath::~CTagPath() {
+}
+
+const std::string& CTagPath::getPath() const {
+	return m_path;
+}
+const std::vector<CTagPath::Element>& CTagPath::getElements() const {
+	return m_elements;
 }
 bool CTag::isParent() const {
 	return false;
@@ -281,61 +883,87 @@ bool CTag::isParent() const {
 ////////////////
 
 CTagParent::CTagParent() {
+	m_pFirstChild = 0;
+	m_pLastChild = 0;
+	m_childCount = 0;
 }
 CTagParent::~CTagParent() {
-	m_children.clear();
 }
 
-void CTagParent::addChild( CTag *pTag ) {
-	m_children.push_back( pTag );
+void CTagParent::addChild( CTag *pTag )
+{
+	// Children are linked through the tags themselves so adding one never allocates
+	pTag->m_pNextSibling = 0;
+	if( m_pLastChild )
+		m_pLastChild->m_pNextSibling = pTag;
+	else
+		m_pFirstChild = pTag;
+	m_pLastChild = pTag;
+	m_childCount++;
 }
 
-TagList CTagParent::getChildren() const {
-	return m_children;
+TagList CTagParent::getChildren() const
+{
+	TagList children;
+
+	children.reserve( m_childCount );
+	for( CTag *pChild = m_pFirstChild; pChild; pChild = pChild->m_pNextSibling )
+		children.push_back( pChild );
+	return children;
+}
+size_t CTagParent::getChildCount() const {
+	return m_childCount;
+}
+CTag* CTagParent::getFirstChild() const {
+	return m_pFirstChild;
 }
 bool CTagParent::isParent() const {
 	return true;
 }
-CTag* CTagParent::getChildName( std::string name )
+CTag* CTagParent::getChildName( boost::string_ref name ) const {
+	return this->getChildName( name, CTag::HashName( name ) );
+}
+CTag* CTagParent::getChildName( boost::string_ref name, boost::uint32_t hash ) const
 {
-	// Find it in the children list
-	for( auto it = m_children.begin(); it != m_children.end(); it++ ) {
-		if( (*it)->getName().compare( name ) == 0 ) {
-			return (*it);
-		}
+	// Find it in the children list, only compare the names when the hashes match
+	for( CTag *pChild = m_pFirstChild; pChild; pChild = pChild->m_pNextSibling ) {
+		if( pChild->m_nameHash == hash && pChild->getNameRef() == name )
+			return pChild;
 	}
 	return 0;
 }
-CTag* CTagParent::getChildPath( std::string path, boost::int8_t type )
+CTag* CTagParent::getChildPath( std::string path, boost::int8_t type ) const {
+	return this->getChildPath( CTagPath( path ), type );
+}
+CTag* CTagParent::getChildPath( const CTagPath &path, boost::int8_t type ) const
 {
-	std::vector<std::string> tokens;
+	const std::vector<CTagPath::Element> &elements = path.getElements();
 	CTag *pNextTag;
-	CTagParent *pCurrentParent;
+	const CTagParent *pCurrentParent;
 
-	// Split into tokens
-	boost::split( tokens, path, boost::is_any_of( "." ) );
 	pCurrentParent = this;
-	for( auto it = tokens.begin(); it != tokens.end(); it++ )
+	for( auto it = elements.begin(); it != elements.end(); it++ )
 	{
 		// Search for
-		pNextTag = pCurrentParent->getChildName( (*it) );
+		pNextTag = pCurrentParent->getChildName( (*it).name, (*it).hash );
 		if( !pNextTag ) {
-			std::cout << "Could not find tag \'" << path.c_str() << "\'" << std::endl;
+			std::cout << "Could not find tag \'" << path.getPath().c_str() << "\'" << std::endl;
 			return 0;
 		}
 		// Check if we're at the end
-		if( it == tokens.end()-1 ) {
+		if( it == elements.end()-1 ) {
 			if( pNextTag->getId() == type )
 				return pNextTag;
 			else {
-				std::cout << "Invalid type for tag specified by path \'" << path.c_str() << "\'" << std::endl;
+				std::cout << "Invalid type for tag specified by path \'" << path.getPath().c_str() << "\'" << std::endl;
 				return 0;
 			}
 		}
 		else if( pNextTag->isParent() )
 			pCurrentParent = reinterpret_cast<CTagParent*>(pNextTag);
 		else {
-			std::cout << "Invalid path \'" << path.c_str() << "\'" << std::endl;
+			std::cout << "Invalid path \'" << path.getPath().c_str() << "\'" << std::endl;
+			return 0;
 		}
 	}
 
@@ -348,12 +976,14 @@ CTag* CTagParent::getChildPath( std::string path, boost::int8_t type )
 
 CTagEnd::CTagEnd() {
 	m_tagId = TAGID_END;
-	m_tagName = "#END-TAG";
+	this->setName( "#END-TAG", 8 );
 }
 CTagEnd::~CTagEnd() {
 }
 
-void CTagEnd::read( InputStream &stream, size_t *pBytesRead, bool fullTag ) {
+void CTagEnd::read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena ) {
+}
+void CTagEnd::read( const NBTView &view, CArena &arena ) {
 }
 
 //////////////
@@ -374,12 +1004,17 @@ CTagByte::CTagByte() {
 CTagByte::~CTagByte() {
 }
 
-void CTagByte::read( InputStream &stream, size_t *pBytesRead, bool fullTag )
+void CTagByte::read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena )
 {
 	if( fullTag )
-		this->readName( stream, pBytesRead );
+		this->readName( stream, pBytesRead, arena );
 	CTagByte::ReadPayload( stream, pBytesRead, &m_payload );
 }
+void CTagByte::read( const NBTView &view, CArena &arena )
+{
+	this->readName( view, arena );
+	m_payload = CNBTBufferReader::GetByte( view );
+}
 
 boost::int8_t CTagByte::getPayload() const {
 	return m_payload;
@@ -404,14 +1039,19 @@ CTagShort::CTagShort() {
 CTagShort::~CTagShort() {
 }
 
-void CTagShort::read( InputStream &stream, size_t *pBytesRead, bool fullTag )
+void CTagShort::read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena )
 {
 	// Read the name
 	if( fullTag )
-		this->readName( stream, pBytesRead );
+		this->readName( stream, pBytesRead, arena );
 	// Read payload
 	CTagShort::ReadPayload( stream, pBytesRead, &m_payload );
 }
+void CTagShort::read( const NBTView &view, CArena &arena )
+{
+	this->readName( view, arena );
+	m_payload = CNBTBufferReader::GetShort( view );
+}
 
 boost::int16_t CTagShort::getPayload() const {
 	return m_payload;
@@ -436,12 +1076,17 @@ CTagInt::CTagInt() {
 CTagInt::~CTagInt() {
 }
 
-void CTagInt::read( InputStream &stream, size_t *pBytesRead, bool fullTag )
+void CTagInt::read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena )
 {
 	if( fullTag )
-		this->readName( stream, pBytesRead );
+		this->readName( stream, pBytesRead, arena );
 	CTagInt::ReadPayload( stream, pBytesRead, &m_payload );
 }
+void CTagInt::read( const NBTView &view, CArena &arena )
+{
+	this->readName( view, arena );
+	m_payload = CNBTBufferReader::GetInt( view );
+}
 
 boost::int32_t CTagInt::getPayload() const {
 	return m_payload;
@@ -466,14 +1111,19 @@ CTagLong::CTagLong() {
 CTagLong::~CTagLong() {
 }
 
-void CTagLong::read( InputStream &stream, size_t *pBytesRead, bool fullTag )
+void CTagLong::read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena )
 {
 	// Read the name
 	if( fullTag )
-		this->readName( stream, pBytesRead );
+		this->readName( stream, pBytesRead, arena );
 	// Read payload
 	CTagLong::ReadPayload( stream, pBytesRead, &m_payload );
 }
+void CTagLong::read( const NBTView &view, CArena &arena )
+{
+	this->readName( view, arena );
+	m_payload = CNBTBufferReader::GetLong( view );
+}
 
 boost::int64_t CTagLong::getPayload() const {
 	return m_payload;
@@ -501,12 +1151,17 @@ CTagFloat::CTagFloat() {
 CTagFloat::~CTagFloat() {
 }
 
-void CTagFloat::read( InputStream &stream, size_t *pBytesRead, bool fullTag )
+void CTagFloat::read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena )
 {
 	if( fullTag )
-		this->readName( stream, pBytesRead );
+		this->readName( stream, pBytesRead, arena );
 	CTagFloat::ReadPayload( stream, pBytesRead, &m_payload );
 }
+void CTagFloat::read( const NBTView &view, CArena &arena )
+{
+	this->readName( view, arena );
+	m_payload = CNBTBufferReader::GetFloat( view );
+}
 
 float CTagFloat::getPayload() const {
 	return m_payload;
@@ -534,12 +1189,17 @@ CTagDouble::CTagDouble() {
 CTagDouble::~CTagDouble() {
 }
 
-void CTagDouble::read( InputStream &stream, size_t *pBytesRead, bool fullTag )
+void CTagDouble::read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena )
 {
 	if( fullTag )
-		this->readName( stream, pBytesRead );
+		this->readName( stream, pBytesRead, arena );
 	CTagDouble::ReadPayload( stream, pBytesRead, &m_payload );
 }
+void CTagDouble::read( const NBTView &view, CArena &arena )
+{
+	this->readName( view, arena );
+	m_payload = CNBTBufferReader::GetDouble( view );
+}
 
 double CTagDouble::getPayload() const {
 	return m_payload;
@@ -549,15 +1209,15 @@ double CTagDouble::getPayload() const {
 // CTagByteArray //
 ///////////////////
 
-void CTagByteArray::ReadPayload( InputStream &stream, size_t *pBytesRead, boost::int32_t *pSize, boost::int8_t **pBytes )
+void CTagByteArray::ReadPayload( InputStream &stream, size_t *pBytesRead, boost::int32_t *pSize, boost::int8_t **pBytes, CArena &arena )
 {
 	// Read the payload size
 	CTagInt::ReadPayload( stream, pBytesRead, pSize );
-	// Read pSize number of payloads
+	// Read the whole array straight into the arena
 	if( (*pSize) > 0 ) {
-		(*pBytes) = new boost::int8_t[(*pSize)];
-		for( boost::int32_t i = 0; i < (*pSize); i++ )
-			CTagByte::ReadPayload( stream, pBytesRead, &(*pBytes)[i] );
+		(*pBytes) = reinterpret_cast<boost::int8_t*>(arena.allocate( (*pSize), 1 ));
+		stream.read( reinterpret_cast<char*>(*pBytes), (*pSize) );
+		(*pBytesRead) += (*pSize);
 	}
 	else
 		(*pBytes) = 0;
@@ -565,40 +1225,52 @@ void CTagByteArray::ReadPayload( InputStream &stream, size_t *pBytesRead, boost:
 
 CTagByteArray::CTagByteArray() {
 	m_tagId = TAGID_BYTE_ARRAY;
+	m_pPayload = 0;
+	m_payloadSize = 0;
 }
 CTagByteArray::~CTagByteArray() {
 }
 
-void CTagByteArray::read( InputStream &stream, size_t *pBytesRead, bool fullTag )
+void CTagByteArray::read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena )
 {
-	boost::int32_t size;
-	boost::int8_t *pBytes;
-
 	if( fullTag )
-		this->readName( stream, pBytesRead );
-	CTagByteArray::ReadPayload( stream, pBytesRead, &size, &pBytes );
-	if( size > 0 && pBytes ) {
-		m_payload = std::vector<boost::int8_t>( pBytes, pBytes + size );
-		delete[] pBytes;
+		this->readName( stream, pBytesRead, arena );
+	CTagByteArray::ReadPayload( stream, pBytesRead, &m_payloadSize, &m_pPayload, arena );
+	if( !m_pPayload )
+		m_payloadSize = 0;
+}
+void CTagByteArray::read( const NBTView &view, CArena &arena )
+{
+	this->readName( view, arena );
+	m_payloadSize = view.count;
+	if( m_payloadSize > 0 ) {
+		m_pPayload = reinterpret_cast<boost::int8_t*>(arena.allocate( m_payloadSize, 1 ));
+		CNBTBufferReader::CopyByteArray( view, m_pPayload );
 	}
 }
 
 std::vector<boost::int8_t> CTagByteArray::getPayload() const {
-	return m_payload;
+	return std::vector<boost::int8_t>( m_pPayload, m_pPayload + m_payloadSize );
+}
+const boost::int8_t* CTagByteArray::getData() const {
+	return m_pPayload;
+}
+boost::int32_t CTagByteArray::getSize() const {
+	return m_payloadSize;
 }
 
 ////////////////
 // CTagString //
 ////////////////
 
-void CTagString::ReadPayload( InputStream &stream, size_t *pBytesRead, boost::int16_t *pStringLength, char **pString )
+void CTagString::ReadPayload( InputStream &stream, size_t *pBytesRead, boost::int16_t *pStringLength, char **pString, CArena &arena )
 {
 	// Read the string length (TAG_Short)
 	CTagShort::ReadPayload( stream, pBytesRead, pStringLength );
 	// Read the name
 	if( (*pStringLength) > 0 )
 	{
-		(*pString) = new char[(*pStringLength)+1];
+		(*pString) = reinterpret_cast<char*>(arena.allocate( (*pStringLength)+1, 1 ));
 		stream.read( (*pString), (*pStringLength) );
 		(*pBytesRead) += (*pStringLength);
 		(*pString)[(*pStringLength)] = '\0'; // null terminate
@@ -609,32 +1281,45 @@ void CTagString::ReadPayload( InputStream &stream, size_t *pBytesRead, boost::in
 
 CTagString::CTagString() {
 	m_tagId = TAGID_STRING;
-	m_payload = "";
+	m_pPayload = "";
+	m_payloadLength = 0;
 }
 CTagString::~CTagString() {
 }
 
-void CTagString::read( InputStream &stream, size_t *pBytesRead, bool fullTag )
+void CTagString::read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena )
 {
 	boost::int16_t stringLength;
 	char *pString;
 
 	// Read the name
 	if( fullTag )
-		this->readName( stream, pBytesRead );
+		this->readName( stream, pBytesRead, arena );
 	// Read payload
-	CTagString::ReadPayload( stream, pBytesRead, &stringLength, &pString );
-	if( stringLength < 0 || !pString )
-		m_payload = "";
-	else {
-		m_payload = std::string( pString );
-		delete[] pString;
-		pString = 0;
+	CTagString::ReadPayload( stream, pBytesRead, &stringLength, &pString, arena );
+	if( stringLength > 0 && pString ) {
+		m_pPayload = pString;
+		m_payloadLength = stringLength;
+	}
+}
+void CTagString::read( const NBTView &view, CArena &arena )
+{
+	char *pString;
+
+	this->readName( view, arena );
+	if( view.payloadLength > 0 ) {
+		pString = reinterpret_cast<char*>(arena.allocate( view.payloadLength, 1 ));
+		memcpy( pString, view.pPayload, view.payloadLength );
+		m_pPayload = pString;
+		m_payloadLength = (boost::uint16_t)view.payloadLength;
 	}
 }
 
 std::string CTagString::getPayload() const {
-	return m_payload;
+	return std::string( m_pPayload, m_payloadLength );
+}
+boost::string_ref CTagString::getPayloadRef() const {
+	return boost::string_ref( m_pPayload, m_payloadLength );
 }
 
 //////////////
@@ -649,11 +1334,11 @@ CTagList::CTagList() {
 CTagList::~CTagList() {
 }
 
-void CTagList::read( InputStream &stream, size_t *pBytesRead, bool fullTag )
+void CTagList::read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena )
 {
 	// Read name
 	if( fullTag )
-		this->readName( stream, pBytesRead );
+		this->readName( stream, pBytesRead, arena );
 	// Read the type of tags in the list
 	CTagByte::ReadPayload( stream, pBytesRead, &m_childrenId );
 	// Read how many are in the list
@@ -661,11 +1346,17 @@ void CTagList::read( InputStream &stream, size_t *pBytesRead, bool fullTag )
 
 	// The tag reader will handle assigning children
 }
+void CTagList::read( const NBTView &view, CArena &arena )
+{
+	this->readName( view, arena );
+	m_childrenId = view.childrenId;
+	m_childrenCount = view.count;
+}
 
 boost::int8_t CTagList::getChildrenId() const {
 	return m_childrenId;
 }
-boost::int8_t CTagList::getChildrenCount() const {
+boost::int32_t CTagList::getChildrenCount() const {
 	return m_childrenCount;
 }
 
@@ -679,25 +1370,29 @@ CTagCompound::CTagCompound() {
 CTagCompound::~CTagCompound() {
 }
 
-void CTagCompound::read( InputStream &stream, size_t *pBytesRead, bool fullTag )
+void CTagCompound::read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena )
 {
 	if( fullTag )
-		this->readName( stream, pBytesRead );
+		this->readName( stream, pBytesRead, arena );
+}
+void CTagCompound::read( const NBTView &view, CArena &arena ) {
+	this->readName( view, arena );
 }
 
 //////////////////
 // CTagIntArray //
 //////////////////
 
-void CTagIntArray::ReadPayload( InputStream &stream, size_t *pBytesRead, boost::int32_t *pSize, boost::int32_t **pInts )
+void CTagIntArray::ReadPayload( InputStream &stream, size_t *pBytesRead, boost::int32_t *pSize, boost::int32_t **pInts, CArena &arena )
 {
 	// Read the payload size
 	CTagInt::ReadPayload( stream, pBytesRead, pSize );
-	// Read pSize number of payloads
+	// Read the whole array straight into the arena, then fix the byte order in one pass
 	if( (*pSize) > 0 ) {
-		(*pInts) = new boost::int32_t[(*pSize)];
-		for( boost::int32_t i = 0; i < (*pSize); i++ )
-			CTagInt::ReadPayload( stream, pBytesRead, &(*pInts)[i] );
+		(*pInts) = reinterpret_cast<boost::int32_t*>(arena.allocate( (*pSize)*sizeof( boost::int32_t ), alignof( boost::int32_t ) ));
+		stream.read( reinterpret_cast<char*>(*pInts), (*pSize)*sizeof( boost::int32_t ) );
+		(*pBytesRead) += (*pSize)*sizeof( boost::int32_t );
+		BigToNativeInt32Array( (*pInts), (*pSize) );
 	}
 	else
 		(*pInts) = 0;
@@ -705,24 +1400,36 @@ void CTagIntArray::ReadPayload( InputStream &stream, size_t *pBytesRead, boost::
 
 CTagIntArray::CTagIntArray() {
 	m_tagId = TAGID_INT_ARRAY;
+	m_pPayload = 0;
+	m_payloadSize = 0;
 }
 CTagIntArray::~CTagIntArray() {
 }
 
-void CTagIntArray::read( InputStream &stream, size_t *pBytesRead, bool fullTag )
+void CTagIntArray::read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena )
 {
-	boost::int32_t size;
-	boost::int32_t *pInts;
-
 	if( fullTag )
-		this->readName( stream, pBytesRead );
-	CTagIntArray::ReadPayload( stream, pBytesRead, &size, &pInts );
-	if( size > 0 && pInts ) {
-		m_payload = std::vector<boost::int32_t>( pInts, pInts + size );
-		delete[] pInts;
+		this->readName( stream, pBytesRead, arena );
+	CTagIntArray::ReadPayload( stream, pBytesRead, &m_payloadSize, &m_pPayload, arena );
+	if( !m_pPayload )
+		m_payloadSize = 0;
+}
+void CTagIntArray::read( const NBTView &view, CArena &arena )
+{
+	this->readName( view, arena );
+	m_payloadSize = view.count;
+	if( m_payloadSize > 0 ) {
+		m_pPayload = reinterpret_cast<boost::int32_t*>(arena.allocate( m_payloadSize*sizeof( boost::int32_t ), alignof( boost::int32_t ) ));
+		CNBTBufferReader::CopyIntArray( view, m_pPayload );
 	}
 }
 
 std::vector<boost::int32_t> CTagIntArray::getPayload() const {
-	return m_payload;
+	return std::vector<boost::int32_t>( m_pPayload, m_pPayload + m_payloadSize );
+}
+const boost::int32_t* CTagIntArray::getData() const {
+	return m_pPayload;
+}
+boost::int32_t CTagIntArray::getSize() const {
+	return m_payloadSize;
 }
\ No newline at end of file
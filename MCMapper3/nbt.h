@@ -31,8 +31,10 @@
 #pragma warning( default:4244 )
 #include <boost\filesystem.hpp>
 #include <boost\integer.hpp>
+#include <boost\utility\string_ref.hpp>
 #include <stack>
 #include <vector>
+#include "arena.h"
 
 class CTag;
 class CTagParent;
@@ -69,49 +71,253 @@ enum : boost::int8_t
 	TAGID_COUNT
 };
 
-class CNBTReader
+#define NBTVIEW_NONE ((size_t)-1)
+#define NBT_MAX_DEPTH 512
+
+/*
+	A single tag inside a decompressed NBT buffer
+	Nothing is copied, the pointers refer into the buffer given to CNBTBufferReader::read
+	and are only valid for as long as that buffer is
+*/
+struct NBTView
+{
+	boost::int8_t tagId;
+	const char *pName;
+	boost::uint16_t nameLength;
+	const char *pPayload;		// start of the payload, after any length or type prefix
+	size_t payloadLength;		// payload size in bytes, including the children of lists and compounds
+	boost::int32_t count;		// elements in an array, entries in a list or children in a compound
+	boost::int8_t childrenId;	// tag id of the entries in a list
+	size_t firstChild;			// view index of the first child, or NBTVIEW_NONE
+	size_t nextSibling;			// view index of the next sibling, or NBTVIEW_NONE
+};
+
+/////////////////
+// CNBTVisitor //
+/////////////////
+
+/*
+	Receives the tags of a buffer in order as CNBTBufferReader::visit parses them
+	Views passed to a visitor are not indexed, so firstChild and nextSibling are always NBTVIEW_NONE
+	For lists and compounds the children follow beginTag, then endTag is called with payloadLength and count filled in
+	Returning false from either stops the parse
+*/
+class CNBTVisitor
+{
+public:
+	virtual ~CNBTVisitor() {}
+
+	virtual bool beginTag( const NBTView &view ) = 0;
+	virtual bool endTag( const NBTView &view ) = 0;
+};
+
+////////////////////
+// CNBTProjection //
+////////////////////
+
+#define NBTPROJECTION_ROOT 0
+#define NBTPROJECTION_SKIP ((size_t)-1)
+
+/*
+	A set of wanted tag paths, in the same dotted form as CTagParent::getChildPath
+	Paths are relative to the root compound and list entries don't add a path element,
+	so "Level.Sections.Blocks" selects the Blocks array of every section
+	Everything below a wanted path is wanted, anything else is skipped without being parsed
+*/
+class CNBTProjection
+{
+private:
+	struct Node
+	{
+		std::string name;
+		std::vector<size_t> children;
+		bool whole;
+	};
+	std::vector<Node> m_nodes;
+public:
+	CNBTProjection();
+	~CNBTProjection();
+
+	void addPath( std::string path );
+	void clear();
+
+	/*
+		@method: getChild
+		@returns: the node for the child called name, or NBTPROJECTION_SKIP if it isn't wanted
+	*/
+	size_t getChild( size_t node, boost::string_ref name ) const;
+};
+
+//////////////////////
+// CNBTBufferReader //
+//////////////////////
+
+class CNBTBufferReader : private CNBTVisitor
 {
 private:
-	std::stack<CTagParent*> m_parentStack;
+	struct IndexParent
+	{
+		size_t parent;
+		size_t lastChild;
+	};
+
+	const char *m_pBegin;
+	const char *m_pEnd;
+	std::vector<NBTView> m_views;
+	std::vector<IndexParent> m_indexStack;
+	size_t m_lastRoot;
+
+	bool visitTag( const char **ppCursor, boost::int8_t tagId, const char *pName, boost::uint16_t nameLength, unsigned int depth, size_t node, CNBTVisitor &visitor, const CNBTProjection *pProjection );
+	bool skipPayload( const char **ppCursor, boost::int8_t tagId, unsigned int depth );
+	bool readName( const char **ppCursor, const char **ppName, boost::uint16_t *pNameLength );
+
+	// Builds the view index for read
+	bool beginTag( const NBTView &view );
+	bool endTag( const NBTView &view );
+public:
+	static boost::string_ref GetName( const NBTView &view );
+	static boost::int8_t GetByte( const NBTView &view );
+	static boost::int16_t GetShort( const NBTView &view );
+	static boost::int32_t GetInt( const NBTView &view );
+	static boost::int64_t GetLong( const NBTView &view );
+	static float GetFloat( const NBTView &view );
+	static double GetDouble( const NBTView &view );
+	static boost::string_ref GetString( const NBTView &view );
+	static void CopyByteArray( const NBTView &view, boost::int8_t *pBytes );
+	static void CopyIntArray( const NBTView &view, boost::int32_t *pInts );
+
+	CNBTBufferReader();
+	~CNBTBufferReader();
+
+	/*
+		@method: read
+		@returns: if the buffer contained valid NBT data
+		Indexes every tag in the buffer, the buffer must outlive the views
+	*/
+	bool read( const char *pData, size_t length );
+	/*
+		@method: visit
+		@returns: if the buffer contained valid NBT data and the visitor didn't stop
+		Streams the tags in the buffer to the visitor without indexing them
+		If a projection is given, tags it doesn't want are skipped by length and never reach the visitor
+	*/
+	bool visit( const char *pData, size_t length, CNBTVisitor &visitor, const CNBTProjection *pProjection );
+	void clear();
+
+	size_t getViewCount() const;
+	const NBTView& getView( size_t index ) const;
+	size_t getRootView() const;
+	size_t getChildName( size_t parent, boost::string_ref name ) const;
+};
+
+////////////////
+// CNBTReader //
+////////////////
+
+class CNBTReader : private CNBTVisitor
+{
+private:
+	std::stack<CTagParent*, std::vector<CTagParent*>> m_parentStack;
 	TagList m_rootTags;
-	TagList m_tags;
+	CNBTBufferReader m_bufferReader;
+	CArena m_arena;
 
 	CTag* readTag( InputStream &stream, size_t *pBytesRead, bool fullTag );
+
+	// Builds the tag tree for read
+	bool beginTag( const NBTView &view );
+	bool endTag( const NBTView &view );
 public:
-	static CTag* createTag( boost::int8_t tagId );
+	static CTag* createTag( boost::int8_t tagId, CArena &arena );
 
 	CNBTReader();
 	~CNBTReader();
 
 	bool read( boost::filesystem::path fullPath );
 	bool read( InputStream &stream );
+	/*
+		@method: read
+		@returns: if the buffer contained valid NBT data
+		Builds the tag tree from an already decompressed buffer
+		If a projection is given only the tags it wants are built
+	*/
+	bool read( const char *pData, size_t length, const CNBTProjection *pProjection = 0 );
+	/*
+		@method: deleteTags
+		@returns: none
+		Releases the whole tag tree at once, the reader's memory is kept so it can be reused for the next chunk
+	*/
 	void deleteTags();
 
-	TagList getRootTags() const;
+	const TagList& getRootTags() const;
+	const CArena& getArena() const;
 };
 
 //////////
 // CTag //
 //////////
 
+/*
+	Tags are created by CNBTReader in its arena, everything they point to (names, payloads,
+	siblings) lives in the same arena and is released with it, so tags are never deleted
+*/
 class CTag
 {
+	friend class CTagParent;
 protected:
 	boost::int8_t m_tagId;
-	std::string m_tagName;
-
-	void readName( InputStream &stream, size_t *pBytesRead );
+	const char *m_pName;
+	boost::uint16_t m_nameLength;
+	boost::uint32_t m_nameHash;
+	CTag *m_pNextSibling;
+
+	void readName( InputStream &stream, size_t *pBytesRead, CArena &arena );
+	void readName( const NBTView &view, CArena &arena );
+	void setName( const char *pName, boost::uint16_t nameLength );
 public:
+	static boost::uint32_t HashName( boost::string_ref name );
+
 	CTag();
 	virtual ~CTag();
 
-	virtual void read( InputStream &stream, size_t *pBytesRead, bool fullTag ) = 0;
+	virtual void read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena ) = 0;
+	virtual void read( const NBTView &view, CArena &arena ) = 0;
 
 	boost::int8_t getId() const;
 	std::string getName() const;
+	boost::string_ref getNameRef() const;
+	boost::uint32_t getNameHash() const;
+	CTag* getNextSibling() const;
 	virtual bool isParent() const;
 };
 
+//////////////
+// CTagPath //
+//////////////
+
+/*
+	A dotted tag path split and hashed ahead of time
+	Build one for each path that is looked up repeatedly and reuse it for every chunk
+*/
+class CTagPath
+{
+public:
+	struct Element
+	{
+		std::string name;
+		boost::uint32_t hash;
+	};
+private:
+	std::string m_path;
+	std::vector<Element> m_elements;
+public:
+	CTagPath( std::string path );
+	~CTagPath();
+
+	const std::string& getPath() const;
+	const std::vector<Element>& getElements() const;
+};
+
 ////////////////
 // CTagParent //
 ////////////////
@@ -119,7 +325,9 @@ public:
 class CTagParent : public CTag
 {
 private:
-	TagList m_children;
+	CTag *m_pFirstChild;
+	CTag *m_pLastChild;
+	size_t m_childCount;
 public:
 	CTagParent();
 	virtual ~CTagParent();
@@ -127,9 +335,17 @@ public:
 	void addChild( CTag *pTag );
 
 	TagList getChildren() const;
+	size_t getChildCount() const;
+	/*
+		@method: getFirstChild
+		@returns: the first child or null, follow getNextSibling for the rest without copying the child list
+	*/
+	CTag* getFirstChild() const;
 	virtual bool isParent() const;
-	CTag* getChildName( std::string name );
-	CTag* getChildPath( std::string path, boost::int8_t type );
+	CTag* getChildName( boost::string_ref name ) const;
+	CTag* getChildName( boost::string_ref name, boost::uint32_t hash ) const;
+	CTag* getChildPath( std::string path, boost::int8_t type ) const;
+	CTag* getChildPath( const CTagPath &path, boost::int8_t type ) const;
 };
 
 /////////////
@@ -142,7 +358,8 @@ public:
 	CTagEnd();
 	~CTagEnd();
 
-	void read( InputStream &stream, size_t *pBytesRead, bool fullTag );
+	void read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena );
+	void read( const NBTView &view, CArena &arena );
 };
 
 //////////////
@@ -159,7 +376,8 @@ public:
 	CTagByte();
 	~CTagByte();
 
-	void read( InputStream &stream, size_t *pBytesRead, bool fullTag );
+	void read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena );
+	void read( const NBTView &view, CArena &arena );
 
 	boost::int8_t getPayload() const;
 };
@@ -178,7 +396,8 @@ public:
 	CTagShort();
 	~CTagShort();
 
-	void read( InputStream &stream, size_t *pBytesRead, bool fullTag );
+	void read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena );
+	void read( const NBTView &view, CArena &arena );
 
 	boost::int16_t getPayload() const;
 };
@@ -197,7 +416,8 @@ public:
 	CTagInt();
 	~CTagInt();
 
-	void read( InputStream &stream, size_t *pBytesRead, bool fullTag );
+	void read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena );
+	void read( const NBTView &view, CArena &arena );
 
 	boost::int32_t getPayload() const;
 };
@@ -216,7 +436,8 @@ public:
 	CTagLong();
 	~CTagLong();
 
-	void read( InputStream &stream, size_t *pBytesRead, bool fullTag );
+	void read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena );
+	void read( const NBTView &view, CArena &arena );
 
 	boost::int64_t getPayload() const;
 };
@@ -235,7 +456,8 @@ public:
 	CTagFloat();
 	~CTagFloat();
 
-	void read( InputStream &stream, size_t *pBytesRead, bool fullTag );
+	void read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena );
+	void read( const NBTView &view, CArena &arena );
 
 	float getPayload() const;
 };
@@ -254,7 +476,8 @@ public:
 	CTagDouble();
 	~CTagDouble();
 
-	void read( InputStream &stream, size_t *pBytesRead, bool fullTag );
+	void read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena );
+	void read( const NBTView &view, CArena &arena );
 
 	double getPayload() const;
 };
@@ -266,16 +489,20 @@ public:
 class CTagByteArray : public CTag
 {
 private:
-	std::vector<boost::int8_t> m_payload;
+	boost::int8_t *m_pPayload;
+	boost::int32_t m_payloadSize;
 public:
-	static void ReadPayload( InputStream &stream, size_t *pBytesRead, boost::int32_t *pSize, boost::int8_t **pBytes );
+	static void ReadPayload( InputStream &stream, size_t *pBytesRead, boost::int32_t *pSize, boost::int8_t **pBytes, CArena &arena );
 
 	CTagByteArray();
 	~CTagByteArray();
 
-	void read( InputStream &stream, size_t *pBytesRead, bool fullTag );
+	void read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena );
+	void read( const NBTView &view, CArena &arena );
 
 	std::vector<boost::int8_t> getPayload() const;
+	const boost::int8_t* getData() const;
+	boost::int32_t getSize() const;
 };
 
 
@@ -286,16 +513,19 @@ public:
 class CTagString : public CTag
 {
 private:
-	std::string m_payload;
+	const char *m_pPayload;
+	boost::uint16_t m_payloadLength;
 public:
-	static void ReadPayload( InputStream &stream, size_t *pBytesRead, boost::int16_t *pStringLength, char **pString );
+	static void ReadPayload( InputStream &stream, size_t *pBytesRead, boost::int16_t *pStringLength, char **pString, CArena &arena );
 
 	CTagString();
 	~CTagString();
 
-	void read( InputStream &stream, size_t *pBytesRead, bool fullTag );
+	void read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena );
+	void read( const NBTView &view, CArena &arena );
 
 	std::string getPayload() const;
+	boost::string_ref getPayloadRef() const;
 };
 
 //////////////
@@ -311,10 +541,11 @@ public:
 	CTagList();
 	~CTagList();
 
-	void read( InputStream &stream, size_t *pBytesRead, bool fullTag );
+	void read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena );
+	void read( const NBTView &view, CArena &arena );
 
 	boost::int8_t getChildrenId() const;
-	boost::int8_t getChildrenCount() const;
+	boost::int32_t getChildrenCount() const;
 };
 
 //////////////////
@@ -327,7 +558,8 @@ public:
 	CTagCompound();
 	~CTagCompound();
 
-	void read( InputStream &stream, size_t *pBytesRead, bool fullTag );
+	void read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena );
+	void read( const NBTView &view, CArena &arena );
 };
 
 //////////////////
@@ -337,14 +569,18 @@ public:
 class CTagIntArray : public CTag
 {
 private:
-	std::vector<boost::int32_t> m_payload;
+	boost::int32_t *m_pPayload;
+	boost::int32_t m_payloadSize;
 public:
-	static void ReadPayload( InputStream &stream, size_t *pBytesRead, boost::int32_t *pSize, boost::int32_t **pInts );
+	static void ReadPayload( InputStream &stream, size_t *pBytesRead, boost::int32_t *pSize, boost::int32_t **pInts, CArena &arena );
 
 	CTagIntArray();
 	~CTagIntArray();
 
-	void read( InputStream &stream, size_t *pBytesRead, bool fullTag );
+	void read( InputStream &stream, size_t *pBytesRead, bool fullTag, CArena &arena );
+	void read( const NBTView &view, CArena &arena );
 
 	std::vector<boost::int32_t> getPayload() const;
+	const boost::int32_t* getData() const;
+	boost::int32_t getSize() const;
 };
@@ -0,0 +1,402 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include "pipeline.h"
+#include "maploader.h"
+#include "renderer.h"
+#include "threadpool.h"
+
+const char* CRegionPipeline::GetStageName( PipelineStage stage )
+{
+	switch( stage )
+	{
+	case STAGE_READ:
+		return "read";
+	case STAGE_INFLATE:
+		return "inflate";
+	case STAGE_PARSE:
+		return "parse";
+	case STAGE_RENDER:
+		return "render";
+	case STAGE_ENCODE:
+		return "encode";
+	default:
+		return "unknown";
+	}
+}
+bool CRegionPipeline::ParseSettings( std::string settingsString, PipelineSettings *pSettings )
+{
+	std::stringstream settingsStream( settingsString );
+	std::string count;
+	unsigned int stage;
+
+	stage = 0;
+	while( std::getline( settingsStream, count, ',' ) )
+	{
+		if( stage >= PIPELINE_STAGE_COUNT || count.empty() || count.find_first_not_of( "0123456789" ) != std::string::npos )
+			return false;
+		pSettings->stageThreads[stage] = std::max( 1, atoi( count.c_str() ) );
+		stage++;
+	}
+	return stage == PIPELINE_STAGE_COUNT;
+}
+PipelineSettings CRegionPipeline::GetDefaultSettings( unsigned int threadCount )
+{
+	PipelineSettings settings;
+
+	// Inflating and writing the images are the heavy stages, reading and drawing are cheap
+	settings.stageThreads[STAGE_READ] = 1;
+	settings.stageThreads[STAGE_INFLATE] = std::max( 1u, threadCount / 3 );
+	settings.stageThreads[STAGE_PARSE] = std::max( 1u, threadCount / 6 );
+	settings.stageThreads[STAGE_RENDER] = std::max( 1u, threadCount / 8 );
+	settings.stageThreads[STAGE_ENCODE] = std::max( 1u, threadCount / 3 );
+
+	return settings;
+}
+
+CRegionPipeline::CRegionPipeline( CMapLoader &mapLoader, PipelineSettings settings )
+	: m_mapLoader( mapLoader ), m_settings( settings ),
+	m_inflateQueue( PIPELINE_QUEUE_LENGTH ), m_parseQueue( PIPELINE_QUEUE_LENGTH ), m_renderQueue( PIPELINE_QUEUE_LENGTH ),
+	m_encodeQueue( settings.stageThreads[STAGE_ENCODE] ),
+	m_freeRenderers( settings.stageThreads[STAGE_RENDER] + settings.stageThreads[STAGE_ENCODE] + 1 )
+{
+	for( unsigned int i = 0; i < PIPELINE_STAGE_COUNT; i++ ) {
+		m_runningThreads[i] = 0;
+		m_busyMicroseconds[i] = 0;
+	}
+	m_failed = false;
+}
+CRegionPipeline::~CRegionPipeline()
+{
+}
+
+bool CRegionPipeline::run()
+{
+	std::vector<std::thread> threads;
+	std::vector<CRenderer*> renderers;
+
+	_ASSERT_EXPR( m_mapLoader.m_pRenderer, L"no renderer" );
+
+	// One renderer for each region that can be in flight, it holds the region image until it has been written
+	for( size_t i = 0; i < m_freeRenderers.getCapacity(); i++ ) {
+		renderers.push_back( m_mapLoader.m_pRenderer->clone() );
+		m_freeRenderers.push( renderers.back() );
+	}
+
+	for( unsigned int i = 0; i < PIPELINE_STAGE_COUNT; i++ )
+		m_runningThreads[i] = m_settings.stageThreads[i];
+	try
+	{
+		for( unsigned int i = 0; i < PIPELINE_STAGE_COUNT; i++ ) {
+			for( unsigned int j = 0; j < m_settings.stageThreads[i]; j++ )
+				threads.push_back( std::thread( &CRegionPipeline::runStage, this, (PipelineStage)i ) );
+		}
+	}
+	catch( const std::system_error &e ) {
+		std::cout << "Failed: could not start pipeline threads (" << e.what() << ")" << std::endl;
+		// Let whatever did start drain out
+		m_failed = true;
+		m_inflateQueue.close();
+		m_parseQueue.close();
+		m_renderQueue.close();
+		m_encodeQueue.close();
+		m_freeRenderers.close();
+	}
+	for( auto it = threads.begin(); it != threads.end(); it++ )
+		(*it).join();
+
+	for( auto it = renderers.begin(); it != renderers.end(); it++ )
+		delete (*it);
+
+	// Show where the time went, so the stage counts can be tuned
+	std::cout << " > Pipeline busy time per thread:";
+	for( unsigned int i = 0; i < PIPELINE_STAGE_COUNT; i++ )
+		std::cout << " " << CRegionPipeline::GetStageName( (PipelineStage)i ) << "=" << (m_busyMicroseconds[i] / 1000000.0) / m_settings.stageThreads[i] << "s";
+	std::cout << std::endl;
+
+	return !m_failed;
+}
+
+void CRegionPipeline::runStage( PipelineStage stage )
+{
+	switch( stage )
+	{
+	case STAGE_READ:
+		this->stageRead();
+		break;
+	case STAGE_INFLATE:
+		this->stageInflate();
+		break;
+	case STAGE_PARSE:
+		this->stageParse();
+		break;
+	case STAGE_RENDER:
+		this->stageRender();
+		break;
+	case STAGE_ENCODE:
+		this->stageEncode();
+		break;
+	default:
+		break;
+	}
+	// The last thread out of a stage tells the next stage nothing more is coming
+	if( --m_runningThreads[stage] == 0 )
+		this->closeOutput( stage );
+}
+void CRegionPipeline::closeOutput( PipelineStage stage )
+{
+	switch( stage )
+	{
+	case STAGE_READ:
+		m_inflateQueue.close();
+		break;
+	case STAGE_INFLATE:
+		m_parseQueue.close();
+		break;
+	case STAGE_PARSE:
+		m_renderQueue.close();
+		break;
+	case STAGE_RENDER:
+		m_encodeQueue.close();
+		break;
+	default:
+		break;
+	}
+}
+
+void CRegionPipeline::stageRead()
+{
+	std::chrono::steady_clock::time_point start;
+
+	for( ;; )
+	{
+		RegionJob *pRegion;
+		CRenderer *pRenderer;
+
+		// Wait for a renderer first, this keeps the reader from getting too far ahead
+		if( m_failed || !m_freeRenderers.pop( &pRenderer ) )
+			break;
+		start = std::chrono::steady_clock::now();
+		{
+			std::lock_guard<std::mutex> queueLock( m_mapLoader.m_regionQueueMutex );
+			if( m_mapLoader.m_regionPaths.empty() ) {
+				m_freeRenderers.push( pRenderer );
+				break;
+			}
+			pRegion = new RegionJob();
+			pRegion->path = m_mapLoader.m_regionPaths.front();
+			m_mapLoader.m_regionPaths.pop();
+		}
+		pRegion->pRenderer = pRenderer;
+
+		{
+			std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+			std::cout << " > Rendering region " << pRegion->path.stem() << " (" << ++m_mapLoader.m_regionsStarted << "/" << m_mapLoader.m_regionCount << ")..." << std::endl;
+		}
+		// Read the whole file here rather than mapping it, so the disk work happens in this stage
+		if( !pRegion->regionFile.open( pRegion->path, false ) ) {
+			std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+			std::cout << " > Failed: could not open region file, skipping region" << std::endl;
+			m_failed = true;
+			m_freeRenderers.push( pRenderer );
+			delete pRegion;
+			break;
+		}
+		pRegion->pRenderer->beginRegion( m_mapLoader.m_mapName, pRegion->path.stem().string() );
+		pRegion->update = m_mapLoader.prepareRegion( pRegion->path, pRegion->regionFile, pRegion->pRenderer, &pRegion->chunks, &pRegion->hashes );
+
+		// Hold one extra count until every chunk is queued, so the region can't finish early
+		pRegion->pendingChunks = 1;
+		for( unsigned int i = 0; i < REGION_CHUNK_COUNT; i++ )
+		{
+			ChunkJob *pChunk;
+
+			if( !pRegion->chunks.test( i ) )
+				continue;
+			// Cached chunks are only a copy, so they don't need to go down the pipeline
+			if( m_mapLoader.loadCachedChunk( pRegion->hashes[i], pRegion->pRenderer ) )
+				continue;
+			pChunk = new ChunkJob();
+			pChunk->pRegion = pRegion;
+			pChunk->index = i;
+			pChunk->pChunkData = 0;
+			pRegion->pendingChunks++;
+			m_busyMicroseconds[STAGE_READ] += std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+			m_inflateQueue.push( pChunk );
+			start = std::chrono::steady_clock::now();
+		}
+		m_busyMicroseconds[STAGE_READ] += std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+		if( --pRegion->pendingChunks == 0 )
+			this->finishRegion( pRegion );
+	}
+}
+void CRegionPipeline::stageInflate()
+{
+	CInflater inflater;
+	ChunkJob *pChunk;
+
+	while( m_inflateQueue.pop( &pChunk ) )
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const char *pCompressedData;
+		size_t compressedLength;
+		unsigned char compression;
+		bool inflated;
+
+		inflated = false;
+		if( !m_failed )
+		{
+			if( !pChunk->pRegion->regionFile.getChunk( pChunk->index, &pCompressedData, &compressedLength, &compression ) ) {
+				std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+				std::cout << " > Skipping chunk" << std::endl;
+			}
+			else if( compression != COMPRESSION_GZIP && compression != COMPRESSION_ZLIB ) {
+				std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+				std::cout << " > Failed: unknown compression type, skipping chunk" << std::endl;
+			}
+			else if( !inflater.inflate( pCompressedData, compressedLength, compression ) || inflater.getLength() == 0 ) {
+				std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+				std::cout << " > Skipping chunk" << std::endl;
+			}
+			else {
+				pChunk->data.assign( inflater.getData(), inflater.getData() + inflater.getLength() );
+				inflated = true;
+			}
+		}
+		m_busyMicroseconds[STAGE_INFLATE] += std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+
+		if( inflated )
+			m_parseQueue.push( pChunk );
+		else
+			this->finishChunk( pChunk );
+	}
+}
+void CRegionPipeline::stageParse()
+{
+	CNBTReader chunkReader;
+	ChunkJob *pChunk;
+
+	while( m_parseQueue.pop( &pChunk ) )
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		if( !m_failed )
+		{
+			chunkReader.deleteTags();
+			if( !chunkReader.read( &pChunk->data[0], pChunk->data.size(), &m_mapLoader.m_chunkProjection ) ) {
+				std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+				std::cout << " > Failed: could not read chunk data, skipping chunk" << std::endl;
+			}
+			else {
+				pChunk->pChunkData = m_mapLoader.parseChunkData( chunkReader );
+				// Same as the other paths, a chunk that can't be parsed stops the render
+				if( !pChunk->pChunkData )
+					m_failed = true;
+			}
+		}
+		// The decompressed data isn't needed past this point
+		std::vector<char>().swap( pChunk->data );
+		m_busyMicroseconds[STAGE_PARSE] += std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+
+		if( pChunk->pChunkData )
+			m_renderQueue.push( pChunk );
+		else
+			this->finishChunk( pChunk );
+	}
+}
+void CRegionPipeline::stageRender()
+{
+	ChunkJob *chunks[PIPELINE_RENDER_BATCH];
+	ChunkData *chunkData[PIPELINE_RENDER_BATCH];
+	size_t count;
+
+	// Take whatever has queued up, so the renderer gets it in one batch instead of a call per chunk
+	while( (count = m_renderQueue.popBatch( chunks, PIPELINE_RENDER_BATCH )) != 0 )
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		// Chunks only touch their own tile, so any number of threads can draw into the same region
+		// A batch can span regions, each run of chunks from the same region goes to its renderer together
+		if( !m_failed ) {
+			for( size_t first = 0, last; first < count; first = last ) {
+				RegionJob *pRegion = chunks[first]->pRegion;
+
+				for( last = first; last < count && chunks[last]->pRegion == pRegion; last++ )
+					chunkData[last - first] = chunks[last]->pChunkData;
+				pRegion->pRenderer->renderChunks( chunkData, last - first, m_mapLoader.m_pBlockColors );
+			}
+			for( size_t i = 0; i < count; i++ )
+				m_mapLoader.storeCachedChunk( chunks[i]->pRegion->hashes[chunks[i]->index], chunks[i]->pChunkData, chunks[i]->pRegion->pRenderer );
+		}
+		m_busyMicroseconds[STAGE_RENDER] += std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+
+		for( size_t i = 0; i < count; i++ )
+			this->finishChunk( chunks[i] );
+	}
+}
+void CRegionPipeline::stageEncode()
+{
+	RegionJob *pRegion;
+
+	while( m_encodeQueue.pop( &pRegion ) )
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		if( !m_failed )
+			m_mapLoader.completeRegion( pRegion->path, pRegion->pRenderer, pRegion->update, pRegion->hashes );
+		m_busyMicroseconds[STAGE_ENCODE] += std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+
+		if( !m_failed )
+		{
+			m_mapLoader.m_regionsRendered++;
+			std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+			std::cout << " > Finished region " << pRegion->path.stem() << " (" << CRenderCache::DescribeUpdate( pRegion->update, pRegion->chunks ) << "t=" << pRegion->renderTimer.elapsed() << "s)" << std::endl;
+		}
+		// Hand the renderer back so the reader can start on another region
+		m_freeRenderers.push( pRegion->pRenderer );
+		delete pRegion;
+	}
+}
+
+void CRegionPipeline::finishChunk( ChunkJob *pChunk )
+{
+	RegionJob *pRegion = pChunk->pRegion;
+
+	if( pChunk->pChunkData )
+		delete pChunk->pChunkData;
+	delete pChunk;
+	if( --pRegion->pendingChunks == 0 )
+		this->finishRegion( pRegion );
+}
+void CRegionPipeline::finishRegion( RegionJob *pRegion )
+{
+	// All chunks are drawn, the file isn't needed while the images are written
+	pRegion->regionFile.close();
+	m_encodeQueue.push( pRegion );
+}
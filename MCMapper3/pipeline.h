@@ -0,0 +1,131 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <boost\filesystem.hpp>
+#include <boost\timer.hpp>
+#include <atomic>
+#include <vector>
+#include <string>
+#include "boundedqueue.h"
+#include "region.h"
+#include "rendercache.h"
+
+#define PIPELINE_QUEUE_LENGTH 256
+// Most chunks the render stage takes off its queue at once
+#define PIPELINE_RENDER_BATCH 32
+
+enum PipelineStage : unsigned int
+{
+	STAGE_READ		= 0,
+	STAGE_INFLATE	= 1,
+	STAGE_PARSE		= 2,
+	STAGE_RENDER	= 3,
+	STAGE_ENCODE	= 4,
+	PIPELINE_STAGE_COUNT
+};
+
+struct PipelineSettings
+{
+	unsigned int stageThreads[PIPELINE_STAGE_COUNT];
+};
+
+class CMapLoader;
+class CRenderer;
+struct ChunkData;
+
+/*
+	Renders regions as a chain of stages connected by bounded queues
+	Each stage has its own threads, so reading, decoding and writing images of different regions overlap
+*/
+class CRegionPipeline
+{
+private:
+	struct RegionJob
+	{
+		boost::filesystem::path path;
+		CRegionFile regionFile;
+		CRenderer *pRenderer;
+		RegionUpdate update;
+		ChunkSet chunks;
+		ChunkHashes hashes;
+		std::atomic<unsigned int> pendingChunks;
+		boost::timer renderTimer;
+	};
+	struct ChunkJob
+	{
+		RegionJob *pRegion;
+		unsigned int index;
+		std::vector<char> data;
+		ChunkData *pChunkData;
+	};
+
+	CMapLoader &m_mapLoader;
+	PipelineSettings m_settings;
+
+	CBoundedQueue<ChunkJob*> m_inflateQueue;
+	CBoundedQueue<ChunkJob*> m_parseQueue;
+	CBoundedQueue<ChunkJob*> m_renderQueue;
+	CBoundedQueue<RegionJob*> m_encodeQueue;
+	// Renderers not in use by a region, taking one is what limits how many regions are in flight
+	CBoundedQueue<CRenderer*> m_freeRenderers;
+
+	std::atomic<unsigned int> m_runningThreads[PIPELINE_STAGE_COUNT];
+	std::atomic<long long> m_busyMicroseconds[PIPELINE_STAGE_COUNT];
+	std::atomic<bool> m_failed;
+
+	void runStage( PipelineStage stage );
+	void stageRead();
+	void stageInflate();
+	void stageParse();
+	void stageRender();
+	void stageEncode();
+	void closeOutput( PipelineStage stage );
+
+	void finishChunk( ChunkJob *pChunk );
+	void finishRegion( RegionJob *pRegion );
+public:
+	static const char* GetStageName( PipelineStage stage );
+	/*
+		@method: ParseSettings
+		@returns: if the string was valid
+		Reads per stage thread counts in the form read,inflate,parse,render,encode
+	*/
+	static bool ParseSettings( std::string settingsString, PipelineSettings *pSettings );
+	static PipelineSettings GetDefaultSettings( unsigned int threadCount );
+
+	CRegionPipeline( CMapLoader &mapLoader, PipelineSettings settings );
+	~CRegionPipeline();
+
+	CRegionPipeline( CRegionPipeline const& ) = delete;
+	void operator=( CRegionPipeline const& ) = delete;
+
+	/*
+		@method: run
+		@returns: if every region was rendered successfully
+		Renders all the regions queued in the map loader, blocks until done
+	*/
+	bool run();
+};
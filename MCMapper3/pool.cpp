@@ -0,0 +1,71 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+#include <new>
+#include "pool.h"
+
+CBlockPool::CBlockPool( size_t blockSize, size_t maxFree ) {
+	m_blockSize = blockSize;
+	m_maxFree = maxFree;
+}
+CBlockPool::~CBlockPool()
+{
+	for( size_t i = 0; i < m_freeBlocks.size(); i++ )
+		::operator delete( m_freeBlocks[i] );
+	m_freeBlocks.clear();
+}
+
+void* CBlockPool::allocate( size_t size )
+{
+	void *pBlock;
+
+	_ASSERT_EXPR( size <= m_blockSize, L"allocation is larger than the pool's blocks" );
+	{
+		std::lock_guard<std::mutex> poolLock( m_poolMutex );
+		if( !m_freeBlocks.empty() ) {
+			pBlock = m_freeBlocks.back();
+			m_freeBlocks.pop_back();
+			return pBlock;
+		}
+	}
+	return ::operator new( m_blockSize );
+}
+void CBlockPool::free( void *pBlock )
+{
+	if( !pBlock )
+		return;
+	{
+		std::lock_guard<std::mutex> poolLock( m_poolMutex );
+		if( m_freeBlocks.size() < m_maxFree ) {
+			m_freeBlocks.push_back( pBlock );
+			return;
+		}
+	}
+	::operator delete( pBlock );
+}
+
+size_t CBlockPool::getFreeCount()
+{
+	std::lock_guard<std::mutex> poolLock( m_poolMutex );
+	return m_freeBlocks.size();
+}
\ No newline at end of file
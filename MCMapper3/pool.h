@@ -0,0 +1,68 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <cstddef>
+
+////////////////
+// CBlockPool //
+////////////////
+
+/*
+	A free list of equally sized blocks, for records that are made and freed for every chunk
+	Freed blocks are kept, up to maxFree of them, and handed out again so a warm pool never goes to the heap
+	Blocks can be freed on another thread than the one that allocated them
+*/
+class CBlockPool
+{
+private:
+	size_t m_blockSize;
+	size_t m_maxFree;
+
+	std::mutex m_poolMutex;
+	std::vector<void*> m_freeBlocks;
+public:
+	CBlockPool( size_t blockSize, size_t maxFree );
+	~CBlockPool();
+
+	CBlockPool( CBlockPool const& ) = delete;
+	void operator=( CBlockPool const& ) = delete;
+
+	/*
+		@method: allocate
+		@returns: A block of at least size bytes, uninitialized
+		size may not be larger than the pool's block size
+	*/
+	void* allocate( size_t size );
+	/*
+		@method: free
+		@returns: none
+		Gives a block from allocate back, null is ignored
+	*/
+	void free( void *pBlock );
+
+	size_t getFreeCount();
+};
\ No newline at end of file
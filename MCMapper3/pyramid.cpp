@@ -0,0 +1,249 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <climits>
+#include <boost\filesystem\fstream.hpp>
+#include "pyramid.h"
+#include "renderer.h"
+#include "threadpool.h"
+#include "tilewriter.h"
+#include "encoder.h"
+
+// Matches the background of region images, so tiles with missing regions blend in
+static const boost::gil::rgb8_pixel_t BlankPixel( 200, 200, 200 );
+
+// Floors towards negative infinity, unlike /, so that regions -1 and 0 end up in different tiles
+static inline int FloorHalf( int value ) {
+	return value >> 1;
+}
+
+void CTilePyramid::DownsampleInto( const boost::gil::rgb8_image_t::const_view_t &source, const boost::gil::rgb8_image_t::view_t &destination )
+{
+	_ASSERT_EXPR( source.width() == destination.width()*2 && source.height() == destination.height()*2, L"destination must be half the size of source" );
+
+	for( int z = 0; z < (int)destination.height(); z++ )
+	{
+		const unsigned char *pTop = reinterpret_cast<const unsigned char*>(&source( 0, z*2 ));
+		const unsigned char *pBottom = reinterpret_cast<const unsigned char*>(&source( 0, z*2 + 1 ));
+		unsigned char *pOut = reinterpret_cast<unsigned char*>(&destination( 0, z ));
+
+		for( int x = 0; x < (int)destination.width()*3; x += 3 ) {
+			for( int c = 0; c < 3; c++ )
+				pOut[x + c] = (unsigned char)((pTop[x*2 + c] + pTop[x*2 + 3 + c] + pBottom[x*2 + c] + pBottom[x*2 + 3 + c] + 2) >> 2);
+		}
+	}
+}
+std::string CTilePyramid::GetTileName( int x, int z, ImageFormat format ) {
+	return "t." + std::to_string( x ) + "." + std::to_string( z ) + CImageEncoder::GetExtension( format );
+}
+
+unsigned int CTilePyramid::CountLevels( int minRegionX, int maxRegionX, int minRegionZ, int maxRegionZ )
+{
+	unsigned int levelCount;
+
+	// Same steps as build, every level halves the coordinates until they fit
+	for( levelCount = 1; levelCount < PYRAMID_MAX_LEVELS; levelCount++ ) {
+		minRegionX = FloorHalf( minRegionX );
+		maxRegionX = FloorHalf( maxRegionX );
+		minRegionZ = FloorHalf( minRegionZ );
+		maxRegionZ = FloorHalf( maxRegionZ );
+		if( maxRegionX - minRegionX < PYRAMID_TOP_LENGTH && maxRegionZ - minRegionZ < PYRAMID_TOP_LENGTH )
+			break;
+	}
+	return levelCount;
+}
+std::string CTilePyramid::GetViewerInfo( unsigned int zoomOutLevels, unsigned int zoomInLevels, ImageFormat format ) {
+	return "var mapTiles = { zoomOutLevels: " + std::to_string( zoomOutLevels ) + ", zoomInLevels: " + std::to_string( zoomInLevels ) +
+		", extension: \"" + CImageEncoder::GetExtension( format ) + "\" };\n";
+}
+
+CTilePyramid::CTilePyramid() {
+	m_pTileWriter = 0;
+	m_format = IMAGE_FORMAT_JPEG;
+	m_compressionLevel = PNG_DEFAULT_LEVEL;
+	m_levelCount = 0;
+}
+CTilePyramid::~CTilePyramid() {
+}
+
+void CTilePyramid::begin( boost::filesystem::path outputPath, CTileWriter *pTileWriter )
+{
+	std::lock_guard<std::mutex> tilesLock( m_tilesMutex );
+
+	m_outputPath = outputPath;
+	m_pTileWriter = pTileWriter;
+	m_tiles.clear();
+	m_levelCount = 0;
+}
+void CTilePyramid::setFormat( ImageFormat format, int compressionLevel ) {
+	m_format = format;
+	m_compressionLevel = compressionLevel;
+}
+
+boost::gil::rgb8_image_t& CTilePyramid::getTile( TileMap &tiles, int x, int z )
+{
+	TileMap::iterator it;
+
+	it = tiles.find( TileKey( x, z ) );
+	if( it == tiles.end() ) {
+		it = tiles.insert( std::make_pair( TileKey( x, z ), boost::gil::rgb8_image_t() ) ).first;
+		if( !m_spareTiles.empty() ) {
+			it->second.swap( m_spareTiles.back() );
+			m_spareTiles.pop_back();
+		}
+		else
+			it->second = boost::gil::rgb8_image_t( REGION_PIXEL_LENGTH, REGION_PIXEL_LENGTH );
+		boost::gil::fill_pixels( boost::gil::view( it->second ), BlankPixel );
+	}
+	return it->second;
+}
+void CTilePyramid::addRegion( int regionX, int regionZ, const boost::gil::rgb8_image_t &regionImage )
+{
+	boost::gil::rgb8_image_t *pTile;
+	const int half = REGION_PIXEL_LENGTH / 2;
+
+	{
+		std::lock_guard<std::mutex> tilesLock( m_tilesMutex );
+		pTile = &this->getTile( m_tiles, FloorHalf( regionX ), FloorHalf( regionZ ) );
+	}
+	// Map nodes don't move and every region has its own quarter, so the copy can happen outside the lock
+	CTilePyramid::DownsampleInto( boost::gil::const_view( regionImage ),
+		boost::gil::subimage_view( boost::gil::view( *pTile ), (regionX & 1)*half, (regionZ & 1)*half, half, half ) );
+}
+
+bool CTilePyramid::writeLevel( TileMap &tiles, int level, unsigned int threadCount )
+{
+	boost::filesystem::path levelPath;
+	std::vector<TileMap::value_type*> tileList;
+	std::vector<CImageEncoder> encoders;
+	CThreadPool threadPool;
+	std::atomic<bool> failed;
+
+	_ASSERT_EXPR( m_pTileWriter, L"no tile writer" );
+
+	levelPath = m_outputPath / std::to_string( level );
+	if( !m_pTileWriter->ensureDirectory( levelPath ) ) {
+		std::cout << " > Failed: could not create directory for images" << std::endl;
+		return false;
+	}
+
+	for( TileMap::iterator it = tiles.begin(); it != tiles.end(); it++ )
+		tileList.push_back( &(*it) );
+	threadCount = std::max( 1u, std::min( threadCount, (unsigned int)tileList.size() ) );
+	// One encoder for each worker and one for this thread, which takes the last index
+	encoders = std::vector<CImageEncoder>( threadCount + 1 );
+	for( size_t i = 0; i < encoders.size(); i++ )
+		encoders[i].setFormat( m_format, m_compressionLevel );
+	failed = false;
+	auto writeTile = [&]( size_t index, unsigned int workerIndex ) {
+		std::vector<unsigned char> data;
+		if( !encoders[workerIndex].encode( boost::gil::const_view( tileList[index]->second ), &data ) ||
+			!m_pTileWriter->write( levelPath / CTilePyramid::GetTileName( tileList[index]->first.first, tileList[index]->first.second, m_format ), std::move( data ) ) )
+			failed = true;
+	};
+	// Encoding is most of the work, spread the tiles across threads when there are enough of them
+	if( threadCount > 1 && threadPool.start( threadCount ) ) {
+		threadPool.parallelFor( tileList.size(), threadCount, writeTile );
+		threadPool.stop();
+	}
+	else {
+		for( size_t i = 0; i < tileList.size(); i++ )
+			writeTile( i, threadCount );
+	}
+	if( failed ) {
+		std::cout << " > Failed: could not write zoomed out tiles for level " << level << std::endl;
+		return false;
+	}
+
+	return true;
+}
+bool CTilePyramid::build( unsigned int threadCount )
+{
+	TileMap parents;
+	int minX, maxX, minZ, maxZ;
+	const int half = REGION_PIXEL_LENGTH / 2;
+
+	std::lock_guard<std::mutex> tilesLock( m_tilesMutex );
+
+	m_levelCount = 0;
+	if( m_tiles.empty() )
+		return true;
+
+	for( int level = -1; level >= -PYRAMID_MAX_LEVELS; level-- )
+	{
+		if( !this->writeLevel( m_tiles, level, threadCount ) )
+			return false;
+		m_levelCount++;
+
+		// Done once the whole level fits on screen
+		minX = minZ = INT_MAX;
+		maxX = maxZ = INT_MIN;
+		for( TileMap::iterator it = m_tiles.begin(); it != m_tiles.end(); it++ ) {
+			minX = std::min( minX, it->first.first );
+			maxX = std::max( maxX, it->first.first );
+			minZ = std::min( minZ, it->first.second );
+			maxZ = std::max( maxZ, it->first.second );
+		}
+		if( maxX - minX < PYRAMID_TOP_LENGTH && maxZ - minZ < PYRAMID_TOP_LENGTH )
+			break;
+
+		// Build the next level up, each child's image is reused once it is in its parent
+		parents.clear();
+		for( TileMap::iterator it = m_tiles.begin(); it != m_tiles.end(); it = m_tiles.erase( it ) ) {
+			boost::gil::rgb8_image_t &parent = this->getTile( parents, FloorHalf( it->first.first ), FloorHalf( it->first.second ) );
+			CTilePyramid::DownsampleInto( boost::gil::const_view( it->second ),
+				boost::gil::subimage_view( boost::gil::view( parent ), (it->first.first & 1)*half, (it->first.second & 1)*half, half, half ) );
+			m_spareTiles.push_back( boost::gil::rgb8_image_t() );
+			m_spareTiles.back().swap( it->second );
+		}
+		m_tiles.swap( parents );
+	}
+	m_tiles.clear();
+	m_spareTiles.clear();
+
+	return true;
+}
+
+bool CTilePyramid::writeViewerInfo( unsigned int zoomInLevels )
+{
+	boost::filesystem::ofstream infoFile;
+
+	infoFile.open( m_outputPath / "tiles.js", std::ios::out | std::ios::trunc );
+	if( !infoFile.is_open() ) {
+		std::cout << " > Failed: could not write tiles.js" << std::endl;
+		return false;
+	}
+	infoFile << CTilePyramid::GetViewerInfo( m_levelCount, zoomInLevels, m_format );
+	infoFile.close();
+
+	return true;
+}
+
+unsigned int CTilePyramid::getLevelCount() const {
+	return m_levelCount;
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <boost\filesystem.hpp>
+#include <boost\gil\gil_all.hpp>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include "encoder.h"
+
+class CTileWriter;
+
+// Stop once a level fits in this many tiles across, the viewer can show the whole world from there
+#define PYRAMID_TOP_LENGTH 2
+#define PYRAMID_MAX_LEVELS 16
+
+/*
+	Builds the zoomed out levels of the map as a quadtree, each tile is its four children box filtered down to half size
+	Level -1 is filled in as regions finish, the rest are built bottom up once the whole world is rendered
+	Tiles at level -k are written to [output]/-k/t.X.Z.[extension] and cover 2^k by 2^k regions
+*/
+class CTilePyramid
+{
+private:
+	typedef std::pair<int, int> TileKey;
+	typedef std::map<TileKey, boost::gil::rgb8_image_t> TileMap;
+
+	boost::filesystem::path m_outputPath;
+	CTileWriter *m_pTileWriter;
+	ImageFormat m_format;
+	int m_compressionLevel;
+	// Tiles of the lowest level still waiting to be built, only ever added to while regions are rendering
+	// This is the one thing that grows with the map, a 768KB image for every 2x2 regions until build
+	TileMap m_tiles;
+	// Images of children already merged into their parent, reused for the next parents
+	// A deque so adding one never copies the others
+	std::deque<boost::gil::rgb8_image_t> m_spareTiles;
+	std::mutex m_tilesMutex;
+	unsigned int m_levelCount;
+
+	boost::gil::rgb8_image_t& getTile( TileMap &tiles, int x, int z );
+	bool writeLevel( TileMap &tiles, int level, unsigned int threadCount );
+public:
+	/*
+		@method: DownsampleInto
+		@returns: none
+		Averages each 2x2 block of source into one pixel of destination, which must be half the size
+	*/
+	static void DownsampleInto( const boost::gil::rgb8_image_t::const_view_t &source, const boost::gil::rgb8_image_t::view_t &destination );
+	static std::string GetTileName( int x, int z, ImageFormat format );
+	/*
+		@method: CountLevels
+		@returns: how many zoomed out levels a world with regions in the given bounds gets
+	*/
+	static unsigned int CountLevels( int minRegionX, int maxRegionX, int minRegionZ, int maxRegionZ );
+	/*
+		@method: GetViewerInfo
+		@returns: the contents of tiles.js
+	*/
+	static std::string GetViewerInfo( unsigned int zoomOutLevels, unsigned int zoomInLevels, ImageFormat format );
+
+	CTilePyramid();
+	~CTilePyramid();
+
+	CTilePyramid( CTilePyramid const& ) = delete;
+	void operator=( CTilePyramid const& ) = delete;
+
+	/*
+		@method: begin
+		@returns: none
+		Drops any tiles from a previous map and sets where and how the levels are written
+	*/
+	void begin( boost::filesystem::path outputPath, CTileWriter *pTileWriter );
+	/*
+		@method: setFormat
+		@returns: none
+		Sets how tiles are encoded, should match the renderer so the viewer finds every level
+	*/
+	void setFormat( ImageFormat format, int compressionLevel );
+	/*
+		@method: addRegion
+		@returns: none
+		Downsamples a finished region image into its quarter of the level -1 tile
+		The tile is made the first time one of its regions comes in and kept until build, so memory grows with the map
+		Safe to call from several threads at once for different regions
+	*/
+	void addRegion( int regionX, int regionZ, const boost::gil::rgb8_image_t &regionImage );
+	/*
+		@method: build
+		@returns: if every tile was written
+		Writes level -1, then builds and writes each level above it until the world fits in PYRAMID_TOP_LENGTH tiles
+		Tiles of a level are written on up to threadCount threads
+	*/
+	bool build( unsigned int threadCount );
+	/*
+		@method: writeViewerInfo
+		@returns: if the file was written
+		Writes tiles.js next to the levels so the viewer knows how far it can zoom out and in
+	*/
+	bool writeViewerInfo( unsigned int zoomInLevels );
+	/*
+		@method: getLevelCount
+		@returns: how many zoomed out levels the last build wrote
+	*/
+	unsigned int getLevelCount() const;
+};
\ No newline at end of file
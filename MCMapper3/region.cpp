@@ -0,0 +1,203 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <boost\endian\conversion.hpp>
+#include <boost\filesystem\fstream.hpp>
+#include "region.h"
+#include "threadpool.h"
+
+CRegionFile::CRegionFile()
+{
+	m_pData = 0;
+	m_length = 0;
+	memset( &m_header, 0, sizeof( m_header ) );
+}
+CRegionFile::~CRegionFile()
+{
+	this->close();
+}
+
+bool CRegionFile::ParseName( const std::string &name, int *pX, int *pZ )
+{
+	int x, z;
+	char end;
+
+	// The trailing %c only matches if something follows the coordinates
+	if( sscanf( name.c_str(), "r.%d.%d%c", &x, &z, &end ) != 2 )
+		return false;
+	*pX = x;
+	*pZ = z;
+	return true;
+}
+
+bool CRegionFile::open( boost::filesystem::path fullPath, bool mapFile )
+{
+	this->close();
+
+	if( !boost::filesystem::is_regular_file( fullPath ) ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: could not open region file" << std::endl;
+		return false;
+	}
+
+	// Map the whole file, the chunks are then read straight out of the page cache
+	if( mapFile )
+	{
+		try
+		{
+			m_mappedFile.open( fullPath.string() );
+			if( m_mappedFile.is_open() ) {
+				m_pData = m_mappedFile.data();
+				m_length = m_mappedFile.size();
+			}
+		}
+		catch( const std::exception& ) {
+			// Empty files and some file systems cannot be mapped
+			if( m_mappedFile.is_open() )
+				m_mappedFile.close();
+		}
+	}
+	// Otherwise fall back to reading the file in one go
+	if( !m_mappedFile.is_open() )
+	{
+		boost::filesystem::ifstream inputStream;
+		boost::uintmax_t fileSize;
+
+		fileSize = boost::filesystem::file_size( fullPath );
+		inputStream.open( fullPath, std::ios::in | std::ios::binary );
+		if( !inputStream.is_open() ) {
+			std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+			std::cout << " > Failed: could not open region file" << std::endl;
+			return false;
+		}
+		m_fileData.resize( (size_t)fileSize );
+		if( fileSize > 0 )
+			inputStream.read( &m_fileData[0], fileSize );
+		if( !inputStream ) {
+			std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+			std::cout << " > Failed: could not read region file" << std::endl;
+			this->close();
+			return false;
+		}
+		m_pData = m_fileData.empty() ? 0 : &m_fileData[0];
+		m_length = m_fileData.size();
+	}
+
+	if( !this->parseHeader() ) {
+		this->close();
+		return false;
+	}
+
+	return true;
+}
+void CRegionFile::close()
+{
+	if( m_mappedFile.is_open() )
+		m_mappedFile.close();
+	m_fileData.clear();
+	m_fileData.shrink_to_fit();
+	m_pData = 0;
+	m_length = 0;
+}
+
+bool CRegionFile::parseHeader()
+{
+	const unsigned char *pLocations, *pTimestamps;
+
+	// Header is two sectors, locations then timestamps
+	if( m_length < REGION_SECTOR_SIZE*2 ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: region file header was truncated" << std::endl;
+		return false;
+	}
+
+	// Location table is a 3 byte big endian sector offset and a 1 byte sector count, followed by the big endian timestamps
+	pLocations = reinterpret_cast<const unsigned char*>(m_pData);
+	pTimestamps = pLocations + REGION_CHUNK_COUNT*4;
+	for( unsigned int i = 0; i < REGION_CHUNK_COUNT; i++ )
+	{
+		m_header.locations[i].offset = pLocations[i*4+2] + (pLocations[i*4+1] << 8) + (pLocations[i*4] << 16);
+		m_header.locations[i].sectorCount = pLocations[i*4+3];
+		// Widened first, shifting a high byte into the sign bit of an int is undefined
+		m_header.timestamps[i] = (boost::int32_t)(((boost::uint32_t)pTimestamps[i*4] << 24) | ((boost::uint32_t)pTimestamps[i*4+1] << 16) |
+			((boost::uint32_t)pTimestamps[i*4+2] << 8) | (boost::uint32_t)pTimestamps[i*4+3]);
+	}
+
+	return true;
+}
+
+bool CRegionFile::hasChunk( unsigned int index ) const
+{
+	_ASSERT_EXPR( index < REGION_CHUNK_COUNT, L"chunk index out of range" );
+	return m_header.locations[index].sectorCount != 0;
+}
+bool CRegionFile::getChunk( unsigned int index, const char **ppData, size_t *pLength, unsigned char *pCompression ) const
+{
+	size_t chunkStart;
+	boost::int32_t chunkLength;
+
+	_ASSERT_EXPR( index < REGION_CHUNK_COUNT, L"chunk index out of range" );
+
+	if( !this->hasChunk( index ) )
+		return false;
+	chunkStart = (size_t)m_header.locations[index].offset * REGION_SECTOR_SIZE;
+	if( chunkStart + 5 > m_length ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: chunk is past the end of the region file" << std::endl;
+		return false;
+	}
+	// 4 byte big endian length including the compression byte
+	memcpy( &chunkLength, m_pData + chunkStart, sizeof( boost::int32_t ) );
+	chunkLength = boost::endian::big_to_native( chunkLength );
+	if( chunkLength <= 1 ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: found empty chunk" << std::endl;
+		return false;
+	}
+	if( chunkStart + 4 + (size_t)chunkLength > m_length ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: chunk is past the end of the region file" << std::endl;
+		return false;
+	}
+	(*pCompression) = (unsigned char)m_pData[chunkStart+4];
+	(*ppData) = m_pData + chunkStart + 5;
+	(*pLength) = (size_t)chunkLength - 1;
+
+	return true;
+}
+boost::int32_t CRegionFile::getTimestamp( unsigned int index ) const
+{
+	_ASSERT_EXPR( index < REGION_CHUNK_COUNT, L"chunk index out of range" );
+	return m_header.timestamps[index];
+}
+
+const RegionHeader& CRegionFile::getHeader() const {
+	return m_header;
+}
+bool CRegionFile::isMapped() const {
+	return m_mappedFile.is_open();
+}
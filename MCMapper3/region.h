@@ -0,0 +1,106 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <boost\filesystem.hpp>
+#include <boost\iostreams\device\mapped_file.hpp>
+#include <vector>
+#include <string>
+
+#define REGION_CHUNK_COUNT 1024
+#define REGION_SECTOR_SIZE 4096
+
+#pragma pack(push, 1)
+struct ChunkLocation
+{
+	boost::int32_t offset;
+	unsigned char sectorCount;
+};
+struct RegionHeader
+{
+	ChunkLocation locations[REGION_CHUNK_COUNT];
+	boost::int32_t timestamps[REGION_CHUNK_COUNT];
+};
+#pragma pack(pop)
+
+/*
+	Gives direct access to the chunks of a .mca file
+	The file is memory mapped if possible, otherwise it is read in whole with a single read
+*/
+class CRegionFile
+{
+private:
+	boost::iostreams::mapped_file_source m_mappedFile;
+	std::vector<char> m_fileData;
+
+	const char *m_pData;
+	size_t m_length;
+
+	RegionHeader m_header;
+
+	bool parseHeader();
+public:
+	CRegionFile();
+	~CRegionFile();
+
+	CRegionFile( CRegionFile const& ) = delete;
+	void operator=( CRegionFile const& ) = delete;
+
+	/*
+		@method: ParseName
+		@returns: if name is in the form r.X.Z
+		Reads the region coordinates out of a region file name without its extension
+	*/
+	static bool ParseName( const std::string &name, int *pX, int *pZ );
+
+	/*
+		@method: open
+		@returns: if the file was opened and its header was read
+		Closes any file that was already open, if mapFile is false the whole file is read into memory up front
+	*/
+	bool open( boost::filesystem::path fullPath, bool mapFile = true );
+	/*
+		@method: close
+		@returns: none
+		Unmaps the file, chunk pointers are no longer valid after this
+	*/
+	void close();
+
+	/*
+		@method: hasChunk
+		@returns: if the region contains the chunk at index
+	*/
+	bool hasChunk( unsigned int index ) const;
+	/*
+		@method: getChunk
+		@returns: if the chunk was found and is within the file
+		Points ppData at the compressed chunk data, valid until the file is closed
+	*/
+	bool getChunk( unsigned int index, const char **ppData, size_t *pLength, unsigned char *pCompression ) const;
+	boost::int32_t getTimestamp( unsigned int index ) const;
+
+	const RegionHeader& getHeader() const;
+	bool isMapped() const;
+};
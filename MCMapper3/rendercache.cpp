@@ -0,0 +1,383 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include <iostream>
+#include <cstring>
+#include <climits>
+#include <zlib.h>
+#include <boost\filesystem\fstream.hpp>
+#include "rendercache.h"
+
+static const char ManifestMagic[4] = { 'M', 'C', 'R', 'M' };
+static const char DataMagic[4] = { 'M', 'C', 'R', 'D' };
+
+#pragma pack(push, 1)
+struct CacheDataHeader
+{
+	char magic[4];
+	boost::uint32_t version;
+	boost::uint64_t length;
+};
+#pragma pack(pop)
+
+CCacheDataFile::CCacheDataFile()
+{
+	memset( &m_deflater, 0, sizeof( m_deflater ) );
+	memset( &m_inflater, 0, sizeof( m_inflater ) );
+	m_deflaterReady = false;
+	m_inflaterReady = false;
+}
+CCacheDataFile::~CCacheDataFile()
+{
+	if( m_deflaterReady )
+		deflateEnd( &m_deflater );
+	if( m_inflaterReady )
+		inflateEnd( &m_inflater );
+}
+
+bool CCacheDataFile::write( const boost::filesystem::path &path, const CacheDataPart *pParts, size_t partCount )
+{
+	boost::filesystem::path tempPath;
+	boost::filesystem::ofstream file;
+	size_t totalLength, compressedLength;
+	uLong bound;
+	CacheDataHeader header;
+	boost::system::error_code error;
+
+	// Fastest level, most of this is flat color and compresses well anyway
+	if( !m_deflaterReady ) {
+		if( deflateInit( &m_deflater, 1 ) != Z_OK )
+			return false;
+		m_deflaterReady = true;
+	}
+	else if( deflateReset( &m_deflater ) != Z_OK )
+		return false;
+
+	totalLength = 0;
+	for( size_t i = 0; i < partCount; i++ )
+		totalLength += pParts[i].length;
+	// Room for the worst case, so the whole file is compressed in one go
+	bound = deflateBound( &m_deflater, (uLong)totalLength );
+	if( m_compressed.size() < bound )
+		m_compressed.resize( bound );
+	m_deflater.next_out = m_compressed.data();
+	m_deflater.avail_out = (uInt)bound;
+	for( size_t i = 0; i < partCount; i++ ) {
+		m_deflater.next_in = reinterpret_cast<Bytef*>(const_cast<void*>(pParts[i].pData));
+		m_deflater.avail_in = (uInt)pParts[i].length;
+		if( m_deflater.avail_in != 0 && (deflate( &m_deflater, Z_NO_FLUSH ) != Z_OK || m_deflater.avail_in != 0) )
+			return false;
+	}
+	if( deflate( &m_deflater, Z_FINISH ) != Z_STREAM_END )
+		return false;
+	compressedLength = bound - m_deflater.avail_out;
+
+	memcpy( header.magic, DataMagic, sizeof( header.magic ) );
+	header.version = RENDERCACHE_VERSION;
+	header.length = totalLength;
+	// Written beside it and renamed, so a run that stops half way never leaves a broken file behind
+	tempPath = path;
+	tempPath += ".tmp";
+	file.open( tempPath, std::ios::out | std::ios::binary | std::ios::trunc );
+	if( !file.is_open() )
+		return false;
+	file.write( reinterpret_cast<const char*>(&header), sizeof( header ) );
+	file.write( reinterpret_cast<const char*>(m_compressed.data()), (std::streamsize)compressedLength );
+	file.close();
+	if( file.fail() )
+		return false;
+	boost::filesystem::rename( tempPath, path, error );
+	return !error;
+}
+bool CCacheDataFile::read( const boost::filesystem::path &path, const CacheDataTarget *pTargets, size_t targetCount )
+{
+	boost::filesystem::ifstream file;
+	boost::uintmax_t fileSize;
+	size_t totalLength, compressedLength;
+	CacheDataHeader header;
+	unsigned char extra;
+	int result;
+	boost::system::error_code error;
+
+	totalLength = 0;
+	for( size_t i = 0; i < targetCount; i++ )
+		totalLength += pTargets[i].length;
+
+	fileSize = boost::filesystem::file_size( path, error );
+	if( error || fileSize < sizeof( header ) )
+		return false;
+	file.open( path, std::ios::in | std::ios::binary );
+	if( !file.is_open() )
+		return false;
+	file.read( reinterpret_cast<char*>(&header), sizeof( header ) );
+	if( file.fail() || memcmp( header.magic, DataMagic, sizeof( header.magic ) ) != 0 || header.version != RENDERCACHE_VERSION || header.length != totalLength )
+		return false;
+	compressedLength = (size_t)(fileSize - sizeof( header ));
+	if( m_compressed.size() < compressedLength )
+		m_compressed.resize( compressedLength );
+	file.read( reinterpret_cast<char*>(m_compressed.data()), (std::streamsize)compressedLength );
+	if( file.fail() )
+		return false;
+
+	if( !m_inflaterReady ) {
+		if( inflateInit( &m_inflater ) != Z_OK )
+			return false;
+		m_inflaterReady = true;
+	}
+	else if( inflateReset( &m_inflater ) != Z_OK )
+		return false;
+	m_inflater.next_in = m_compressed.data();
+	m_inflater.avail_in = (uInt)compressedLength;
+	result = Z_OK;
+	for( size_t i = 0; i < targetCount && result == Z_OK; i++ ) {
+		m_inflater.next_out = reinterpret_cast<Bytef*>(pTargets[i].pData);
+		m_inflater.avail_out = (uInt)pTargets[i].length;
+		while( m_inflater.avail_out != 0 && result == Z_OK )
+			result = inflate( &m_inflater, Z_NO_FLUSH );
+		if( m_inflater.avail_out != 0 )
+			return false;
+	}
+	// Every target is full, the stream has to end here too
+	if( result == Z_OK ) {
+		m_inflater.next_out = &extra;
+		m_inflater.avail_out = 1;
+		result = inflate( &m_inflater, Z_NO_FLUSH );
+		if( m_inflater.avail_out != 1 )
+			return false;
+	}
+	return result == Z_STREAM_END;
+}
+
+std::string CRenderCache::DescribeUpdate( RegionUpdate update, const ChunkSet &chunks )
+{
+	if( update == REGION_UPDATE_NONE )
+		return "unchanged, ";
+	if( update == REGION_UPDATE_PARTIAL )
+		return std::to_string( chunks.count() ) + " chunks redrawn, ";
+	return "";
+}
+
+CRenderCache::CRenderCache() {
+	m_enabled = false;
+}
+CRenderCache::~CRenderCache() {
+}
+
+bool CRenderCache::open( const boost::filesystem::path &directory, const std::string &settingsKey, bool ignorePrevious )
+{
+	boost::system::error_code error;
+
+	m_directory = directory;
+	m_settingsKey = settingsKey;
+	m_previous.clear();
+	m_pending.clear();
+	m_current.clear();
+	m_enabled = false;
+
+	if( !boost::filesystem::is_directory( m_directory ) && !boost::filesystem::create_directories( m_directory, error ) ) {
+		std::cout << " > Failed: could not create " << m_directory << ", rendering everything without a cache" << std::endl;
+		return false;
+	}
+	m_enabled = true;
+	if( ignorePrevious )
+		return true;
+	if( this->readManifest( true ) )
+		std::cout << " > Found " << m_previous.size() << " regions rendered before, only changed chunks are drawn" << std::endl;
+
+	return true;
+}
+bool CRenderCache::load( const boost::filesystem::path &directory, const std::string &settingsKey )
+{
+	m_directory = directory;
+	m_settingsKey = settingsKey;
+	m_previous.clear();
+	m_pending.clear();
+	m_current.clear();
+	m_enabled = false;
+
+	return this->readManifest( false );
+}
+bool CRenderCache::readManifest( bool reportSettings )
+{
+	boost::filesystem::ifstream file;
+	char magic[4];
+	boost::uint32_t version, regionCount;
+	boost::uint16_t length;
+	std::string settingsKey, regionName;
+	RegionEntry entry;
+
+	file.open( m_directory / RENDERCACHE_MANIFEST_NAME, std::ios::in | std::ios::binary );
+	if( !file.is_open() )
+		return false;
+	file.read( magic, sizeof( magic ) );
+	file.read( reinterpret_cast<char*>(&version), sizeof( version ) );
+	if( file.fail() || memcmp( magic, ManifestMagic, sizeof( magic ) ) != 0 || version != RENDERCACHE_VERSION )
+		return false;
+	file.read( reinterpret_cast<char*>(&length), sizeof( length ) );
+	settingsKey.resize( length );
+	if( length > 0 )
+		file.read( &settingsKey[0], length );
+	if( file.fail() )
+		return false;
+	// Tiles from other settings would be mixed in with new ones
+	if( settingsKey.compare( m_settingsKey ) != 0 ) {
+		if( reportSettings )
+			std::cout << " > The map was last rendered with other settings, rendering everything" << std::endl;
+		return false;
+	}
+
+	file.read( reinterpret_cast<char*>(&regionCount), sizeof( regionCount ) );
+	for( boost::uint32_t i = 0; i < regionCount && !file.fail(); i++ ) {
+		file.read( reinterpret_cast<char*>(&length), sizeof( length ) );
+		regionName.resize( length );
+		if( length > 0 )
+			file.read( &regionName[0], length );
+		file.read( reinterpret_cast<char*>(entry.stamps.data()), sizeof( boost::int32_t )*REGION_CHUNK_COUNT );
+		file.read( reinterpret_cast<char*>(entry.hashes.data()), sizeof( boost::uint64_t )*REGION_CHUNK_COUNT );
+		if( !file.fail() )
+			m_previous[regionName] = entry;
+	}
+	if( file.fail() ) {
+		m_previous.clear();
+		return false;
+	}
+
+	return true;
+}
+bool CRenderCache::save()
+{
+	boost::filesystem::path manifestPath, tempPath;
+	boost::filesystem::ofstream file;
+	boost::uint32_t version, regionCount;
+	boost::uint16_t length;
+	boost::system::error_code error;
+
+	if( !m_enabled )
+		return true;
+
+	manifestPath = m_directory / RENDERCACHE_MANIFEST_NAME;
+	tempPath = manifestPath;
+	tempPath += ".tmp";
+	file.open( tempPath, std::ios::out | std::ios::binary | std::ios::trunc );
+	if( !file.is_open() ) {
+		std::cout << " > Failed: could not write " << manifestPath << std::endl;
+		return false;
+	}
+	version = RENDERCACHE_VERSION;
+	file.write( ManifestMagic, sizeof( ManifestMagic ) );
+	file.write( reinterpret_cast<const char*>(&version), sizeof( version ) );
+	length = (boost::uint16_t)m_settingsKey.length();
+	file.write( reinterpret_cast<const char*>(&length), sizeof( length ) );
+	file.write( m_settingsKey.data(), length );
+
+	std::lock_guard<std::mutex> cacheLock( m_mutex );
+	regionCount = (boost::uint32_t)m_current.size();
+	file.write( reinterpret_cast<const char*>(&regionCount), sizeof( regionCount ) );
+	for( std::map<std::string, RegionEntry>::const_iterator it = m_current.begin(); it != m_current.end(); it++ ) {
+		length = (boost::uint16_t)it->first.length();
+		file.write( reinterpret_cast<const char*>(&length), sizeof( length ) );
+		file.write( it->first.data(), length );
+		file.write( reinterpret_cast<const char*>(it->second.stamps.data()), sizeof( boost::int32_t )*REGION_CHUNK_COUNT );
+		file.write( reinterpret_cast<const char*>(it->second.hashes.data()), sizeof( boost::uint64_t )*REGION_CHUNK_COUNT );
+	}
+	file.close();
+	if( file.fail() ) {
+		std::cout << " > Failed: could not write " << manifestPath << std::endl;
+		return false;
+	}
+	boost::filesystem::rename( tempPath, manifestPath, error );
+	if( error ) {
+		std::cout << " > Failed: could not write " << manifestPath << std::endl;
+		return false;
+	}
+
+	return true;
+}
+bool CRenderCache::isEnabled() const {
+	return m_enabled;
+}
+
+bool CRenderCache::findChanges( const std::string &regionName, const CRegionFile &regionFile, ChunkSet *pChanged, ChunkHashes *pHashes )
+{
+	std::lock_guard<std::mutex> cacheLock( m_mutex );
+	std::map<std::string, RegionEntry>::const_iterator it;
+	RegionEntry &entry = m_pending[regionName];
+
+	for( unsigned int i = 0; i < REGION_CHUNK_COUNT; i++ )
+		entry.stamps[i] = regionFile.hasChunk( i ) ? regionFile.getTimestamp( i ) : RENDERCACHE_NO_CHUNK;
+
+	it = m_previous.find( regionName );
+	if( it == m_previous.end() )
+		return false;
+	pChanged->reset();
+	for( unsigned int i = 0; i < REGION_CHUNK_COUNT; i++ ) {
+		if( it->second.stamps[i] != entry.stamps[i] )
+			pChanged->set( i );
+	}
+	(*pHashes) = it->second.hashes;
+	return true;
+}
+bool CRenderCache::isUnchanged( const std::string &regionName, const CRegionFile &regionFile )
+{
+	std::lock_guard<std::mutex> cacheLock( m_mutex );
+	std::map<std::string, RegionEntry>::const_iterator it;
+
+	it = m_previous.find( regionName );
+	if( it == m_previous.end() )
+		return false;
+	for( unsigned int i = 0; i < REGION_CHUNK_COUNT; i++ ) {
+		if( it->second.stamps[i] != (regionFile.hasChunk( i ) ? regionFile.getTimestamp( i ) : RENDERCACHE_NO_CHUNK) )
+			return false;
+	}
+	return true;
+}
+size_t CRenderCache::getPreviousCount() const {
+	return m_previous.size();
+}
+void CRenderCache::commit( const std::string &regionName, const ChunkHashes &hashes )
+{
+	std::lock_guard<std::mutex> cacheLock( m_mutex );
+	std::map<std::string, RegionEntry>::iterator it;
+
+	it = m_pending.find( regionName );
+	if( it == m_pending.end() )
+		return;
+	it->second.hashes = hashes;
+	m_current[regionName] = it->second;
+	m_pending.erase( it );
+}
+void CRenderCache::getCommittedHashes( std::unordered_set<boost::uint64_t> *pHashes )
+{
+	std::lock_guard<std::mutex> cacheLock( m_mutex );
+
+	for( std::map<std::string, RegionEntry>::const_iterator it = m_current.begin(); it != m_current.end(); it++ ) {
+		for( unsigned int i = 0; i < REGION_CHUNK_COUNT; i++ ) {
+			if( it->second.hashes[i] != 0 )
+				pHashes->insert( it->second.hashes[i] );
+		}
+	}
+}
+boost::filesystem::path CRenderCache::getRegionPath( const std::string &regionName ) const {
+	return m_directory / (regionName + ".cache");
+}
\ No newline at end of file
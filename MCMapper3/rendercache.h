@@ -0,0 +1,197 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <boost\filesystem.hpp>
+#include <boost\integer.hpp>
+#include <array>
+#include <bitset>
+#include <map>
+#include <unordered_set>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include "region.h"
+
+#define RENDERCACHE_DIRECTORY "cache"
+#define RENDERCACHE_MANIFEST_NAME "manifest.dat"
+#define RENDERCACHE_VERSION 2
+// Stored for chunks that aren't in the region, so a chunk appearing or going away counts as a change
+#define RENDERCACHE_NO_CHUNK INT32_MIN
+
+typedef std::bitset<REGION_CHUNK_COUNT> ChunkSet;
+// Hash of each chunk's compressed bytes, 0 where there is no chunk or it wasn't read
+typedef std::array<boost::uint64_t, REGION_CHUNK_COUNT> ChunkHashes;
+
+// How much of a region has to be drawn again
+enum RegionUpdate : unsigned int
+{
+	REGION_UPDATE_FULL,
+	REGION_UPDATE_PARTIAL,
+	REGION_UPDATE_NONE
+};
+
+// A piece of a renderer's state to write to a cache file, the pieces are stored one after another
+struct CacheDataPart
+{
+	const void *pData;
+	size_t length;
+};
+// Where read puts each piece back, in the order they were written
+struct CacheDataTarget
+{
+	void *pData;
+	size_t length;
+};
+
+/*
+	Writes and reads the compressed files renderers keep their region state in
+	Each renderer has one, so the compressed buffer and zlib state are reused for every region
+	instead of being allocated again each time, parts go in and out without a copy of the whole state
+*/
+class CCacheDataFile
+{
+private:
+	z_stream m_deflater;
+	z_stream m_inflater;
+	bool m_deflaterReady;
+	bool m_inflaterReady;
+	// Grows to the largest file and stays that size
+	std::vector<unsigned char> m_compressed;
+public:
+	CCacheDataFile();
+	~CCacheDataFile();
+
+	CCacheDataFile( CCacheDataFile const& ) = delete;
+	void operator=( CCacheDataFile const& ) = delete;
+
+	/*
+		@method: write
+		@returns: if the file was written
+		Writes the parts to path compressed, as one block of data
+	*/
+	bool write( const boost::filesystem::path &path, const CacheDataPart *pParts, size_t partCount );
+	/*
+		@method: read
+		@returns: if the file was read and held exactly as many bytes as the targets once decompressed
+		The targets may be partly written when it fails
+	*/
+	bool read( const boost::filesystem::path &path, const CacheDataTarget *pTargets, size_t targetCount );
+};
+
+/*
+	Remembers what was rendered last time, so generate only redraws what changed
+	The manifest holds the timestamp and hash of every chunk of every region as it was when rendered, renderers
+	save what they need to redraw part of a region next to it. Anything rendered with other settings is ignored
+*/
+class CRenderCache
+{
+private:
+	struct RegionEntry
+	{
+		std::array<boost::int32_t, REGION_CHUNK_COUNT> stamps;
+		ChunkHashes hashes;
+	};
+
+	boost::filesystem::path m_directory;
+	std::string m_settingsKey;
+	bool m_enabled;
+
+	// From the manifest, then the regions started and finished this run
+	std::map<std::string, RegionEntry> m_previous;
+	std::map<std::string, RegionEntry> m_pending;
+	std::map<std::string, RegionEntry> m_current;
+	std::mutex m_mutex;
+
+	bool readManifest( bool reportSettings );
+public:
+	/*
+		@method: DescribeUpdate
+		@returns: what was redrawn, for the finished region message ("" for a full render)
+	*/
+	static std::string DescribeUpdate( RegionUpdate update, const ChunkSet &chunks );
+
+	CRenderCache();
+	~CRenderCache();
+
+	CRenderCache( CRenderCache const& ) = delete;
+	void operator=( CRenderCache const& ) = delete;
+
+	/*
+		@method: open
+		@returns: if the cache directory could be made
+		Reads the manifest in directory if it was written with the same settingsKey
+		If ignorePrevious is set everything is treated as changed, but the cache is still saved for next time
+	*/
+	bool open( const boost::filesystem::path &directory, const std::string &settingsKey, bool ignorePrevious );
+	/*
+		@method: load
+		@returns: if the manifest in directory was read and was written with the same settingsKey
+		For checking what generate left without rendering, the cache stays disabled so nothing is saved
+	*/
+	bool load( const boost::filesystem::path &directory, const std::string &settingsKey );
+	/*
+		@method: save
+		@returns: if the manifest was written
+		Only regions that were committed this run are kept
+	*/
+	bool save();
+	bool isEnabled() const;
+
+	/*
+		@method: findChanges
+		@returns: if the region was rendered before, pChanged is then set to the chunks whose timestamps have changed
+		since and pHashes to the hashes the chunks had then. Also remembers the chunk timestamps, for commit
+	*/
+	bool findChanges( const std::string &regionName, const CRegionFile &regionFile, ChunkSet *pChanged, ChunkHashes *pHashes );
+	/*
+		@method: isUnchanged
+		@returns: if the region was rendered before and none of its chunk timestamps have changed since
+	*/
+	bool isUnchanged( const std::string &regionName, const CRegionFile &regionFile );
+	/*
+		@method: getPreviousCount
+		@returns: how many regions were read from the manifest
+	*/
+	size_t getPreviousCount() const;
+	/*
+		@method: commit
+		@returns: none
+		Records the region as rendered with the timestamps seen by findChanges and the given chunk hashes
+	*/
+	void commit( const std::string &regionName, const ChunkHashes &hashes );
+	/*
+		@method: getCommittedHashes
+		@returns: none
+		Adds the hash of every chunk in the regions committed this run to pHashes
+	*/
+	void getCommittedHashes( std::unordered_set<boost::uint64_t> *pHashes );
+	/*
+		@method: getRegionPath
+		@returns: where a renderer keeps its state for the region
+	*/
+	boost::filesystem::path getRegionPath( const std::string &regionName ) const;
+};
\ No newline at end of file
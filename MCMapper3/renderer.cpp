@@ -23,108 +23,243 @@
 */
 
 #include <iostream>
-#pragma warning( disable:4996 )
-#include <boost\gil\extension\io\jpeg_dynamic_io.hpp>
-#pragma warning( default:4996 )
+#include <algorithm>
 #include "renderer.h"
 #include "maploader.h"
 #include "blocks.h"
+#include "threadpool.h"
+#include "simd.h"
+#include "tilewriter.h"
+#include "hash.h"
+#include "rendercache.h"
 
 int CRenderer::PixelToBlockRatios[ZOOM_LEVELS] ={ 1, 2, 4, 8 };
 
+static const boost::gil::rgb8_pixel_t BlankPixel( 200, 200, 200 );
+
 CRenderer::CRenderer() {
+	m_settings.magnify = false;
+	m_settings.pTileWriter = 0;
+	m_settings.format = IMAGE_FORMAT_JPEG;
+	m_settings.compressionLevel = PNG_DEFAULT_LEVEL;
 }
 CRenderer::~CRenderer() {
 }
 
 bool CRenderer::beginRegion( std::string mapName, std::string regionName )
 {
-	boost::gil::rgb8_pixel_t blankPixels( 200, 200, 200 );
-
 	// Construct the output path
 	m_outputPath = boost::filesystem::current_path() / "maps";
 	m_outputPath /= mapName;
 	// Make sure the directory exists
-	if( !boost::filesystem::is_directory( m_outputPath ) ) {
-		if( !boost::filesystem::create_directories( m_outputPath ) ) {
-			std::cout << "Failed: could not create output directory" << std::endl;
-			return false;
-		}
+	_ASSERT_EXPR( m_settings.pTileWriter, L"no tile writer" );
+	if( !m_settings.pTileWriter->ensureDirectory( m_outputPath ) ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << "Failed: could not create output directory" << std::endl;
+		return false;
 	}
 	m_regionName = regionName;
 
 	// Create and fill the image
-	m_regionImage = boost::gil::rgb8_image_t( 512, 512 );
-	boost::gil::fill_pixels( boost::gil::view( m_regionImage ), blankPixels );
+	this->clearRegionImage();
 
 	return true;
 }
+void CRenderer::clearRegionImage()
+{
+	if( m_regionImage.width() != REGION_PIXEL_LENGTH || m_regionImage.height() != REGION_PIXEL_LENGTH )
+		m_regionImage = boost::gil::rgb8_image_t( REGION_PIXEL_LENGTH, REGION_PIXEL_LENGTH );
+	boost::gil::fill_pixels( boost::gil::view( m_regionImage ), BlankPixel );
+}
+const boost::gil::rgb8_image_t& CRenderer::getRegionImage() const {
+	return m_regionImage;
+}
+void CRenderer::composeRegion() {
+}
 bool CRenderer::finishRegion()
 {
-	boost::filesystem::path zeroZoom;
+	// Let the renderer finish drawing
+	this->composeRegion();
 
 	// Write the zero zoom
-	zeroZoom = m_outputPath / "0";
-	if( !boost::filesystem::is_directory( zeroZoom ) ) {
-		if( !boost::filesystem::create_directories( zeroZoom ) ) {
-			std::cout<< " > Failed: could not create directory for images" << std::endl;
-			return false;
-		}
-	}
-	zeroZoom /= m_regionName + "-0.jpeg";
-	boost::gil::jpeg_write_view( zeroZoom.string(), boost::gil::const_view( m_regionImage ) );
+	if( !this->writeImage( m_outputPath / "0", m_regionName + "-0" + CImageEncoder::GetExtension( m_settings.format ), boost::gil::const_view( m_regionImage ) ) )
+		return false;
 
 	// Generate the zoom images
-	if( !this->generateZoom() )
+	if( m_settings.magnify && !this->generateZoom() )
 		return false;
 
 	return true;
 }
 
-bool CRenderer::generateZoom()
+void CRenderer::setSettings( const RenderSettings &settings ) {
+	m_settings = settings;
+	m_encoder.setFormat( m_settings.format, m_settings.compressionLevel );
+}
+const RenderSettings& CRenderer::getSettings() const {
+	return m_settings;
+}
+
+void CRenderer::renderChunks( ChunkData *const *ppChunks, size_t count, CBlockColors *pBlockColors )
+{
+	for( size_t i = 0; i < count; i++ )
+		this->renderChunk( ppChunks[i], pBlockColors );
+}
+void CRenderer::clearChunk( int x, int z ) {
+	boost::gil::fill_pixels( boost::gil::subimage_view( boost::gil::view( m_regionImage ), x*16, z*16, 16, 16 ), BlankPixel );
+}
+size_t CRenderer::getChunkStateSize() const {
+	return CHUNK_LENGTH*CHUNK_LENGTH*3;
+}
+void CRenderer::saveChunk( int x, int z, unsigned char *pState ) const
+{
+	boost::gil::rgb8_image_t::const_view_t imageView = boost::gil::const_view( m_regionImage );
+
+	for( int row = 0; row < CHUNK_LENGTH; row++ )
+		memcpy( pState + row*CHUNK_LENGTH*3, &imageView( x*16, z*16 + row ), CHUNK_LENGTH*3 );
+}
+void CRenderer::loadChunk( int x, int z, const unsigned char *pState, CBlockColors *pBlockColors )
+{
+	boost::gil::rgb8_image_t::view_t imageView = boost::gil::view( m_regionImage );
+
+	for( int row = 0; row < CHUNK_LENGTH; row++ )
+		memcpy( &imageView( x*16, z*16 + row ), pState + row*CHUNK_LENGTH*3, CHUNK_LENGTH*3 );
+}
+bool CRenderer::saveCache( const boost::filesystem::path &path ) const
+{
+	CacheDataPart part;
+
+	// Chunks only draw into their own tile, so the image is all there is
+	part.pData = &boost::gil::const_view( m_regionImage )( 0, 0 );
+	part.length = REGION_PIXEL_LENGTH*REGION_PIXEL_LENGTH*3;
+	return m_cacheFile.write( path, &part, 1 );
+}
+bool CRenderer::loadCache( const boost::filesystem::path &path, CBlockColors *pBlockColors )
+{
+	CacheDataTarget target;
+
+	target.pData = &boost::gil::view( m_regionImage )( 0, 0 );
+	target.length = REGION_PIXEL_LENGTH*REGION_PIXEL_LENGTH*3;
+	// It reads straight into the image, so put the background back if it stopped part way
+	if( !m_cacheFile.read( path, &target, 1 ) ) {
+		this->clearRegionImage();
+		return false;
+	}
+	return true;
+}
+
+bool CRenderer::IsBlank( const boost::gil::rgb8_image_t::const_view_t &view )
+{
+	for( int y = 0; y < (int)view.height(); y++ ) {
+		boost::gil::rgb8_image_t::const_view_t::x_iterator pRow = view.row_begin( y );
+		for( int x = 0; x < (int)view.width(); x++ ) {
+			if( pRow[x] != BlankPixel )
+				return false;
+		}
+	}
+	return true;
+}
+bool CRenderer::writeImage( const boost::filesystem::path &directory, const std::string &fileName, const boost::gil::rgb8_image_t::const_view_t &view )
+{
+	std::vector<unsigned char> data;
+
+	_ASSERT_EXPR( m_settings.pTileWriter, L"no tile writer" );
+
+	// Nothing was drawn, the viewer's background is the same color
+	if( CRenderer::IsBlank( view ) ) {
+		m_settings.pTileWriter->skip( directory / fileName );
+		return true;
+	}
+	if( !m_settings.pTileWriter->ensureDirectory( directory ) ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout<< " > Failed: could not create directory for images" << std::endl;
+		return false;
+	}
+	// Same pixels as a tile already stored, so skip encoding it again
+	if( m_settings.pTileWriter->linkDuplicate( HashImage( view ), directory / fileName ) )
+		return true;
+	// Encode here, the writer only does the file
+	if( !m_encoder.encode( view, &data ) )
+		return false;
+	return m_settings.pTileWriter->write( directory / fileName, std::move( data ) );
+}
+// Nearest neighbour with Ratio known at compile time, so there is no divide per pixel and repeated rows are copied whole
+template<int Ratio>
+static void MagnifyBy( const boost::gil::rgb8_image_t::const_view_t &region, int xOffset, int zOffset, const boost::gil::rgb8_image_t::view_t &destination )
+{
+	for( int z = 0; z < REGION_PIXEL_LENGTH; z += Ratio )
+	{
+		boost::gil::rgb8_image_t::const_view_t::x_iterator pSource = region.row_begin( zOffset + z/Ratio ) + xOffset;
+		boost::gil::rgb8_image_t::view_t::x_iterator pDestination = destination.row_begin( z );
+
+		for( int x = 0; x < REGION_PIXEL_LENGTH/Ratio; x++ ) {
+			for( int i = 0; i < Ratio; i++ )
+				pDestination[x*Ratio + i] = pSource[x];
+		}
+		for( int i = 1; i < Ratio; i++ )
+			std::copy( pDestination, pDestination + REGION_PIXEL_LENGTH, destination.row_begin( z + i ) );
+	}
+}
+void CRenderer::Magnify( const boost::gil::rgb8_image_t::const_view_t &region, int zoom, int index, const boost::gil::rgb8_image_t::view_t &destination )
 {
-	int subdivisionCount;
 	int sideLength, sideSubdivisions;
 	int xOffset, zOffset;
-	boost::gil::rgb8_image_t::view_t currentView, regionView;
-	boost::filesystem::path zoomOutput, subdivisionOutput;
 
-	std::cout << " > Generating zoom images for region..." << std::endl;
+	_ASSERT_EXPR( zoom > 0 && zoom < ZOOM_LEVELS, L"zoom out of range" );
+
+	sideLength = REGION_PIXEL_LENGTH / CRenderer::PixelToBlockRatios[zoom];
+	sideSubdivisions = REGION_PIXEL_LENGTH / sideLength;
+	xOffset = (index % sideSubdivisions)*sideLength;
+	zOffset = (index / sideSubdivisions)*sideLength;
+
+	// The ratios the zoom levels use get their own copy loop, anything else takes the generic one
+	switch( CRenderer::PixelToBlockRatios[zoom] )
+	{
+	case 2:
+		MagnifyBy<2>( region, xOffset, zOffset, destination );
+		return;
+	case 4:
+		MagnifyBy<4>( region, xOffset, zOffset, destination );
+		return;
+	case 8:
+		MagnifyBy<8>( region, xOffset, zOffset, destination );
+		return;
+	}
+
+	// Nearest neighbour, copied a row at a time
+	for( int z = 0; z < REGION_PIXEL_LENGTH; z++ ) {
+		boost::gil::rgb8_image_t::const_view_t::x_iterator pSource = region.row_begin( zOffset + z/CRenderer::PixelToBlockRatios[zoom] );
+		boost::gil::rgb8_image_t::view_t::x_iterator pDestination = destination.row_begin( z );
+		for( int x = 0; x < REGION_PIXEL_LENGTH; x++ )
+			pDestination[x] = pSource[xOffset + x/CRenderer::PixelToBlockRatios[zoom]];
+	}
+}
+
+bool CRenderer::generateZoom()
+{
+	int subdivisionCount;
+	boost::filesystem::path zoomOutput;
+
+	if( m_zoomImage.width() != REGION_PIXEL_LENGTH || m_zoomImage.height() != REGION_PIXEL_LENGTH )
+		m_zoomImage = boost::gil::rgb8_image_t( REGION_PIXEL_LENGTH, REGION_PIXEL_LENGTH );
+
+	{
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Generating zoom images for region " << m_regionName << "..." << std::endl;
+	}
 	// For each zoom we subdivide the region
-	regionView = boost::gil::view( m_regionImage );
 	for( int i = 1; i < ZOOM_LEVELS; i++ ) // skip the first one because its always 1
 	{
 		subdivisionCount = (int)pow( 4, i );
-		sideLength = REGION_PIXEL_LENGTH / CRenderer::PixelToBlockRatios[i];
-		sideSubdivisions = 512 / sideLength;
 		zoomOutput = m_outputPath / std::to_string( i );
 
-		// Make sure thge directory exists
-		if( !boost::filesystem::is_directory( zoomOutput ) ) {
-			if( !boost::filesystem::create_directories( zoomOutput ) ) {
-				std::cout<< " > Failed: could not create directory for images" << std::endl;
-				return false;
-			}
-		}
-
 		// Render each
 		for( int j = 0; j < subdivisionCount; j++ )
 		{
-			boost::gil::rgb8_image_t subdivision( REGION_PIXEL_LENGTH, REGION_PIXEL_LENGTH );
-
-			// Fill with blocks at the appropriate ratio
-			xOffset = (unsigned int)(j % sideSubdivisions)*sideLength;
-			zOffset = (unsigned int)(j / sideSubdivisions)*sideLength;
-			currentView = boost::gil::view( subdivision );
-			for( int x = 0; x < sideLength; x++ ) {
-				for( int z = 0; z < sideLength; z++ ) {
-					boost::gil::fill_pixels( boost::gil::subimage_view( boost::gil::view( subdivision ), x*CRenderer::PixelToBlockRatios[i], z*CRenderer::PixelToBlockRatios[i], CRenderer::PixelToBlockRatios[i], CRenderer::PixelToBlockRatios[i] ), regionView( x+xOffset, z+zOffset ) );
-				}
-			}
+			CRenderer::Magnify( boost::gil::const_view( m_regionImage ), i, j, boost::gil::view( m_zoomImage ) );
 			// Write it
-			subdivisionOutput = zoomOutput;
-			subdivisionOutput /= (m_regionName + "-" + std::to_string(j) + ".jpeg");
-			boost::gil::jpeg_write_view( subdivisionOutput.string(), boost::gil::const_view( subdivision ) );
+			if( !this->writeImage( zoomOutput, m_regionName + "-" + std::to_string( j ) + CImageEncoder::GetExtension( m_settings.format ), boost::gil::const_view( m_zoomImage ) ) )
+				return false;
 		}
 	}
 
@@ -150,57 +285,173 @@ bool CRendererClassic::beginRegion( std::string mapName, std::string regionName
 	return true;
 }
 
-void CRendererClassic::renderChunk( ChunkData *pChunkData, CBlockColors *pBlockColors )
+void CRendererClassic::drawChunk( ChunkData *pChunkData, CBlockColors *pBlockColors )
 {
 	int xPos, zPos;
 	boost::gil::rgb8_image_t::view_t imageView;
+	const boost::uint32_t *pLitColors, *pShadowColors;
 
-	xPos = abs( pChunkData->xPos % 32 );
-	zPos = abs( pChunkData->zPos % 32 );
+	// Position within the region, also correct for negative chunk coordinates
+	xPos = pChunkData->xPos & 31;
+	zPos = pChunkData->zPos & 31;
 
-	if( pChunkData->zPos < 0 )
-		zPos = 32 - zPos;
-	if( pChunkData->xPos < 0 )
-		xPos = 32 - xPos;
-
-	// Draw each pixel based on height
+	// Draw each row of pixels based on height
+	// Blocks lower than the one to their left get a shadow to show depth
 	imageView = boost::gil::view( m_regionImage );
-	for( int x = 0; x < CHUNK_LENGTH; x++ ) {
-		for( int z = 0; z < CHUNK_LENGTH; z++ )
-		{
-			int height, section, heightOffset;
-			unsigned char blockId;
-			boost::gil::rgb8_pixel_t color;
-			float blockShadowMult;
-
-			// Find the top block
-			if( pChunkData->HeightMap[x+z*16] != 0 )
-				height = pChunkData->HeightMap[x+z*16]-1;
-			else
-				height = 0;
-			section = height / SECTION_HEIGHT;
-			heightOffset = height - (section*SECTION_HEIGHT);
-			blockId = pChunkData->Sections[section].BlockIds[x+(z*16)+(heightOffset*CHUNK_LENGTH*CHUNK_LENGTH)];
-			color = pBlockColors->getBlockPixel( blockId );
-
-			// Determine if we apply a shadow to show depth
-			// Left gets shadow, right gets highlight
-			blockShadowMult = 1.0f;
-			if( x != 0 ) {
-				if( pChunkData->HeightMap[(x-1)+z*16] > pChunkData->HeightMap[x+z*16] )
-					blockShadowMult = 0.5f;
-			}
-			/*else if( x != 15 ) {
-				if( pChunkData->HeightMap[(x+1)+z*16] > pChunkData->HeightMap[x+z*16] )
-					blockShadowMult = 0.9f;
-			}*/
-
-			imageView( x+xPos*16, z+zPos*16 ) = boost::gil::rgb8_pixel_t( color[0] * blockShadowMult, color[1] * blockShadowMult, color[2] * blockShadowMult );
-			//imageView( x+xPos*16, z+zPos*16 ) = boost::gil::rgb8_pixel_t( (unsigned char)(((float)pChunkData->HeightMap[x+z*16] / 255.0f) * 255.0f), (unsigned char)(((float)pChunkData->HeightMap[x+z*16] / 255.0f) * 255.0f), (unsigned char)(((float)pChunkData->HeightMap[x+z*16] / 255.0f) * 255.0f) );
-		}
+	pLitColors = pBlockColors->getPackedShadeTable( SHADE_NEUTRAL );
+	pShadowColors = pBlockColors->getPackedShadeTable( SHADE_HALF );
+	for( int z = 0; z < CHUNK_LENGTH; z++ ) {
+		RenderSurfaceRow( &pChunkData->Surface.Heights[z*CHUNK_LENGTH], &pChunkData->Surface.BlockIds[z*CHUNK_LENGTH],
+			pLitColors, pShadowColors, reinterpret_cast<unsigned char*>(&imageView( xPos*16, z+zPos*16 )) );
 	}
 }
 
+const char* CRendererClassic::getName() const {
+	return "classic";
+}
 unsigned int CRendererClassic::getChunkDataFlags() {
-	return CHUNKDATA_HEIGHTMAP | CHUNKDATA_BLOCKIDS;
+	return CHUNKDATA_SURFACE;
+}
+CRenderer* CRendererClassic::clone() const
+{
+	CRendererClassic *pClone = new CRendererClassic();
+	pClone->setSettings( m_settings );
+	return pClone;
+}
+
+////////////////////////
+// CRendererHillshade //
+////////////////////////
+
+CRendererHillshade::CRendererHillshade()
+{
+	m_heightField.resize( HEIGHTFIELD_STRIDE*HEIGHTFIELD_STRIDE, HEIGHT_NONE );
+	m_colorIndices.resize( REGION_PIXEL_LENGTH*REGION_PIXEL_LENGTH, 0 );
+	memset( m_chunkPresent, 0, sizeof( m_chunkPresent ) );
+	m_pBlockColors = 0;
+}
+CRendererHillshade::~CRendererHillshade() {
+
+}
+
+bool CRendererHillshade::beginRegion( std::string mapName, std::string regionName )
+{
+	if( !CRenderer::beginRegion( mapName, regionName ) )
+		return false;
+
+	std::fill( m_heightField.begin(), m_heightField.end(), (boost::int16_t)HEIGHT_NONE );
+	memset( m_chunkPresent, 0, sizeof( m_chunkPresent ) );
+
+	return true;
+}
+
+void CRendererHillshade::drawChunk( ChunkData *pChunkData, CBlockColors *pBlockColors )
+{
+	int xPos, zPos;
+
+	xPos = pChunkData->xPos & 31;
+	zPos = pChunkData->zPos & 31;
+	m_pBlockColors = pBlockColors;
+
+	// Only gather the surface here, the shading needs the neighbouring chunks too
+	for( int z = 0; z < CHUNK_LENGTH; z++ ) {
+		memcpy( &m_heightField[(zPos*16 + z + 1)*HEIGHTFIELD_STRIDE + xPos*16 + 1], &pChunkData->Surface.Heights[z*CHUNK_LENGTH], CHUNK_LENGTH*sizeof( boost::int16_t ) );
+		BlockIdsToColorIndices( &pChunkData->Surface.BlockIds[z*CHUNK_LENGTH], &m_colorIndices[(zPos*16 + z)*REGION_PIXEL_LENGTH + xPos*16], CHUNK_LENGTH );
+	}
+	m_chunkPresent[xPos + zPos*32] = 1;
+}
+void CRendererHillshade::clearChunk( int x, int z )
+{
+	for( int row = 0; row < CHUNK_LENGTH; row++ )
+		std::fill_n( m_heightField.begin() + (z*16 + row + 1)*HEIGHTFIELD_STRIDE + x*16 + 1, CHUNK_LENGTH, (boost::int16_t)HEIGHT_NONE );
+	m_chunkPresent[x + z*32] = 0;
+}
+size_t CRendererHillshade::getChunkStateSize() const {
+	return CHUNK_LENGTH*CHUNK_LENGTH*(sizeof( boost::int16_t ) + sizeof( boost::uint16_t ));
+}
+void CRendererHillshade::saveChunk( int x, int z, unsigned char *pState ) const
+{
+	const size_t heightBytes = CHUNK_LENGTH*CHUNK_LENGTH*sizeof( boost::int16_t );
+
+	// All the heights, then all the color indices
+	for( int row = 0; row < CHUNK_LENGTH; row++ ) {
+		memcpy( pState + row*CHUNK_LENGTH*sizeof( boost::int16_t ), &m_heightField[(z*16 + row + 1)*HEIGHTFIELD_STRIDE + x*16 + 1], CHUNK_LENGTH*sizeof( boost::int16_t ) );
+		memcpy( pState + heightBytes + row*CHUNK_LENGTH*sizeof( boost::uint16_t ), &m_colorIndices[(z*16 + row)*REGION_PIXEL_LENGTH + x*16], CHUNK_LENGTH*sizeof( boost::uint16_t ) );
+	}
+}
+void CRendererHillshade::loadChunk( int x, int z, const unsigned char *pState, CBlockColors *pBlockColors )
+{
+	const size_t heightBytes = CHUNK_LENGTH*CHUNK_LENGTH*sizeof( boost::int16_t );
+
+	m_pBlockColors = pBlockColors;
+	for( int row = 0; row < CHUNK_LENGTH; row++ ) {
+		memcpy( &m_heightField[(z*16 + row + 1)*HEIGHTFIELD_STRIDE + x*16 + 1], pState + row*CHUNK_LENGTH*sizeof( boost::int16_t ), CHUNK_LENGTH*sizeof( boost::int16_t ) );
+		memcpy( &m_colorIndices[(z*16 + row)*REGION_PIXEL_LENGTH + x*16], pState + heightBytes + row*CHUNK_LENGTH*sizeof( boost::uint16_t ), CHUNK_LENGTH*sizeof( boost::uint16_t ) );
+	}
+	m_chunkPresent[x + z*32] = 1;
+}
+bool CRendererHillshade::saveCache( const boost::filesystem::path &path ) const
+{
+	const CacheDataPart parts[3] = {
+		{ m_heightField.data(), m_heightField.size()*sizeof( boost::int16_t ) },
+		{ m_colorIndices.data(), m_colorIndices.size()*sizeof( boost::uint16_t ) },
+		{ m_chunkPresent, sizeof( m_chunkPresent ) }
+	};
+
+	return m_cacheFile.write( path, parts, 3 );
+}
+bool CRendererHillshade::loadCache( const boost::filesystem::path &path, CBlockColors *pBlockColors )
+{
+	const CacheDataTarget targets[3] = {
+		{ m_heightField.data(), m_heightField.size()*sizeof( boost::int16_t ) },
+		{ m_colorIndices.data(), m_colorIndices.size()*sizeof( boost::uint16_t ) },
+		{ m_chunkPresent, sizeof( m_chunkPresent ) }
+	};
+
+	// It reads straight into the fields, so put back what beginRegion left if it stopped part way
+	if( !m_cacheFile.read( path, targets, 3 ) ) {
+		std::fill( m_heightField.begin(), m_heightField.end(), (boost::int16_t)HEIGHT_NONE );
+		memset( m_chunkPresent, 0, sizeof( m_chunkPresent ) );
+		return false;
+	}
+	// Needed to shade even if no chunk is drawn this time
+	m_pBlockColors = pBlockColors;
+	return true;
+}
+void CRendererHillshade::composeRegion()
+{
+	boost::gil::rgb8_image_t::view_t imageView;
+	const CBlockColors *pBlockColors;
+
+	// No chunks were drawn, the image is already blank
+	pBlockColors = m_pBlockColors;
+	if( !pBlockColors )
+		return;
+
+	// Shade the region a row at a time, each row reads the rows above and below it
+	imageView = boost::gil::view( m_regionImage );
+	for( int z = 0; z < REGION_PIXEL_LENGTH; z++ ) {
+		HillshadeRow( &m_heightField[(z + 1)*HEIGHTFIELD_STRIDE + 1], HEIGHTFIELD_STRIDE, &m_colorIndices[z*REGION_PIXEL_LENGTH],
+			pBlockColors->getPackedShadeTable( 0 ), BLOCK_COLOR_COUNT, SHADE_NEUTRAL, SHADE_HALF, SHADE_BRIGHTEST,
+			reinterpret_cast<unsigned char*>(&imageView( 0, z )), REGION_PIXEL_LENGTH );
+	}
+
+	// Put the background back where there were no chunks
+	for( int i = 0; i < 32*32; i++ ) {
+		if( !m_chunkPresent[i] )
+			boost::gil::fill_pixels( boost::gil::subimage_view( imageView, (i % 32)*16, (i / 32)*16, 16, 16 ), BlankPixel );
+	}
+}
+
+const char* CRendererHillshade::getName() const {
+	return "hillshade";
+}
+unsigned int CRendererHillshade::getChunkDataFlags() {
+	return CHUNKDATA_SURFACE;
+}
+CRenderer* CRendererHillshade::clone() const
+{
+	CRendererHillshade *pClone = new CRendererHillshade();
+	pClone->setSettings( m_settings );
+	return pClone;
 }
\ No newline at end of file
@@ -27,13 +27,29 @@
 #include <boost\filesystem.hpp>
 #include <boost\gil\gil_all.hpp>
 #include <string>
+#include <vector>
+#include <atomic>
+#include "encoder.h"
+#include "rendercache.h"
 
 struct ChunkData;
 class CBlockColors;
+class CTileWriter;
 
 #define ZOOM_LEVELS 4
 #define REGION_PIXEL_LENGTH 512
 
+struct RenderSettings
+{
+	// Also write the magnified zoom levels for each region, the viewer (map.js) scales level 0 tiles up itself otherwise
+	bool magnify;
+	// Shared by every clone, images are handed to it once encoded
+	CTileWriter *pTileWriter;
+	ImageFormat format;
+	// zlib level when the format is PNG
+	int compressionLevel;
+};
+
 
 class CRenderer
 {
@@ -41,27 +57,153 @@ protected:
 	boost::filesystem::path m_outputPath;
 	std::string m_regionName;
 	boost::gil::rgb8_image_t m_regionImage;
+	// Kept between regions, Magnify writes every pixel of it
+	boost::gil::rgb8_image_t m_zoomImage;
+	RenderSettings m_settings;
+	// Each clone encodes on its own thread, so each keeps its own compressor
+	CImageEncoder m_encoder;
+	// Same for the cache files, saveCache is const but reuses its buffers
+	mutable CCacheDataFile m_cacheFile;
 
 	bool generateZoom();
+	bool writeImage( const boost::filesystem::path &directory, const std::string &fileName, const boost::gil::rgb8_image_t::const_view_t &view );
 public:
 	static int PixelToBlockRatios[ZOOM_LEVELS];
 
+	/*
+		@method: Magnify
+		@returns: none
+		Scales up the part of a region image shown by tile index of a zoom level to fill destination
+	*/
+	static void Magnify( const boost::gil::rgb8_image_t::const_view_t &region, int zoom, int index, const boost::gil::rgb8_image_t::view_t &destination );
+	/*
+		@method: IsBlank
+		@returns: if every pixel of view is the background a region starts with
+	*/
+	static bool IsBlank( const boost::gil::rgb8_image_t::const_view_t &view );
+
 	CRenderer();
 	virtual ~CRenderer();
 
 	virtual bool beginRegion( std::string mapName, std::string regionName );
 	bool finishRegion();
 
+	/*
+		@method: setSettings
+		@returns: none
+		Sets the output settings, clones take a copy of them
+	*/
+	void setSettings( const RenderSettings &settings );
+	const RenderSettings& getSettings() const;
+	/*
+		@method: composeRegion
+		@returns: none
+		Called by finishRegion once every chunk is in, for renderers that draw the region image in one pass
+	*/
+	virtual void composeRegion();
+	/*
+		@method: clearRegionImage
+		@returns: none
+		Allocates the region image if needed and fills it with the background color
+	*/
+	void clearRegionImage();
+	const boost::gil::rgb8_image_t& getRegionImage() const;
+
+	/*
+		@method: renderChunk
+		@returns: none
+		Draws a chunk into its own 16x16 tile of the region image
+		May be called from several threads at once for different chunks of the same region
+	*/
 	virtual void renderChunk( ChunkData *pChunkData, CBlockColors *pBlockColors ) = 0;
+	/*
+		@method: renderChunks
+		@returns: none
+		Draws count chunks the same way as renderChunk, by default one call each
+		Renderers based on CRendererBatch draw them in one loop without a virtual call per chunk
+		The loader passes a row of a region at a time, the pipeline whatever its render stage took off its queue
+	*/
+	virtual void renderChunks( ChunkData *const *ppChunks, size_t count, CBlockColors *pBlockColors );
+	/*
+		@method: clearChunk
+		@returns: none
+		Puts the background back over a chunk that is no longer in the region, x and z are within the region
+	*/
+	virtual void clearChunk( int x, int z );
+	/*
+		@method: getChunkStateSize
+		@returns: how many bytes saveChunk copies out, what the chunk cache keeps for each chunk
+	*/
+	virtual size_t getChunkStateSize() const;
+	/*
+		@method: saveChunk
+		@returns: none
+		Copies out what was drawn for the chunk at x, z within the region
+	*/
+	virtual void saveChunk( int x, int z, unsigned char *pState ) const;
+	/*
+		@method: loadChunk
+		@returns: none
+		Puts back a chunk copied out by saveChunk instead of drawing it, the same threading rules as renderChunk apply
+	*/
+	virtual void loadChunk( int x, int z, const unsigned char *pState, CBlockColors *pBlockColors );
+
+	/*
+		@method: saveCache
+		@returns: if the file was written
+		Saves what the renderer needs to redraw only some chunks of the current region later
+	*/
+	virtual bool saveCache( const boost::filesystem::path &path ) const;
+	/*
+		@method: loadCache
+		@returns: if the cache was read, the region is then as it was when saved
+		Call after beginRegion, pBlockColors are the colors the cached chunks were drawn with
+	*/
+	virtual bool loadCache( const boost::filesystem::path &path, CBlockColors *pBlockColors );
 
+	/*
+		@method: getName
+		@returns: a name for the renderer, cached regions are only reused by the same one
+	*/
+	virtual const char* getName() const = 0;
 	virtual unsigned int getChunkDataFlags() = 0;
+	/*
+		@method: clone
+		@returns: a new renderer of the same type and settings, used to give each thread its own
+	*/
+	virtual CRenderer* clone() const = 0;
+};
+
+////////////////////
+// CRendererBatch //
+////////////////////
+
+/*
+	Base for the built-in renderers, TRenderer gives a non-virtual drawChunk and gets renderChunk and renderChunks from it
+	The batch loop calls drawChunk directly, so the drawing is inlined into it
+	Other renderers can still derive from CRenderer and only write renderChunk
+*/
+template<class TRenderer>
+class CRendererBatch : public CRenderer
+{
+public:
+	void renderChunk( ChunkData *pChunkData, CBlockColors *pBlockColors ) {
+		static_cast<TRenderer*>(this)->drawChunk( pChunkData, pBlockColors );
+	}
+	void renderChunks( ChunkData *const *ppChunks, size_t count, CBlockColors *pBlockColors )
+	{
+		TRenderer *pRenderer = static_cast<TRenderer*>(this);
+
+		for( size_t i = 0; i < count; i++ )
+			pRenderer->drawChunk( ppChunks[i], pBlockColors );
+	}
 };
 
 //////////////////////
 // CRendererClassic //
 //////////////////////
 
-class CRendererClassic : public CRenderer
+class CRendererClassic : public CRendererBatch<CRendererClassic>
 {
 public:
 	CRendererClassic();
@@ -69,7 +211,50 @@ public:
 
 	bool beginRegion( std::string mapName, std::string regionName );
 
-	void renderChunk( ChunkData *pChunkData, CBlockColors *pBlockColors );
+	void drawChunk( ChunkData *pChunkData, CBlockColors *pBlockColors );
 
+	const char* getName() const;
 	unsigned int getChunkDataFlags();
+	CRenderer* clone() const;
 };
+
+////////////////////////
+// CRendererHillshade //
+////////////////////////
+
+#define HEIGHTFIELD_STRIDE (REGION_PIXEL_LENGTH+2)
+
+/*
+	Gathers the surface of every chunk into one heightfield, then shades the whole region in one pass
+	Slopes are taken across chunk edges, so there are no seams inside a region
+	Each region is shaded alone, so its outer edge is shaded as flat and can show a seam against the next region
+*/
+class CRendererHillshade : public CRendererBatch<CRendererHillshade>
+{
+private:
+	// Heights with a one sample border of HEIGHT_NONE, so the shading pass never needs a bounds check
+	std::vector<boost::int16_t> m_heightField;
+	std::vector<boost::uint16_t> m_colorIndices;
+	unsigned char m_chunkPresent[32*32];
+	std::atomic<const CBlockColors*> m_pBlockColors;
+public:
+	CRendererHillshade();
+	~CRendererHillshade();
+
+	bool beginRegion( std::string mapName, std::string regionName );
+	void composeRegion();
+
+	void drawChunk( ChunkData *pChunkData, CBlockColors *pBlockColors );
+	void clearChunk( int x, int z );
+	size_t getChunkStateSize() const;
+	void saveChunk( int x, int z, unsigned char *pState ) const;
+	void loadChunk( int x, int z, const unsigned char *pState, CBlockColors *pBlockColors );
+
+	// The image is shaded again from these, so they are what is cached
+	bool saveCache( const boost::filesystem::path &path ) const;
+	bool loadCache( const boost::filesystem::path &path, CBlockColors *pBlockColors );
+
+	const char* getName() const;
+	unsigned int getChunkDataFlags();
+	CRenderer* clone() const;
+};
\ No newline at end of file
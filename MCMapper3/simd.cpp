@@ -0,0 +1,232 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <boost\endian\conversion.hpp>
+#include "simd.h"
+#if defined( SIMD_AVX2 )
+#include <immintrin.h>
+#elif defined( SIMD_SSE2 )
+#include <emmintrin.h>
+#endif
+
+const char* GetSimdName()
+{
+#if defined( SIMD_AVX2 )
+	return "AVX2";
+#elif defined( SIMD_SSE2 )
+	return "SSE2";
+#else
+	return "none";
+#endif
+}
+
+void BigToNativeInt32Array( boost::int32_t *pInts, size_t count )
+{
+	size_t i;
+
+	// Nothing to do on big endian machines
+	if( boost::endian::order::native == boost::endian::order::big )
+		return;
+
+	i = 0;
+#if defined( SIMD_AVX2 )
+	// Reverse the bytes of each int, 8 at a time
+	const __m256i shuffle = _mm256_setr_epi8( 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+	for( ; i + 8 <= count; i += 8 ) {
+		__m256i ints = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(pInts + i) );
+		ints = _mm256_shuffle_epi8( ints, shuffle );
+		_mm256_storeu_si256( reinterpret_cast<__m256i*>(pInts + i), ints );
+	}
+#elif defined( SIMD_SSE2 )
+	// SSE2 has no byte shuffle, swap the bytes in each short then swap the shorts
+	for( ; i + 4 <= count; i += 4 ) {
+		__m128i ints = _mm_loadu_si128( reinterpret_cast<const __m128i*>(pInts + i) );
+		ints = _mm_or_si128( _mm_slli_epi16( ints, 8 ), _mm_srli_epi16( ints, 8 ) );
+		ints = _mm_shufflelo_epi16( ints, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+		ints = _mm_shufflehi_epi16( ints, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>(pInts + i), ints );
+	}
+#endif
+	// Whatever is left over
+	for( ; i < count; i++ )
+		boost::endian::big_to_native_inplace( pInts[i] );
+}
+
+void RenderSurfaceRow( const boost::int16_t *pHeights, const boost::uint8_t *pBlockIds,
+	const boost::uint32_t *pLitColors, const boost::uint32_t *pShadowColors, unsigned char *pPixels )
+{
+#if defined( SIMD_AVX2 )
+	const __m256i shadowOffset = _mm256_set1_epi32( (int)(pShadowColors - pLitColors) );
+	const __m256i rotate = _mm256_setr_epi32( 7, 0, 1, 2, 3, 4, 5, 6 );
+	const __m256i firstColumn = _mm256_setr_epi32( 0, -1, -1, -1, -1, -1, -1, -1 );
+	const __m256i packRgb = _mm256_setr_epi8( 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1 );
+	__m256i heights[2], blockIds[2], previous[2], rotated[2];
+	__m128i ids;
+
+	heights[0] = _mm256_cvtepi16_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i*>(pHeights) ) );
+	heights[1] = _mm256_cvtepi16_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i*>(pHeights + 8) ) );
+	ids = _mm_loadu_si128( reinterpret_cast<const __m128i*>(pBlockIds) );
+	blockIds[0] = _mm256_cvtepu8_epi32( ids );
+	blockIds[1] = _mm256_cvtepu8_epi32( _mm_srli_si128( ids, 8 ) );
+	// The height of the column to the left, the first column has none
+	rotated[0] = _mm256_permutevar8x32_epi32( heights[0], rotate );
+	rotated[1] = _mm256_permutevar8x32_epi32( heights[1], rotate );
+	previous[0] = rotated[0];
+	previous[1] = _mm256_blend_epi32( rotated[1], rotated[0], 0x01 );
+
+	for( int half = 0; half < 2; half++ )
+	{
+		__m256i shadow, colorIndex, colors;
+
+		shadow = _mm256_cmpgt_epi32( previous[half], heights[half] );
+		if( half == 0 )
+			shadow = _mm256_and_si256( shadow, firstColumn );
+		colorIndex = _mm256_add_epi32( _mm256_slli_epi32( blockIds[half], 4 ), _mm256_and_si256( shadow, shadowOffset ) );
+		colors = _mm256_i32gather_epi32( reinterpret_cast<const int*>(pLitColors), colorIndex, 4 );
+
+		// Drop the padding byte, each 128-bit lane then holds 4 pixels in its first 12 bytes
+		colors = _mm256_shuffle_epi8( colors, packRgb );
+		for( int lane = 0; lane < 2; lane++ ) {
+			__m128i pixels = lane == 0 ? _mm256_castsi256_si128( colors ) : _mm256_extracti128_si256( colors, 1 );
+			unsigned char *pOut = pPixels + (half*8 + lane*4)*3;
+			boost::int32_t last;
+			_mm_storel_epi64( reinterpret_cast<__m128i*>(pOut), pixels );
+			last = _mm_cvtsi128_si32( _mm_srli_si128( pixels, 8 ) );
+			memcpy( pOut + 8, &last, 4 );
+		}
+	}
+#else
+	// Without gathers the lookups are scalar anyway, and vectorizing only the height math measured no faster on SSE2
+	for( int x = 0; x < SURFACE_ROW_LENGTH; x++ )
+	{
+		boost::uint32_t color;
+
+		if( x != 0 && pHeights[x-1] > pHeights[x] )
+			color = pShadowColors[pBlockIds[x] << 4];
+		else
+			color = pLitColors[pBlockIds[x] << 4];
+		pPixels[x*3] = (unsigned char)color;
+		pPixels[x*3+1] = (unsigned char)(color >> 8);
+		pPixels[x*3+2] = (unsigned char)(color >> 16);
+	}
+#endif
+}
+
+void HillshadeRow( const boost::int16_t *pHeights, size_t rowStride, const boost::uint16_t *pColorIndices,
+	const boost::uint32_t *pColors, unsigned int tableStride, int neutralShade, int minShade, int maxShade,
+	unsigned char *pPixels, size_t length )
+{
+	size_t x;
+
+	x = 0;
+#if defined( SIMD_AVX2 )
+	// 16 samples at a time, the whole slope works in 16-bit lanes
+	const __m256i none = _mm256_set1_epi16( HEIGHT_NONE );
+	const __m256i neutral = _mm256_set1_epi16( (short)neutralShade );
+	const __m256i lowest = _mm256_set1_epi16( (short)minShade );
+	const __m256i highest = _mm256_set1_epi16( (short)maxShade );
+	const __m256i stride = _mm256_set1_epi32( (int)tableStride );
+	const __m256i packRgb = _mm256_setr_epi8( 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1 );
+	for( ; x + 16 <= length; x += 16 )
+	{
+		__m256i center, west, east, north, south, slope, shade;
+		__m128i shadeHalves[2], indexHalves[2];
+
+		center = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(pHeights + x) );
+		west = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(pHeights + x - 1) );
+		east = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(pHeights + x + 1) );
+		north = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(pHeights + x - rowStride) );
+		south = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(pHeights + x + rowStride) );
+		west = _mm256_blendv_epi8( west, center, _mm256_cmpeq_epi16( west, none ) );
+		east = _mm256_blendv_epi8( east, center, _mm256_cmpeq_epi16( east, none ) );
+		north = _mm256_blendv_epi8( north, center, _mm256_cmpeq_epi16( north, none ) );
+		south = _mm256_blendv_epi8( south, center, _mm256_cmpeq_epi16( south, none ) );
+
+		// Ground rising towards the light is darker, falling away from it is brighter
+		slope = _mm256_adds_epi16( _mm256_subs_epi16( west, east ), _mm256_subs_epi16( north, south ) );
+		shade = _mm256_min_epi16( _mm256_max_epi16( _mm256_subs_epi16( neutral, slope ), lowest ), highest );
+
+		shadeHalves[0] = _mm256_castsi256_si128( shade );
+		shadeHalves[1] = _mm256_extracti128_si256( shade, 1 );
+		indexHalves[0] = _mm_loadu_si128( reinterpret_cast<const __m128i*>(pColorIndices + x) );
+		indexHalves[1] = _mm_loadu_si128( reinterpret_cast<const __m128i*>(pColorIndices + x + 8) );
+		for( int half = 0; half < 2; half++ )
+		{
+			__m256i colorIndex, colors;
+
+			colorIndex = _mm256_add_epi32( _mm256_mullo_epi32( _mm256_cvtepi16_epi32( shadeHalves[half] ), stride ), _mm256_cvtepu16_epi32( indexHalves[half] ) );
+			colors = _mm256_i32gather_epi32( reinterpret_cast<const int*>(pColors), colorIndex, 4 );
+			colors = _mm256_shuffle_epi8( colors, packRgb );
+			for( int lane = 0; lane < 2; lane++ ) {
+				__m128i pixels = lane == 0 ? _mm256_castsi256_si128( colors ) : _mm256_extracti128_si256( colors, 1 );
+				unsigned char *pOut = pPixels + (x + half*8 + lane*4)*3;
+				boost::int32_t last;
+				_mm_storel_epi64( reinterpret_cast<__m128i*>(pOut), pixels );
+				last = _mm_cvtsi128_si32( _mm_srli_si128( pixels, 8 ) );
+				memcpy( pOut + 8, &last, 4 );
+			}
+		}
+	}
+#endif
+	// Whatever is left over, or everything without AVX2
+	for( ; x < length; x++ )
+	{
+		int center, west, east, north, south, shade;
+		boost::uint32_t color;
+
+		center = pHeights[x];
+		west = pHeights[x-1] == HEIGHT_NONE ? center : pHeights[x-1];
+		east = pHeights[x+1] == HEIGHT_NONE ? center : pHeights[x+1];
+		north = pHeights[x-rowStride] == HEIGHT_NONE ? center : pHeights[x-rowStride];
+		south = pHeights[x+rowStride] == HEIGHT_NONE ? center : pHeights[x+rowStride];
+		shade = std::min( std::max( neutralShade - ((west - east) + (north - south)), minShade ), maxShade );
+		color = pColors[shade*tableStride + pColorIndices[x]];
+		pPixels[x*3] = (unsigned char)color;
+		pPixels[x*3+1] = (unsigned char)(color >> 8);
+		pPixels[x*3+2] = (unsigned char)(color >> 16);
+	}
+}
+
+void BlockIdsToColorIndices( const boost::uint8_t *pBlockIds, boost::uint16_t *pColorIndices, size_t count )
+{
+	size_t i;
+
+	i = 0;
+#if defined( SIMD_AVX2 ) || defined( SIMD_SSE2 )
+	// Widen 16 ids at a time, SSE2 is enough for this
+	const __m128i zero = _mm_setzero_si128();
+	for( ; i + 16 <= count; i += 16 ) {
+		__m128i ids = _mm_loadu_si128( reinterpret_cast<const __m128i*>(pBlockIds + i) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>(pColorIndices + i), _mm_slli_epi16( _mm_unpacklo_epi8( ids, zero ), 4 ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>(pColorIndices + i + 8), _mm_slli_epi16( _mm_unpackhi_epi8( ids, zero ), 4 ) );
+	}
+#endif
+	for( ; i < count; i++ )
+		pColorIndices[i] = (boost::uint16_t)(pBlockIds[i] << 4);
+}
\ No newline at end of file
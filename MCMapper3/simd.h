@@ -0,0 +1,91 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <boost\integer.hpp>
+#include <cstddef>
+
+/*
+	SIMD kernels, the instruction set is picked at compile time
+	AVX2 when the compiler targets it (/arch:AVX2), otherwise SSE2 on x86 and x64,
+	otherwise plain C++. Define MCMAPPER_NO_SIMD to force the scalar versions.
+*/
+#if defined( MCMAPPER_NO_SIMD )
+#define SIMD_SCALAR
+#elif defined( __AVX2__ )
+#define SIMD_AVX2
+#elif defined( _M_X64 ) || (defined( _M_IX86_FP ) && _M_IX86_FP >= 2) || defined( __SSE2__ )
+#define SIMD_SSE2
+#else
+#define SIMD_SCALAR
+#endif
+
+/*
+	@function: GetSimdName
+	@returns: the name of the instruction set the kernels were compiled for
+*/
+const char* GetSimdName();
+
+/*
+	@function: BigToNativeInt32Array
+	@returns: none
+	Converts count big endian 32-bit ints to native byte order in place
+*/
+void BigToNativeInt32Array( boost::int32_t *pInts, size_t count );
+
+#define SURFACE_ROW_LENGTH 16
+
+/*
+	@function: RenderSurfaceRow
+	@returns: none
+	Draws one 16 pixel row of a chunk's surface into pPixels as RGB8, from the height and top block id of each column
+	Columns whose left neighbour is higher use pShadowColors instead of pLitColors,
+	both are indexed by block id << 4 and hold colors packed as R, G, B, 0 bytes
+	Only AVX2 has a vector version, it needs gathers to be worth it
+*/
+void RenderSurfaceRow( const boost::int16_t *pHeights, const boost::uint8_t *pBlockIds,
+	const boost::uint32_t *pLitColors, const boost::uint32_t *pShadowColors, unsigned char *pPixels );
+
+/*
+	@function: BlockIdsToColorIndices
+	@returns: none
+	Writes count block ids as color indices (id << 4), for renderers that look the colors up later
+*/
+void BlockIdsToColorIndices( const boost::uint8_t *pBlockIds, boost::uint16_t *pColorIndices, size_t count );
+
+// Marks a heightfield sample with no data, neighbours that have it are treated as level with the center
+#define HEIGHT_NONE (-32768)
+
+/*
+	@function: HillshadeRow
+	@returns: none
+	Shades length pixels of a heightfield row lit from the north west and writes them to pPixels as RGB8
+	pHeights is the first sample of the row in a heightfield with a one sample border, rows are rowStride samples apart.
+	The shade level is neutralShade minus the west-east plus north-south height difference, clamped to [minShade, maxShade],
+	and picks the color from pColors[shade*tableStride + colorIndex]
+*/
+void HillshadeRow( const boost::int16_t *pHeights, size_t rowStride, const boost::uint16_t *pColorIndices,
+	const boost::uint32_t *pColors, unsigned int tableStride, int neutralShade, int minShade, int maxShade,
+	unsigned char *pPixels, size_t length );
\ No newline at end of file
@@ -0,0 +1,182 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include <iostream>
+#include <algorithm>
+#include "threadpool.h"
+
+std::mutex CThreadPool::OutputMutex;
+
+unsigned int CThreadPool::GetDefaultThreadCount()
+{
+	unsigned int count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+CThreadPool::CThreadPool()
+{
+	m_activeTasks = 0;
+	m_stopping = false;
+}
+CThreadPool::~CThreadPool()
+{
+	this->stop();
+}
+
+bool CThreadPool::start( unsigned int threadCount )
+{
+	_ASSERT_EXPR( m_threads.empty(), L"thread pool already started" );
+
+	if( threadCount == 0 )
+		threadCount = 1;
+	m_stopping = false;
+	try
+	{
+		for( unsigned int i = 0; i < threadCount; i++ )
+			m_threads.push_back( std::thread( &CThreadPool::workerMain, this, i ) );
+	}
+	catch( const std::system_error &e ) {
+		std::cout << "Failed: could not start worker threads (" << e.what() << ")" << std::endl;
+		this->stop();
+		return false;
+	}
+
+	return true;
+}
+void CThreadPool::stop()
+{
+	{
+		std::unique_lock<std::mutex> lock( m_mutex );
+		m_stopping = true;
+	}
+	m_taskCondition.notify_all();
+	for( auto it = m_threads.begin(); it != m_threads.end(); it++ ) {
+		if( (*it).joinable() )
+			(*it).join();
+	}
+	m_threads.clear();
+}
+
+void CThreadPool::enqueue( Task task )
+{
+	{
+		std::unique_lock<std::mutex> lock( m_mutex );
+		m_tasks.push( std::move( task ) );
+	}
+	m_taskCondition.notify_one();
+}
+void CThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock( m_mutex );
+	m_idleCondition.wait( lock, [this] { return m_tasks.empty() && m_activeTasks == 0; } );
+}
+
+void CThreadPool::parallelFor( size_t count, unsigned int callerIndex, IndexedTask task )
+{
+	std::shared_ptr<ParallelJob> pJob;
+	size_t helperCount;
+
+	if( count == 0 )
+		return;
+	pJob = std::make_shared<ParallelJob>();
+	pJob->nextIndex = 0;
+	pJob->count = count;
+	pJob->task = std::move( task );
+	pJob->running = 0;
+
+	// Only ask for help from workers that would otherwise sit idle
+	helperCount = std::min<size_t>( this->getIdleCount(), count-1 );
+	for( size_t i = 0; i < helperCount; i++ )
+	{
+		this->enqueue( [pJob]( unsigned int workerIndex ) {
+			{
+				std::unique_lock<std::mutex> lock( pJob->mutex );
+				// Picked up too late, the caller has already claimed everything
+				if( pJob->nextIndex >= pJob->count )
+					return;
+				pJob->running++;
+			}
+			pJob->run( workerIndex );
+			{
+				std::unique_lock<std::mutex> lock( pJob->mutex );
+				pJob->running--;
+			}
+			pJob->doneCondition.notify_all();
+		} );
+	}
+
+	pJob->run( callerIndex );
+
+	// Wait only for the helpers that actually joined in, the rest will find nothing left to do
+	std::unique_lock<std::mutex> lock( pJob->mutex );
+	pJob->doneCondition.wait( lock, [&pJob] { return pJob->running == 0; } );
+}
+void CThreadPool::ParallelJob::run( unsigned int workerIndex )
+{
+	for( ;; )
+	{
+		size_t index = nextIndex++;
+		if( index >= count )
+			break;
+		task( index, workerIndex );
+	}
+}
+
+void CThreadPool::workerMain( unsigned int workerIndex )
+{
+	for( ;; )
+	{
+		Task task;
+
+		{
+			std::unique_lock<std::mutex> lock( m_mutex );
+			// Keep draining the queue when stopping, so nothing that was queued is lost
+			m_taskCondition.wait( lock, [this] { return m_stopping || !m_tasks.empty(); } );
+			if( m_tasks.empty() )
+				return;
+			task = std::move( m_tasks.front() );
+			m_tasks.pop();
+			m_activeTasks++;
+		}
+
+		task( workerIndex );
+
+		{
+			std::unique_lock<std::mutex> lock( m_mutex );
+			m_activeTasks--;
+			if( m_tasks.empty() && m_activeTasks == 0 )
+				m_idleCondition.notify_all();
+		}
+	}
+}
+
+unsigned int CThreadPool::getThreadCount() const {
+	return (unsigned int)m_threads.size();
+}
+unsigned int CThreadPool::getIdleCount()
+{
+	std::unique_lock<std::mutex> lock( m_mutex );
+	size_t busy = m_activeTasks + m_tasks.size();
+	return busy >= m_threads.size() ? 0 : (unsigned int)(m_threads.size() - busy);
+}
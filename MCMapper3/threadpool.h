@@ -0,0 +1,123 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <queue>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+/*
+	Fixed set of worker threads running queued tasks
+	Each task is given the index of the worker running it, so it can use per-worker state
+*/
+class CThreadPool
+{
+public:
+	typedef std::function<void( unsigned int )> Task;
+	typedef std::function<void( size_t, unsigned int )> IndexedTask;
+private:
+	struct ParallelJob
+	{
+		std::atomic<size_t> nextIndex;
+		size_t count;
+		IndexedTask task;
+		unsigned int running;
+		std::mutex mutex;
+		std::condition_variable doneCondition;
+
+		void run( unsigned int workerIndex );
+	};
+
+	std::vector<std::thread> m_threads;
+	std::queue<Task> m_tasks;
+	unsigned int m_activeTasks;
+	bool m_stopping;
+
+	std::mutex m_mutex;
+	std::condition_variable m_taskCondition;
+	std::condition_variable m_idleCondition;
+
+	void workerMain( unsigned int workerIndex );
+public:
+	// Held while writing progress to the console from a worker
+	static std::mutex OutputMutex;
+
+	/*
+		@method: GetDefaultThreadCount
+		@returns: the number of hardware threads, at least 1
+	*/
+	static unsigned int GetDefaultThreadCount();
+
+	CThreadPool();
+	~CThreadPool();
+
+	CThreadPool( CThreadPool const& ) = delete;
+	void operator=( CThreadPool const& ) = delete;
+
+	/*
+		@method: start
+		@returns: if the threads were started
+	*/
+	bool start( unsigned int threadCount );
+	/*
+		@method: stop
+		@returns: none
+		Waits for the queued tasks to finish, then joins the threads
+	*/
+	void stop();
+
+	/*
+		@method: enqueue
+		@returns: none
+		Queues a task to be run by the next free worker
+	*/
+	void enqueue( Task task );
+	/*
+		@method: wait
+		@returns: none
+		Blocks until the queue is empty and no task is running
+	*/
+	void wait();
+	/*
+		@method: parallelFor
+		@returns: none
+		Runs task for every index in [0, count) on the calling thread and any workers that are idle
+		The caller always does work itself, so this is safe to call from inside a task
+		callerIndex is passed to task for the indices the calling thread runs
+	*/
+	void parallelFor( size_t count, unsigned int callerIndex, IndexedTask task );
+
+	unsigned int getThreadCount() const;
+	/*
+		@method: getIdleCount
+		@returns: how many workers have nothing queued for them to do
+	*/
+	unsigned int getIdleCount();
+};
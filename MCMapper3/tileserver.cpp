@@ -0,0 +1,634 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include <boost\asio.hpp>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <climits>
+#include <chrono>
+#include <cstdio>
+#pragma warning( disable:4996 )
+#include <boost\gil\extension\io\jpeg_dynamic_io.hpp>
+#pragma warning( default:4996 )
+#include <boost\filesystem\fstream.hpp>
+#include "tileserver.h"
+#include "renderer.h"
+#include "pyramid.h"
+#include "rendercache.h"
+
+#define REQUEST_HEADER_LIMIT 8192
+// Milliseconds a connection gets to send its request before it is dropped
+#define REQUEST_READ_TIMEOUT 5000
+
+static const boost::gil::rgb8_pixel_t BlankPixel( 200, 200, 200 );
+
+static std::string DecodeUrl( const std::string &url )
+{
+	std::string decoded;
+
+	for( size_t i = 0; i < url.length(); i++ ) {
+		if( url[i] == '%' && i+2 < url.length() && isxdigit( (unsigned char)url[i+1] ) && isxdigit( (unsigned char)url[i+2] ) ) {
+			decoded.push_back( (char)strtol( url.substr( i+1, 2 ).c_str(), 0, 16 ) );
+			i += 2;
+		}
+		// Only paths are decoded, where '+' is itself and not a form's space
+		else
+			decoded.push_back( url[i] );
+	}
+	return decoded;
+}
+static const char* GetStatusText( int status )
+{
+	switch( status )
+	{
+	case 200:
+		return "OK";
+	case 302:
+		return "Found";
+	case 400:
+		return "Bad Request";
+	case 404:
+		return "Not Found";
+	case 405:
+		return "Method Not Allowed";
+	default:
+		return "Internal Server Error";
+	}
+}
+static std::string GetContentType( const boost::filesystem::path &path )
+{
+	std::string ext = path.extension().string();
+	std::transform( ext.begin(), ext.end(), ext.begin(), ::tolower );
+	if( ext.compare( ".html" ) == 0 || ext.compare( ".htm" ) == 0 )
+		return "text/html";
+	if( ext.compare( ".js" ) == 0 )
+		return "application/javascript";
+	if( ext.compare( ".css" ) == 0 )
+		return "text/css";
+	if( ext.compare( ".jpeg" ) == 0 || ext.compare( ".jpg" ) == 0 )
+		return "image/jpeg";
+	if( ext.compare( ".png" ) == 0 )
+		return "image/png";
+	return "application/octet-stream";
+}
+static bool ReadFileData( const boost::filesystem::path &path, std::vector<unsigned char> *pData )
+{
+	boost::filesystem::ifstream file;
+	boost::uintmax_t size;
+
+	file.open( path, std::ios::in | std::ios::binary );
+	if( !file.is_open() )
+		return false;
+	size = boost::filesystem::file_size( path );
+	pData->resize( (size_t)size );
+	if( size > 0 && !file.read( reinterpret_cast<char*>(pData->data()), (std::streamsize)size ) )
+		return false;
+	return true;
+}
+
+// A socket with an io_service of its own, so a worker can wait on it with a deadline without touching other connections
+struct Connection
+{
+	boost::asio::io_service ioService;
+	boost::asio::ip::tcp::socket socket;
+
+	Connection() : socket( ioService ) {
+	}
+};
+
+/*
+	@function: ReadRequest
+	@returns: if the request headers arrived within REQUEST_READ_TIMEOUT
+	Browsers open spare connections they may never use, a plain blocking read would hold the worker until they close
+*/
+static bool ReadRequest( Connection &connection, boost::asio::streambuf &requestBuffer )
+{
+	boost::asio::deadline_timer timer( connection.ioService );
+	boost::system::error_code readError;
+
+	readError = boost::asio::error::would_block;
+	boost::asio::async_read_until( connection.socket, requestBuffer, "\r\n\r\n", [&]( const boost::system::error_code &error, size_t ) {
+		readError = error;
+		timer.cancel();
+	} );
+	timer.expires_from_now( boost::posix_time::milliseconds( REQUEST_READ_TIMEOUT ) );
+	timer.async_wait( [&]( const boost::system::error_code &error ) {
+		boost::system::error_code closeError;
+		// Closing makes the read finish with an error
+		if( !error )
+			connection.socket.close( closeError );
+	} );
+	// Returns once both the read and the timer are done
+	connection.ioService.run();
+	return !readError;
+}
+
+/*
+	@function: ServeConnection
+	@returns: none
+	Reads one request from the socket, answers it and closes the connection
+*/
+static void ServeConnection( CTileServer *pServer, Connection &connection, unsigned int workerIndex )
+{
+	boost::asio::ip::tcp::socket &socket = connection.socket;
+	boost::asio::streambuf requestBuffer( REQUEST_HEADER_LIMIT );
+	boost::system::error_code error;
+	std::string method, target, headers;
+	CTileServer::Response response;
+	std::chrono::steady_clock::time_point start;
+
+	if( !ReadRequest( connection, requestBuffer ) )
+		return;
+	start = std::chrono::steady_clock::now();
+	{
+		std::istream requestStream( &requestBuffer );
+		requestStream >> method >> target;
+	}
+
+	if( method.compare( "GET" ) != 0 )
+		CTileServer::SetTextResponse( 405, "Only GET is supported", &response );
+	else {
+		try {
+			pServer->handleRequest( target, workerIndex, &response );
+		}
+		catch( const std::exception &e ) {
+			CTileServer::SetTextResponse( 500, e.what(), &response );
+		}
+	}
+
+	headers = "HTTP/1.1 " + std::to_string( response.status ) + " " + GetStatusText( response.status ) + "\r\n";
+	headers += "Content-Type: " + response.contentType + "\r\n";
+	headers += "Content-Length: " + std::to_string( response.pBody ? response.pBody->size() : 0 ) + "\r\n";
+	headers += response.headers;
+	headers += "Connection: close\r\n\r\n";
+	std::vector<boost::asio::const_buffer> buffers;
+	buffers.push_back( boost::asio::buffer( headers ) );
+	if( response.pBody && !response.pBody->empty() )
+		buffers.push_back( boost::asio::buffer( *response.pBody ) );
+	boost::asio::write( socket, buffers, error );
+	socket.shutdown( boost::asio::ip::tcp::socket::shutdown_both, error );
+	socket.close( error );
+
+	pServer->recordRequest( response.contentType.compare( 0, 6, "image/" ) == 0,
+		(unsigned long long)std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count() );
+}
+
+void CTileServer::SetTextResponse( int status, const std::string &text, Response *pResponse )
+{
+	pResponse->status = status;
+	pResponse->contentType = "text/plain";
+	pResponse->headers.clear();
+	pResponse->pBody = std::make_shared<const std::vector<unsigned char>>( text.begin(), text.end() );
+}
+
+CTileServer::CTileServer( CMapLoader &mapLoader ) : m_mapLoader( mapLoader ), m_images( TILESERVER_IMAGE_CACHE_SIZE ), m_tiles( TILESERVER_TILE_CACHE_SIZE )
+{
+	m_zoomOutLevels = 0;
+	m_format = IMAGE_FORMAT_JPEG;
+	m_mapUnchanged = false;
+	m_requestCount = 0;
+	m_tileRequestCount = 0;
+	m_totalMicroseconds = 0;
+	m_maxMicroseconds = 0;
+}
+CTileServer::~CTileServer() {
+	this->stop();
+}
+
+bool CTileServer::start( unsigned int threadCount )
+{
+	std::vector<boost::filesystem::path> regionPaths;
+	int regionX, regionZ;
+	int minX, maxX, minZ, maxZ;
+
+	_ASSERT_EXPR( m_mapLoader.getRenderer(), L"no renderer" );
+
+	// Index the regions by position, anything without coordinates in its name can't be asked for
+	regionPaths = m_mapLoader.getRegionPaths();
+	minX = minZ = INT_MAX;
+	maxX = maxZ = INT_MIN;
+	for( size_t i = 0; i < regionPaths.size(); i++ ) {
+		if( !CRegionFile::ParseName( regionPaths[i].stem().string(), &regionX, &regionZ ) )
+			continue;
+		m_regionPaths[std::make_pair( regionX, regionZ )] = regionPaths[i];
+		minX = std::min( minX, regionX );
+		maxX = std::max( maxX, regionX );
+		minZ = std::min( minZ, regionZ );
+		maxZ = std::max( maxZ, regionZ );
+	}
+	if( m_regionPaths.empty() ) {
+		std::cout << "Failed: the map has no regions to serve" << std::endl;
+		return false;
+	}
+	m_zoomOutLevels = CTilePyramid::CountLevels( minX, maxX, minZ, maxZ );
+
+	m_sitePath = boost::filesystem::current_path();
+	m_basePath = m_sitePath / "maps" / m_mapLoader.getMapName() / "0";
+	m_format = m_mapLoader.getRenderer()->getSettings().format;
+	if( boost::filesystem::is_regular_file( m_basePath.parent_path() / ARCHIVE_FILE_NAME ) ) {
+		if( m_archive.open( m_basePath.parent_path() / ARCHIVE_FILE_NAME ) )
+			std::cout << "Serving " << m_archive.getCount() << " tiles from " << m_archive.getPath() << std::endl;
+	}
+	this->findUnchangedRegions();
+
+	if( threadCount == 0 )
+		threadCount = 1;
+	m_workers = std::vector<RegionWorker>( threadCount );
+	for( unsigned int i = 0; i < threadCount; i++ )
+		m_workers[i].pRenderer = m_mapLoader.getRenderer()->clone();
+	m_encoders = std::vector<CImageEncoder>( threadCount );
+	for( unsigned int i = 0; i < threadCount; i++ )
+		m_encoders[i].setFormat( m_format, m_mapLoader.getRenderer()->getSettings().compressionLevel );
+	if( !m_threadPool.start( threadCount ) ) {
+		this->stop();
+		return false;
+	}
+
+	return true;
+}
+void CTileServer::stop()
+{
+	m_threadPool.stop();
+	for( size_t i = 0; i < m_workers.size(); i++ )
+		delete m_workers[i].pRenderer;
+	m_workers.clear();
+}
+
+bool CTileServer::run( unsigned short port )
+{
+	boost::asio::io_service ioService;
+	boost::asio::ip::tcp::acceptor acceptor( ioService );
+	boost::asio::ip::tcp::endpoint endpoint( boost::asio::ip::address_v4::loopback(), port );
+	boost::system::error_code error;
+
+	acceptor.open( endpoint.protocol(), error );
+	if( !error )
+		acceptor.set_option( boost::asio::ip::tcp::acceptor::reuse_address( true ), error );
+	if( !error )
+		acceptor.bind( endpoint, error );
+	if( !error )
+		acceptor.listen( boost::asio::socket_base::max_connections, error );
+	if( error ) {
+		std::cout << "Failed: could not listen on port " << port << " (" << error.message() << ")" << std::endl;
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << "Serving " << m_regionPaths.size() << " regions at http://localhost:" << port << "/" << std::endl;
+	}
+	for( ;; )
+	{
+		std::shared_ptr<Connection> pConnection = std::make_shared<Connection>();
+
+		acceptor.accept( pConnection->socket, error );
+		if( error )
+			continue;
+		m_threadPool.enqueue( [this, pConnection]( unsigned int workerIndex ) {
+			ServeConnection( this, *pConnection, workerIndex );
+		} );
+	}
+
+	return true;
+}
+
+void CTileServer::handleRequest( const std::string &target, unsigned int workerIndex, Response *pResponse )
+{
+	std::string path;
+	std::vector<std::string> segments;
+	size_t start, end;
+
+	// Split the path, the query doesn't matter
+	path = DecodeUrl( target.substr( 0, target.find( '?' ) ) );
+	for( start = 0; start < path.length(); start = end + 1 ) {
+		end = path.find( '/', start );
+		if( end == std::string::npos )
+			end = path.length();
+		if( end > start )
+			segments.push_back( path.substr( start, end - start ) );
+	}
+
+	if( segments.empty() ) {
+		SetTextResponse( 302, "The viewer is at /mapsrc/index.html", pResponse );
+		pResponse->headers = "Location: /mapsrc/index.html\r\n";
+	}
+	else if( segments.size() == 1 && segments[0].compare( "stats" ) == 0 )
+		SetTextResponse( 200, this->getStats(), pResponse );
+	// The map name is whatever the viewer was set up with, this only ever serves one map
+	else if( segments[0].compare( "maps" ) == 0 && segments.size() == 3 && segments[2].compare( "tiles.js" ) == 0 ) {
+		SetTextResponse( 200, CTilePyramid::GetViewerInfo( m_zoomOutLevels, ZOOM_LEVELS-1, m_format ), pResponse );
+		pResponse->contentType = "application/javascript";
+	}
+	else if( segments[0].compare( "maps" ) == 0 && segments.size() == 4 )
+		this->respondTile( segments[2], segments[3], workerIndex, pResponse );
+	else
+		this->respondFile( segments, pResponse );
+}
+void CTileServer::respondTile( const std::string &levelName, const std::string &fileName, unsigned int workerIndex, Response *pResponse )
+{
+	int level, x, z, index;
+	int nameLength;
+	char end;
+	DataPtr pTile;
+	std::string extension = CImageEncoder::GetExtension( m_format );
+
+	if( sscanf( levelName.c_str(), "%d%c", &level, &end ) != 1 || level < -(int)m_zoomOutLevels || level >= ZOOM_LEVELS ) {
+		SetTextResponse( 404, "No such zoom level", pResponse );
+		return;
+	}
+	// Same names as generate writes, the extension has to match the format tiles are served in
+	nameLength = -1;
+	if( level < 0 ) {
+		index = 0;
+		if( sscanf( fileName.c_str(), "t.%d.%d%n", &x, &z, &nameLength ) != 2 || fileName.compare( nameLength, std::string::npos, extension ) != 0 ) {
+			SetTextResponse( 400, "Expected t.X.Z" + extension, pResponse );
+			return;
+		}
+	}
+	else if( sscanf( fileName.c_str(), "r.%d.%d-%d%n", &x, &z, &index, &nameLength ) != 3 || fileName.compare( nameLength, std::string::npos, extension ) != 0 ||
+		index < 0 || index >= (1 << (level*2)) ) {
+		SetTextResponse( 400, "Expected r.X.Z-index" + extension, pResponse );
+		return;
+	}
+
+	pTile = this->getTile( level, x, z, index, workerIndex );
+	if( !pTile ) {
+		SetTextResponse( 404, "Nothing has been explored there", pResponse );
+		return;
+	}
+	pResponse->status = 200;
+	pResponse->contentType = CImageEncoder::GetContentType( m_format );
+	pResponse->headers = "Cache-Control: max-age=60\r\n";
+	pResponse->pBody = pTile;
+}
+void CTileServer::respondFile( const std::vector<std::string> &segments, Response *pResponse )
+{
+	boost::filesystem::path filePath;
+	std::shared_ptr<std::vector<unsigned char>> pData;
+
+	// Only the viewer and what generate wrote, and never anything above them
+	if( segments[0].compare( "mapsrc" ) != 0 && segments[0].compare( "maps" ) != 0 ) {
+		SetTextResponse( 404, "Not found", pResponse );
+		return;
+	}
+	filePath = m_sitePath;
+	for( size_t i = 0; i < segments.size(); i++ ) {
+		if( segments[i].compare( ".." ) == 0 || segments[i].find( '\\' ) != std::string::npos || segments[i].find( ':' ) != std::string::npos ) {
+			SetTextResponse( 400, "Bad path", pResponse );
+			return;
+		}
+		filePath /= segments[i];
+	}
+
+	pData = std::make_shared<std::vector<unsigned char>>();
+	if( !boost::filesystem::is_regular_file( filePath ) || !ReadFileData( filePath, pData.get() ) ) {
+		SetTextResponse( 404, "Not found", pResponse );
+		return;
+	}
+	pResponse->status = 200;
+	pResponse->contentType = GetContentType( filePath );
+	pResponse->headers.clear();
+	pResponse->pBody = pData;
+}
+
+void CTileServer::findUnchangedRegions()
+{
+	boost::filesystem::path directory;
+	CRenderCache renderCache;
+	CRegionFile regionFile;
+
+	m_unchangedRegions.clear();
+	m_mapUnchanged = false;
+
+	// The manifest says which of the archive or the loose tiles generate wrote last, the other is out of date
+	directory = m_basePath.parent_path() / RENDERCACHE_DIRECTORY;
+	if( m_archive.isOpen() && !renderCache.load( directory, m_mapLoader.getSettingsKey( true ) ) ) {
+		m_archive.close();
+		std::cout << "The archive was not written by the last generate with these settings, it is not used" << std::endl;
+	}
+	if( !m_archive.isOpen() && !renderCache.load( directory, m_mapLoader.getSettingsKey( false ) ) ) {
+		std::cout << "The map was not last generated with these settings, every tile is rendered from the region files" << std::endl;
+		return;
+	}
+
+	for( std::map<std::pair<int, int>, boost::filesystem::path>::const_iterator it = m_regionPaths.begin(); it != m_regionPaths.end(); it++ ) {
+		if( regionFile.open( it->second ) && renderCache.isUnchanged( it->second.stem().string(), regionFile ) )
+			m_unchangedRegions.insert( it->first );
+		regionFile.close();
+	}
+	m_mapUnchanged = m_unchangedRegions.size() == m_regionPaths.size() && renderCache.getPreviousCount() == m_regionPaths.size();
+	std::cout << "Reusing generated tiles of " << m_unchangedRegions.size() << " of " << m_regionPaths.size() << " regions, the others changed since" << std::endl;
+}
+bool CTileServer::hasRegions( int level, int x, int z ) const
+{
+	std::map<std::pair<int, int>, boost::filesystem::path>::const_iterator it;
+	int minX, maxX, minZ, maxZ;
+
+	// The regions under a tile of level -k are a square 2^k across
+	minX = x * (1 << -level);
+	maxX = (x + 1) * (1 << -level);
+	minZ = z * (1 << -level);
+	maxZ = (z + 1) * (1 << -level);
+	for( it = m_regionPaths.lower_bound( std::make_pair( minX, INT_MIN ) ); it != m_regionPaths.end() && it->first.first < maxX; it++ ) {
+		if( it->first.second >= minZ && it->first.second < maxZ )
+			return true;
+	}
+	return false;
+}
+CTileServer::ImagePtr CTileServer::getImage( int level, int x, int z, unsigned int workerIndex )
+{
+	ImageKey key( level, x, z );
+	ImagePtr pImage;
+	std::promise<ImagePtr> promise;
+
+	if( m_images.get( key, &pImage ) )
+		return pImage;
+	{
+		std::unique_lock<std::mutex> pendingLock( m_pendingMutex );
+		std::map<ImageKey, std::shared_future<ImagePtr>>::iterator it = m_pendingImages.find( key );
+		if( it != m_pendingImages.end() ) {
+			std::shared_future<ImagePtr> pending = it->second;
+			pendingLock.unlock();
+			return pending.get();
+		}
+		m_pendingImages[key] = promise.get_future().share();
+	}
+
+	// Images only wait on images of higher levels, so waiting here can't go round in a circle
+	try {
+		pImage = this->makeImage( level, x, z, workerIndex );
+	}
+	catch( const std::exception &e ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << " > Failed: could not make image " << level << "/" << x << "." << z << " (" << e.what() << ")" << std::endl;
+		pImage.reset();
+	}
+	if( pImage )
+		m_images.put( key, pImage, REGION_PIXEL_LENGTH*REGION_PIXEL_LENGTH*3 );
+	promise.set_value( pImage );
+	{
+		std::lock_guard<std::mutex> pendingLock( m_pendingMutex );
+		m_pendingImages.erase( key );
+	}
+
+	return pImage;
+}
+CTileServer::ImagePtr CTileServer::makeImage( int level, int x, int z, unsigned int workerIndex )
+{
+	std::shared_ptr<boost::gil::rgb8_image_t> pImage;
+	const int half = REGION_PIXEL_LENGTH / 2;
+
+	if( level == 0 )
+	{
+		std::map<std::pair<int, int>, boost::filesystem::path>::const_iterator it;
+		boost::filesystem::path basePath;
+		RegionWorker &worker = m_workers[workerIndex];
+
+		it = m_regionPaths.find( std::make_pair( x, z ) );
+		if( it == m_regionPaths.end() )
+			return ImagePtr();
+		pImage = std::make_shared<boost::gil::rgb8_image_t>();
+
+		// Use what generate wrote if it is still current, only JPEG is ever read back
+		basePath = m_basePath / ("r." + std::to_string( x ) + "." + std::to_string( z ) + "-0.jpeg");
+		if( m_format == IMAGE_FORMAT_JPEG && m_unchangedRegions.count( std::make_pair( x, z ) ) && boost::filesystem::is_regular_file( basePath ) ) {
+			boost::gil::jpeg_read_image( basePath.string(), *pImage );
+			return pImage;
+		}
+
+		if( !m_mapLoader.drawRegion( it->second, worker, workerIndex ) ) {
+			worker.regionFile.close();
+			return ImagePtr();
+		}
+		worker.regionFile.close();
+		worker.pRenderer->composeRegion();
+		(*pImage) = worker.pRenderer->getRegionImage();
+		return pImage;
+	}
+
+	// Zoomed out, made from the four images below it
+	ImagePtr children[4];
+	if( !this->hasRegions( level, x, z ) )
+		return ImagePtr();
+	m_threadPool.parallelFor( 4, workerIndex, [this, level, x, z, &children]( size_t i, unsigned int helperIndex ) {
+		children[i] = this->getImage( level + 1, x*2 + (int)(i & 1), z*2 + (int)(i >> 1), helperIndex );
+	} );
+
+	pImage = std::make_shared<boost::gil::rgb8_image_t>( REGION_PIXEL_LENGTH, REGION_PIXEL_LENGTH );
+	boost::gil::fill_pixels( boost::gil::view( *pImage ), BlankPixel );
+	for( int i = 0; i < 4; i++ ) {
+		if( children[i] ) {
+			CTilePyramid::DownsampleInto( boost::gil::const_view( *children[i] ),
+				boost::gil::subimage_view( boost::gil::view( *pImage ), (i & 1)*half, (i >> 1)*half, half, half ) );
+		}
+	}
+	return pImage;
+}
+CTileServer::DataPtr CTileServer::getTile( int level, int x, int z, int index, unsigned int workerIndex )
+{
+	TileKey key( level, x, z, index );
+	DataPtr pTile;
+	ImagePtr pImage;
+	std::shared_ptr<std::vector<unsigned char>> pData;
+
+	if( m_tiles.get( key, &pTile ) )
+		return pTile;
+
+	pData = std::make_shared<std::vector<unsigned char>>();
+	if( m_archive.isOpen() && (level < 0 ? m_mapUnchanged : m_unchangedRegions.count( std::make_pair( x, z ) ) > 0) ) {
+		std::string name = std::to_string( level ) + "/";
+		if( level < 0 )
+			name += CTilePyramid::GetTileName( x, z, m_format );
+		else
+			name += "r." + std::to_string( x ) + "." + std::to_string( z ) + "-" + std::to_string( index ) + CImageEncoder::GetExtension( m_format );
+		if( m_archive.read( name, pData.get() ) ) {
+			m_tiles.put( key, pData, pData->size() );
+			return pData;
+		}
+	}
+	if( level == 0 ) {
+		// Already encoded, send it as it is
+		boost::filesystem::path basePath = m_basePath / ("r." + std::to_string( x ) + "." + std::to_string( z ) + "-0" + CImageEncoder::GetExtension( m_format ));
+		if( m_unchangedRegions.count( std::make_pair( x, z ) ) && boost::filesystem::is_regular_file( basePath ) && ReadFileData( basePath, pData.get() ) ) {
+			m_tiles.put( key, pData, pData->size() );
+			return pData;
+		}
+	}
+
+	pImage = this->getImage( std::min( level, 0 ), x, z, workerIndex );
+	if( !pImage )
+		return DataPtr();
+	if( level > 0 ) {
+		boost::gil::rgb8_image_t magnified( REGION_PIXEL_LENGTH, REGION_PIXEL_LENGTH );
+		CRenderer::Magnify( boost::gil::const_view( *pImage ), level, index, boost::gil::view( magnified ) );
+		if( !m_encoders[workerIndex].encode( boost::gil::const_view( magnified ), pData.get() ) )
+			return DataPtr();
+	}
+	else if( !m_encoders[workerIndex].encode( boost::gil::const_view( *pImage ), pData.get() ) )
+		return DataPtr();
+	m_tiles.put( key, pData, pData->size() );
+
+	return pData;
+}
+
+void CTileServer::recordRequest( bool isTile, unsigned long long microseconds )
+{
+	unsigned long long previousMax;
+	unsigned long long tileRequests;
+
+	m_requestCount++;
+	m_totalMicroseconds += microseconds;
+	previousMax = m_maxMicroseconds;
+	while( microseconds > previousMax && !m_maxMicroseconds.compare_exchange_weak( previousMax, microseconds ) );
+	if( !isTile )
+		return;
+
+	tileRequests = ++m_tileRequestCount;
+	if( tileRequests % TILESERVER_STATS_INTERVAL == 0 ) {
+		std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+		std::cout << this->getStats();
+	}
+}
+std::string CTileServer::getStats()
+{
+	std::stringstream stats;
+	unsigned long long requests, tileHits, tileMisses, imageHits, imageMisses;
+
+	requests = m_requestCount;
+	tileHits = m_tiles.getHits();
+	tileMisses = m_tiles.getMisses();
+	imageHits = m_images.getHits();
+	imageMisses = m_images.getMisses();
+
+	stats << std::fixed << std::setprecision( 1 );
+	stats << " > Requests: " << requests << " (" << m_tileRequestCount << " tiles), latency avg "
+		<< (requests > 0 ? (double)m_totalMicroseconds / requests / 1000.0 : 0.0) << "ms max " << (double)m_maxMicroseconds / 1000.0 << "ms" << std::endl;
+	stats << " > Tile cache: " << m_tiles.getCount() << " tiles, " << (double)m_tiles.getTotalCost() / (1024.0*1024.0) << "MB, hit rate "
+		<< (tileHits + tileMisses > 0 ? 100.0 * tileHits / (tileHits + tileMisses) : 0.0) << "%" << std::endl;
+	stats << " > Image cache: " << m_images.getCount() << " images, " << (double)m_images.getTotalCost() / (1024.0*1024.0) << "MB, hit rate "
+		<< (imageHits + imageMisses > 0 ? 100.0 * imageHits / (imageHits + imageMisses) : 0.0) << "%" << std::endl;
+	return stats.str();
+}
\ No newline at end of file
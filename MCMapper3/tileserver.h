@@ -0,0 +1,149 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <boost\filesystem.hpp>
+#include <boost\gil\gil_all.hpp>
+#include <memory>
+#include <vector>
+#include <string>
+#include <map>
+#include <set>
+#include <tuple>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include "lrucache.h"
+#include "threadpool.h"
+#include "maploader.h"
+#include "encoder.h"
+#include "archive.h"
+
+#define TILESERVER_DEFAULT_PORT 8080
+// Decoded region and zoomed out images, a region image is 768KB
+#define TILESERVER_IMAGE_CACHE_SIZE (256*1024*1024)
+// Encoded tiles, as sent to the browser
+#define TILESERVER_TILE_CACHE_SIZE (64*1024*1024)
+// Print the counters every this many tile requests
+#define TILESERVER_STATS_INTERVAL 100
+
+/*
+	Small local HTTP server for the map viewer that renders tiles when they are first asked for
+	Serves the same URLs map.js uses for files written by generate, plus the viewer itself from mapsrc
+	Level 0 tiles already written by generate are used as they are, everything else comes from the region files
+*/
+class CTileServer
+{
+public:
+	typedef std::shared_ptr<const std::vector<unsigned char>> DataPtr;
+
+	struct Response
+	{
+		int status;
+		std::string contentType;
+		// Any extra header lines, each ending in \r\n
+		std::string headers;
+		DataPtr pBody;
+	};
+private:
+	typedef std::shared_ptr<const boost::gil::rgb8_image_t> ImagePtr;
+	// Level, x and z, level 0 is a region and levels below it are zoomed out tiles
+	typedef std::tuple<int, int, int> ImageKey;
+	// Level, x, z and the index of the tile within its region for magnified levels
+	typedef std::tuple<int, int, int, int> TileKey;
+
+	CMapLoader &m_mapLoader;
+	std::map<std::pair<int, int>, boost::filesystem::path> m_regionPaths;
+	boost::filesystem::path m_sitePath;
+	boost::filesystem::path m_basePath;
+	unsigned int m_zoomOutLevels;
+	ImageFormat m_format;
+	// Tiles packed by generate --archive, checked before anything is rendered
+	CTileArchive m_archive;
+	// Regions whose tiles generate wrote with these settings and that haven't changed since, only their tiles are reused
+	std::set<std::pair<int, int>> m_unchangedRegions;
+	// Zoomed out tiles also cover regions that were removed since, so they are only reused if nothing changed
+	bool m_mapUnchanged;
+
+	CThreadPool m_threadPool;
+	std::vector<RegionWorker> m_workers;
+	std::vector<CImageEncoder> m_encoders;
+
+	CLruCache<ImageKey, ImagePtr> m_images;
+	CLruCache<TileKey, DataPtr> m_tiles;
+	// Images being made right now, so requests for the same one wait for it instead of making it again
+	std::map<ImageKey, std::shared_future<ImagePtr>> m_pendingImages;
+	std::mutex m_pendingMutex;
+
+	std::atomic<unsigned long long> m_requestCount;
+	std::atomic<unsigned long long> m_tileRequestCount;
+	std::atomic<unsigned long long> m_totalMicroseconds;
+	std::atomic<unsigned long long> m_maxMicroseconds;
+
+	void findUnchangedRegions();
+	bool hasRegions( int level, int x, int z ) const;
+	ImagePtr getImage( int level, int x, int z, unsigned int workerIndex );
+	ImagePtr makeImage( int level, int x, int z, unsigned int workerIndex );
+	DataPtr getTile( int level, int x, int z, int index, unsigned int workerIndex );
+
+	void respondTile( const std::string &levelName, const std::string &fileName, unsigned int workerIndex, Response *pResponse );
+	void respondFile( const std::vector<std::string> &segments, Response *pResponse );
+public:
+	static void SetTextResponse( int status, const std::string &text, Response *pResponse );
+
+	CTileServer( CMapLoader &mapLoader );
+	~CTileServer();
+
+	CTileServer( CTileServer const& ) = delete;
+	void operator=( CTileServer const& ) = delete;
+
+	/*
+		@method: start
+		@returns: if the workers could be started
+		Finds the regions of the map loaded into the map loader, which must have a renderer set
+	*/
+	bool start( unsigned int threadCount );
+	/*
+		@method: run
+		@returns: false if the port could not be opened, otherwise it serves until the program is closed
+		Listens on localhost only, requests are handled on the workers
+	*/
+	bool run( unsigned short port );
+	void stop();
+
+	/*
+		@method: handleRequest
+		@returns: none
+		Answers a GET for target, called from a worker with its index
+	*/
+	void handleRequest( const std::string &target, unsigned int workerIndex, Response *pResponse );
+	/*
+		@method: recordRequest
+		@returns: none
+		Adds a finished request to the counters
+	*/
+	void recordRequest( bool isTile, unsigned long long microseconds );
+	std::string getStats();
+};
\ No newline at end of file
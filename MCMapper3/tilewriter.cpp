@@ -0,0 +1,274 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include <iostream>
+#include <boost\filesystem\fstream.hpp>
+#include "tilewriter.h"
+#include "threadpool.h"
+
+bool CTileWriter::WriteFile( const boost::filesystem::path &path, const std::vector<unsigned char> &data )
+{
+	boost::filesystem::ofstream file;
+	boost::system::error_code error;
+
+	// An earlier run may have left a hard link here, writing through it would change the tile it shares
+	boost::filesystem::remove( path, error );
+	file.open( path, std::ios::out | std::ios::binary | std::ios::trunc );
+	if( !file.is_open() )
+		return false;
+	file.write( reinterpret_cast<const char*>(data.data()), (std::streamsize)data.size() );
+	file.close();
+	return !file.fail();
+}
+bool CTileWriter::LinkFile( const boost::filesystem::path &source, const boost::filesystem::path &destination )
+{
+	boost::system::error_code error;
+
+	// Links can't replace a file, and a copy would write through an old link into the source
+	boost::filesystem::remove( destination, error );
+	boost::filesystem::create_hard_link( source, destination, error );
+	if( !error )
+		return true;
+	error.clear();
+	boost::filesystem::copy_file( source, destination, boost::filesystem::copy_option::overwrite_if_exists, error );
+	return !error;
+}
+
+CTileWriter::CTileWriter() : m_queue( TILEWRITER_QUEUE_LENGTH ) {
+	m_pendingWrites = 0;
+	m_failedWrites = 0;
+	m_linkedCount = 0;
+	m_skippedCount = 0;
+}
+CTileWriter::~CTileWriter() {
+	this->stop();
+}
+
+bool CTileWriter::start( unsigned int threadCount )
+{
+	if( !m_threads.empty() )
+		return true;
+	try
+	{
+		for( unsigned int i = 0; i < threadCount; i++ )
+			m_threads.push_back( std::thread( &CTileWriter::writerMain, this ) );
+	}
+	catch( const std::system_error &e ) {
+		std::cout << "Failed: could not start writer threads (" << e.what() << ")" << std::endl;
+		this->stop();
+		return false;
+	}
+	return true;
+}
+void CTileWriter::stop()
+{
+	m_queue.close();
+	for( size_t i = 0; i < m_threads.size(); i++ )
+		m_threads[i].join();
+	m_threads.clear();
+}
+
+void CTileWriter::writerMain()
+{
+	WriteJob *pJob;
+
+	while( m_queue.pop( &pJob ) ) {
+		bool succeeded = this->store( pJob->path, pJob->data );
+		if( !succeeded ) {
+			std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+			std::cout << " > Failed: could not write " << pJob->path << std::endl;
+		}
+		delete pJob;
+		this->finishWrite( succeeded );
+	}
+}
+void CTileWriter::finishWrite( bool succeeded )
+{
+	if( !succeeded )
+		m_failedWrites++;
+	{
+		std::lock_guard<std::mutex> pendingLock( m_pendingMutex );
+		m_pendingWrites--;
+	}
+	m_writesDone.notify_all();
+}
+
+bool CTileWriter::openArchive( const boost::filesystem::path &root )
+{
+	if( !this->ensureDirectory( root ) )
+		return false;
+	if( !m_archive.create( root / ARCHIVE_FILE_NAME ) )
+		return false;
+	m_archiveRoot = root.generic_string() + "/";
+	return true;
+}
+bool CTileWriter::closeArchive()
+{
+	m_archiveRoot.clear();
+	return m_archive.close();
+}
+bool CTileWriter::isArchiving() const {
+	return m_archive.isOpen();
+}
+std::string CTileWriter::getArchiveName( const boost::filesystem::path &path ) const
+{
+	std::string name = path.generic_string();
+
+	_ASSERT_EXPR( name.compare( 0, m_archiveRoot.length(), m_archiveRoot ) == 0, L"tile is not under the archive root" );
+	return name.substr( m_archiveRoot.length() );
+}
+bool CTileWriter::store( const boost::filesystem::path &path, const std::vector<unsigned char> &data )
+{
+	if( m_archive.isOpen() )
+		return m_archive.append( this->getArchiveName( path ), data );
+	return CTileWriter::WriteFile( path, data );
+}
+
+bool CTileWriter::ensureDirectory( const boost::filesystem::path &path )
+{
+	std::lock_guard<std::mutex> directoryLock( m_directoryMutex );
+
+	// Everything goes in the one file
+	if( m_archive.isOpen() )
+		return true;
+	if( m_directories.count( path ) )
+		return true;
+	// Another process may have made it in between, which is fine
+	if( !boost::filesystem::is_directory( path ) ) {
+		if( !boost::filesystem::create_directories( path ) && !boost::filesystem::is_directory( path ) )
+			return false;
+	}
+	m_directories.insert( path );
+	return true;
+}
+bool CTileWriter::write( const boost::filesystem::path &path, std::vector<unsigned char> &&data )
+{
+	WriteJob *pJob;
+
+	{
+		std::lock_guard<std::mutex> pendingLock( m_pendingMutex );
+		m_pendingWrites++;
+	}
+	// Not started, write it here
+	if( m_threads.empty() ) {
+		bool succeeded = this->store( path, data );
+		if( !succeeded ) {
+			std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+			std::cout << " > Failed: could not write " << path << std::endl;
+		}
+		this->finishWrite( succeeded );
+		return true;
+	}
+
+	pJob = new WriteJob;
+	pJob->path = path;
+	pJob->data = std::move( data );
+	if( !m_queue.push( pJob ) ) {
+		delete pJob;
+		this->finishWrite( false );
+		return false;
+	}
+	return true;
+}
+bool CTileWriter::linkDuplicate( boost::uint64_t hash, const boost::filesystem::path &path )
+{
+	std::lock_guard<std::mutex> linkLock( m_linkMutex );
+	std::unordered_map<boost::uint64_t, boost::filesystem::path>::iterator it;
+	LinkJob link;
+
+	it = m_storedTiles.find( hash );
+	if( it == m_storedTiles.end() ) {
+		m_storedTiles.insert( std::make_pair( hash, path ) );
+		return false;
+	}
+	// Written again with the same pixels, nothing to do
+	if( it->second == path )
+		return false;
+	link.source = it->second;
+	link.destination = path;
+	m_links.push_back( link );
+	m_linkedCount++;
+	return true;
+}
+void CTileWriter::skip( const boost::filesystem::path &path )
+{
+	std::lock_guard<std::mutex> linkLock( m_linkMutex );
+	LinkJob link;
+
+	link.destination = path;
+	m_links.push_back( link );
+	m_skippedCount++;
+}
+bool CTileWriter::finishLinks()
+{
+	std::vector<LinkJob> links;
+	boost::system::error_code error;
+	bool succeeded;
+
+	{
+		std::lock_guard<std::mutex> linkLock( m_linkMutex );
+		links.swap( m_links );
+	}
+	succeeded = true;
+	for( size_t i = 0; i < links.size(); i++ )
+	{
+		// Archives are made from scratch, so there is nothing to remove, and links only need an index entry
+		if( m_archive.isOpen() ) {
+			if( !links[i].source.empty() && !m_archive.link( this->getArchiveName( links[i].source ), this->getArchiveName( links[i].destination ) ) ) {
+				std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+				std::cout << " > Failed: could not link " << links[i].destination << " to " << links[i].source << std::endl;
+				succeeded = false;
+			}
+			continue;
+		}
+		if( links[i].source.empty() ) {
+			boost::filesystem::remove( links[i].destination, error );
+			continue;
+		}
+		if( !CTileWriter::LinkFile( links[i].source, links[i].destination ) ) {
+			std::lock_guard<std::mutex> outputLock( CThreadPool::OutputMutex );
+			std::cout << " > Failed: could not link " << links[i].destination << " to " << links[i].source << std::endl;
+			succeeded = false;
+		}
+	}
+	return succeeded;
+}
+bool CTileWriter::flush()
+{
+	bool linked;
+
+	std::unique_lock<std::mutex> pendingLock( m_pendingMutex );
+	m_writesDone.wait( pendingLock, [this] { return m_pendingWrites == 0; } );
+	pendingLock.unlock();
+
+	linked = this->finishLinks();
+	return (m_failedWrites.exchange( 0 ) == 0) && linked;
+}
+
+unsigned int CTileWriter::getLinkedCount() const {
+	return m_linkedCount;
+}
+unsigned int CTileWriter::getSkippedCount() const {
+	return m_skippedCount;
+}
\ No newline at end of file
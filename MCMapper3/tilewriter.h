@@ -0,0 +1,176 @@
+/*
+	MIT License
+
+	Copyright (c) 2016 Timothy Volpe
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <boost\filesystem.hpp>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <boost\integer.hpp>
+#include "boundedqueue.h"
+#include "archive.h"
+
+// Encoded images waiting to be written, a region tile is a few hundred KB
+#define TILEWRITER_QUEUE_LENGTH 64
+#define TILEWRITER_THREAD_COUNT 2
+
+/*
+	Writes encoded images to disk on its own threads, so rendering threads only encode
+	Also remembers which directories it has made, so they are only checked once
+	Tiles with the same pixels are only stored once, the rest are hard linked to it when flushed
+	Can also pack every tile into one archive instead of writing each to its own file
+*/
+class CTileWriter
+{
+private:
+	struct WriteJob
+	{
+		boost::filesystem::path path;
+		std::vector<unsigned char> data;
+	};
+	// Done at flush once every write has finished, so the source is always on disk
+	struct LinkJob
+	{
+		// Empty to only remove the destination
+		boost::filesystem::path source;
+		boost::filesystem::path destination;
+	};
+
+	CBoundedQueue<WriteJob*> m_queue;
+	std::vector<std::thread> m_threads;
+
+	std::set<boost::filesystem::path> m_directories;
+	std::mutex m_directoryMutex;
+
+	// Writes queued but not finished, flush waits for this to reach 0
+	unsigned int m_pendingWrites;
+	std::mutex m_pendingMutex;
+	std::condition_variable m_writesDone;
+	std::atomic<unsigned int> m_failedWrites;
+
+	// The first path stored for each tile hash
+	std::unordered_map<boost::uint64_t, boost::filesystem::path> m_storedTiles;
+	std::vector<LinkJob> m_links;
+	std::mutex m_linkMutex;
+	std::atomic<unsigned int> m_linkedCount;
+	std::atomic<unsigned int> m_skippedCount;
+
+	// Open while tiles go to an archive, paths are then stored relative to m_archiveRoot
+	CTileArchive m_archive;
+	std::string m_archiveRoot;
+
+	bool finishLinks();
+	std::string getArchiveName( const boost::filesystem::path &path ) const;
+	bool store( const boost::filesystem::path &path, const std::vector<unsigned char> &data );
+
+	void writerMain();
+	void finishWrite( bool succeeded );
+public:
+	/*
+		@method: WriteFile
+		@returns: if all of data was written to path
+		Replaces the file rather than writing into it
+	*/
+	static bool WriteFile( const boost::filesystem::path &path, const std::vector<unsigned char> &data );
+	/*
+		@method: LinkFile
+		@returns: if destination now has the contents of source
+		Replaces destination with a hard link to source, or a copy if the file system can't link
+	*/
+	static bool LinkFile( const boost::filesystem::path &source, const boost::filesystem::path &destination );
+
+	CTileWriter();
+	~CTileWriter();
+
+	CTileWriter( CTileWriter const& ) = delete;
+	void operator=( CTileWriter const& ) = delete;
+
+	/*
+		@method: start
+		@returns: if the threads started
+		Does nothing if already started, writes happen on the calling thread until this is called
+	*/
+	bool start( unsigned int threadCount );
+	/*
+		@method: stop
+		@returns: none
+		Writes whatever is queued, then stops the threads, the writer can't be started again
+	*/
+	void stop();
+
+	/*
+		@method: openArchive
+		@returns: if the archive was created
+		Writes tiles under root to root/tiles.pack from now on, instead of to their own files
+	*/
+	bool openArchive( const boost::filesystem::path &root );
+	/*
+		@method: closeArchive
+		@returns: if the archive index was written
+		Should be flushed first, tiles written after this go to their own files again
+	*/
+	bool closeArchive();
+	bool isArchiving() const;
+
+	/*
+		@method: ensureDirectory
+		@returns: if the directory exists
+		Creates the directory the first time it is asked for, later calls only look it up
+	*/
+	bool ensureDirectory( const boost::filesystem::path &path );
+	/*
+		@method: write
+		@returns: false if the writer has been stopped
+		Queues data to be written to path, waits if the queue is full
+		Errors are reported by flush
+	*/
+	bool write( const boost::filesystem::path &path, std::vector<unsigned char> &&data );
+	/*
+		@method: linkDuplicate
+		@returns: if a tile with the same hash was already stored, path is then linked to it at the next flush
+		Otherwise path becomes the stored tile for hash and the caller has to write it
+	*/
+	bool linkDuplicate( boost::uint64_t hash, const boost::filesystem::path &path );
+	/*
+		@method: skip
+		@returns: none
+		For tiles that aren't written because the viewer shows nothing there anyway
+		Removes any file an earlier run left at path at the next flush
+	*/
+	void skip( const boost::filesystem::path &path );
+	/*
+		@method: flush
+		@returns: if every write since the last flush succeeded
+		Waits for everything queued so far to be written, then makes the links
+	*/
+	bool flush();
+
+	unsigned int getLinkedCount() const;
+	unsigned int getSkippedCount() const;
+};
\ No newline at end of file
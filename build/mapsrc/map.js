@@ -1,15 +1,31 @@
+var mapPath = "../maps/MCMapper Test/";
+// Same as ZOOM_LEVELS-1 in the mapper, deeper levels than were written are scaled up here
+var maxZoomInLevels = 3;
+
+// Written by the mapper next to the tiles, maps from before it have every magnified level
+if( typeof mapTiles === "undefined" )
+	var mapTiles = { zoomOutLevels: 0, zoomInLevels: maxZoomInLevels, extension: ".jpeg" };
+// Maps generated before tiles.js had an extension are all JPEG
+if( typeof mapTiles.extension === "undefined" )
+	mapTiles.extension = ".jpeg";
+
 function getMinecraftTile( coord, zoom )
 {
-	var zoomDivision = Math.pow( 2, zoom );
+	var level = zoom - mapTiles.zoomOutLevels;
+	var zoomDivision = Math.pow( 2, level );
 	var regionX, regionY;
 	var xOffset, yOffset;
 	var index;
 	
+	// Zoomed out tiles each cover a square of 2^-level regions
+	if( level < 0 )
+		return mapPath + level + "/t." + coord.x + "." + coord.y + mapTiles.extension;
+	
 	regionX = Math.floor( coord.x / zoomDivision );
 	regionY = Math.floor( coord.y / zoomDivision );
 	xOffset = Math.abs( coord.x % zoomDivision );
 	yOffset = Math.abs( coord.y % zoomDivision );
-	if( zoom != 0 )
+	if( level != 0 )
 	{
 		if( coord.y < 0 )
 			yOffset = zoomDivision - yOffset;
@@ -18,14 +34,61 @@ function getMinecraftTile( coord, zoom )
 	}
 	index = xOffset + (yOffset * zoomDivision);
 	
-	return "../maps/MCMapper Test/" + zoom + "/r." + regionX + "." + regionY + "-" + index + ".jpeg";
+	return mapPath + level + "/r." + regionX + "." + regionY + "-" + index + mapTiles.extension;
+}
+
+// Tile for a magnified level that wasn't written, the deepest written tile covering it stretched over the map tile
+function getScaledTile( coord, zoom, ownerDocument )
+{
+	var level = zoom - mapTiles.zoomOutLevels;
+	var scale = Math.pow( 2, level - mapTiles.zoomInLevels );
+	var sourceCoord = { x:Math.floor( coord.x / scale ), y:Math.floor( coord.y / scale ) };
+	var xOffset = ((coord.x % scale) + scale) % scale;
+	var yOffset = ((coord.y % scale) + scale) % scale;
+	var tile = ownerDocument.createElement( "div" );
+	var image = ownerDocument.createElement( "img" );
+	
+	tile.style.width = "512px";
+	tile.style.height = "512px";
+	tile.style.overflow = "hidden";
+	image.style.position = "absolute";
+	image.style.width = (512 * scale) + "px";
+	image.style.height = (512 * scale) + "px";
+	image.style.left = (-512 * xOffset) + "px";
+	image.style.top = (-512 * yOffset) + "px";
+	// Blocky like the magnified tiles the mapper writes, not blurred
+	image.style.imageRendering = "pixelated";
+	// Blank tiles aren't written, let the background show through
+	image.onerror = function() { image.style.display = "none"; };
+	image.src = getMinecraftTile( sourceCoord, mapTiles.zoomOutLevels + mapTiles.zoomInLevels );
+	tile.appendChild( image );
+	
+	return tile;
+}
+
+function getTile( coord, zoom, ownerDocument )
+{
+	var image;
+	
+	if( zoom - mapTiles.zoomOutLevels > mapTiles.zoomInLevels )
+		return getScaledTile( coord, zoom, ownerDocument );
+	
+	image = ownerDocument.createElement( "img" );
+	image.style.width = "512px";
+	image.style.height = "512px";
+	image.onerror = function() { image.style.display = "none"; };
+	image.src = getMinecraftTile( coord, zoom );
+	
+	return image;
 }
 
 function setupMap()
 {
 	var mapDesc = {
 		center:new google.maps.LatLng(0,0),
-		zoom:0,
+		zoom:mapTiles.zoomOutLevels,
+		// Same as undrawn parts of a region, blank tiles aren't written
+		backgroundColor:"#c8c8c8",
 		streetViewControl: false,
 		mapTypeControlOptions: {
 			mapTypeIds: ['minecraft']
@@ -34,14 +97,15 @@ function setupMap()
 	
 	var minecraftMap = new google.maps.Map( document.getElementById("minecraft-map"), mapDesc );
 	
-	var minecraftMapType = new google.maps.ImageMapType( {
-		getTileUrl:getMinecraftTile,
+	// Not an ImageMapType, that can only show each tile at its own size
+	var minecraftMapType = {
+		getTile:getTile,
 		tileSize:new google.maps.Size( 512, 512 ),
-		maxZoom:3,
+		maxZoom:mapTiles.zoomOutLevels + maxZoomInLevels,
 		minZoom:0,
 		radius:1738000,
 		name:"Minecraft"
-	});
+	};
 	minecraftMap.mapTypes.set( "minecraft", minecraftMapType );
 	minecraftMap.setMapTypeId( "minecraft" );
 	